@@ -7,12 +7,78 @@
 //
 
 #include <iostream>
+#include <stdexcept>
+#include <string>
 
 #include "render.h"
 
+namespace {
+
+const int kDefaultHeadlessFrames = 300;
+
+// usage: LearnOpenGL [--assets DIR] [--headless] [--frames N] [--seconds S]
+//                    [--warmup N] [--profile FILE] [--asteroids N]
+//                    [--lod-error PIXELS] [--point-lights N] [--deferred]
+//                    [--bloom-levels N] [--bloom-radius R]
+//                    [--bloom-low-quality] [--dynamic-resolution]
+//                    [--target-ms MS] [--hdr-rgb16f]
+RenderOptions ParseOptions(int argc, const char * argv[]) {
+  RenderOptions options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg{argv[i]};
+    bool has_value = i + 1 < argc;
+    if (arg == "--headless") {
+      options.headless = true;
+    } else if (arg == "--deferred") {
+      options.deferred = true;
+    } else if (arg == "--bloom-low-quality") {
+      options.bloom_high_quality = false;
+    } else if (arg == "--hdr-rgb16f") {
+      options.compact_hdr = false;
+    } else if (arg == "--dynamic-resolution") {
+      options.dynamic_resolution = true;
+    } else if (arg == "--assets" && has_value) {
+      options.asset_path = argv[++i];
+      if (options.asset_path.empty())
+        throw std::runtime_error{"Asset path must not be empty"};
+      if (options.asset_path.back() != '/') options.asset_path += '/';
+    } else if (arg == "--frames" && has_value) {
+      options.max_frames = std::stoi(argv[++i]);
+    } else if (arg == "--seconds" && has_value) {
+      options.max_seconds = std::stod(argv[++i]);
+    } else if (arg == "--warmup" && has_value) {
+      options.warmup_frames = std::stoi(argv[++i]);
+    } else if (arg == "--profile" && has_value) {
+      options.profile_path = argv[++i];
+    } else if (arg == "--asteroids" && has_value) {
+      options.num_asteroids = std::stoi(argv[++i]);
+    } else if (arg == "--lod-error" && has_value) {
+      options.lod_error_pixels = std::stof(argv[++i]);
+    } else if (arg == "--point-lights" && has_value) {
+      options.num_point_lights = std::stoi(argv[++i]);
+    } else if (arg == "--bloom-levels" && has_value) {
+      options.bloom_levels = std::stoi(argv[++i]);
+    } else if (arg == "--bloom-radius" && has_value) {
+      options.bloom_radius = std::stof(argv[++i]);
+    } else if (arg == "--target-ms" && has_value) {
+      options.target_frame_ms = std::stod(argv[++i]);
+      if (options.target_frame_ms <= 0.0)
+        throw std::runtime_error{"Target frame time must be positive"};
+    } else {
+      throw std::runtime_error{"Unknown argument: " + arg};
+    }
+  }
+  // nobody can close a headless window
+  if (options.headless && options.max_frames <= 0 && options.max_seconds <= 0)
+    options.max_frames = kDefaultHeadlessFrames;
+  return options;
+}
+
+} /* namespace */
+
 int main(int argc, const char * argv[]) {
   try {
-    Render render;
+    Render render{ParseOptions(argc, argv)};
     render.MainLoop();
     glfwTerminate();
     return 0;
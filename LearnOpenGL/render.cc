@@ -6,35 +6,70 @@
 //  Copyright © 2018 Pujun Lun. All rights reserved.
 //
 
+#include <algorithm>
+#include <cstdio>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include <utility>
 
 #include <glm/glm.hpp>
-#include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "bloom.h"
 #include "camera.h"
 #include "loader.h"
 #include "model.h"
+#include "profiler.h"
+#include "render_queue.h"
+#include "render_target_pool.h"
+#include "resolution_scaler.h"
+#include "scene.h"
 #include "shadow.h"
+#include "stream_buffer.h"
 #include "text.h"
+#include "instance_culler.h"
+#include "light_clusters.h"
 #include "render.h"
 
 namespace loader = wrapper::opengl::loader;
 using std::string;
+using std::unique_ptr;
 using std::vector;
 using glm::vec3;
 using glm::vec4;
 using glm::mat3;
 using glm::mat4;
+using wrapper::opengl::Bloom;
 using wrapper::opengl::Camera;
 using wrapper::opengl::CameraMoveDirection;
+using wrapper::opengl::DrawItem;
+using wrapper::opengl::FrameStats;
+using wrapper::opengl::GpuProfiler;
+using wrapper::opengl::InstanceCuller;
+using wrapper::opengl::kMaxLods;
+using wrapper::opengl::LightClusters;
 using wrapper::opengl::OmniShadow;
+using wrapper::opengl::PointLight;
+using wrapper::opengl::RenderQueue;
+using wrapper::opengl::RenderTargetDesc;
+using wrapper::opengl::RenderTargetPool;
+using wrapper::opengl::ResolutionScaler;
+using wrapper::opengl::Scene;
+using wrapper::opengl::Shadow;
+using wrapper::opengl::ShadowScheduler;
+using wrapper::opengl::StreamBuffer;
+using wrapper::opengl::Material;
 using wrapper::opengl::Model;
 using wrapper::opengl::Shader;
 using wrapper::opengl::Text;
+using wrapper::opengl::TextureType;
+using wrapper::opengl::UniformHandle;
 using wrapper::opengl::UniShadow;
 
 typedef struct ScreenSize {
@@ -44,8 +79,11 @@ typedef struct ScreenSize {
 
 const int SCREEN_WIDTH = 800;
 const int SCREEN_HEIGHT = 600;
-const int NUM_POINT_LIGHTS = 3;
-const int NUM_ASTEROID = 750;
+const int NUM_LAMPS = 3;
+// must match shaders/lighting.glsl
+const int NUM_POINT_SHADOWS = 3;
+// upper bound of text vertices streamed per frame
+const GLsizeiptr STREAM_TEXT_BYTES = 64 * 1024;
 
 Camera camera(vec3(0.0f, 0.0f, 10.0f));
 float lastFrame = 0.0f;
@@ -53,6 +91,41 @@ float explosion = 0.0f;
 ScreenSize originalSize{0, 0};
 ScreenSize currentSize{0, 0};
 
+// uniforms of lights that are set every frame, shared by shader_object.fs
+// (forward) and shader_deferred.fs
+struct LightingUniforms {
+  UniformHandle<int> pointLightDepthMaps[NUM_POINT_SHADOWS];
+  UniformHandle<vec3> pointLightsPos[NUM_POINT_SHADOWS];
+  UniformHandle<float> frustumHeights[NUM_POINT_SHADOWS];
+  UniformHandle<mat4> dirLightSpace, spotLightSpace;
+  UniformHandle<int> dirLightDepthMap, spotLightDepthMap, envMap;
+  UniformHandle<mat3> invView;
+  UniformHandle<vec3> dirLightDir;
+  LightClusters::Uniforms clusters;
+};
+
+LightingUniforms getLightingUniforms(const Shader& shader) {
+  LightingUniforms uniforms;
+  for (int i = 0; i < NUM_POINT_SHADOWS; ++i) {
+    string index = std::to_string(i);
+    uniforms.pointLightDepthMaps[i] = shader.get_handle<int>(
+        "pointLightDepthMaps[" + index + "]");
+    uniforms.pointLightsPos[i] = shader.get_handle<vec3>(
+        "pointLightsPos[" + index + "]");
+    uniforms.frustumHeights[i] = shader.get_handle<float>(
+        "frustumHeights[" + index + "]");
+  }
+  uniforms.dirLightSpace = shader.get_handle<mat4>("dirLightSpace");
+  uniforms.spotLightSpace = shader.get_handle<mat4>("spotLightSpace");
+  uniforms.dirLightDepthMap = shader.get_handle<int>("dirLightDepthMap");
+  uniforms.spotLightDepthMap = shader.get_handle<int>("spotLightDepthMap");
+  uniforms.envMap = shader.get_handle<int>("material.envMap");
+  uniforms.invView = shader.get_handle<mat3>("invView");
+  uniforms.dirLightDir = shader.get_handle<vec3>("dirLight.direction");
+  uniforms.clusters = LightClusters::GetUniforms(shader);
+  return uniforms;
+}
+
 void framebufferSizeCallback(GLFWwindow *window, int width, int height) {
   currentSize.width = width;
   currentSize.height = height;
@@ -92,8 +165,12 @@ void Render::ProcessKeyboardInput() {
     explosion = std::min(9.9f, explosion + 0.1f);
 }
 
-Render::Render() {
-  glfwInit();
+Render::Render(const RenderOptions& options) : options_{options} {
+#if !defined(__APPLE__) && defined(GLFW_PLATFORM_NULL)
+  // no display server is required if we never show the window
+  if (options_.headless) glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+  if (!glfwInit()) throw std::runtime_error{"Failed to init GLFW"};
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -102,25 +179,41 @@ Render::Render() {
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+  if (options_.headless) {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+#if !defined(__APPLE__)
+    // OSMesa renders into client memory, so it works on machines without GPU
+    // (Mesa llvmpipe) and without a display server
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#endif
+  }
+
   // ------------------------------------
   // window
 
   window_ = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "LearnOpenGL", NULL, NULL);
-  if (window_ == NULL) throw "Failed to create window";
+  if (window_ == NULL) throw std::runtime_error{"Failed to create window"};
 
   glfwMakeContextCurrent(window_);
-  // called when window is resized by the user
-  glfwSetFramebufferSizeCallback(window_, framebufferSizeCallback);
-  // hide mouse and capture input
-  glfwSetInputMode(window_, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-  glfwSetCursorPosCallback(window_, mouseMoveCallback);
-  glfwSetScrollCallback(window_, mouseScrollCallback);
+  if (options_.is_benchmark()) {
+    // measure how fast we can render, rather than the refresh rate
+    glfwSwapInterval(0);
+  } else {
+    // called when window is resized by the user
+    glfwSetFramebufferSizeCallback(window_, framebufferSizeCallback);
+    // hide mouse and capture input
+    glfwSetInputMode(window_, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glfwSetCursorPosCallback(window_, mouseMoveCallback);
+    glfwSetScrollCallback(window_, mouseScrollCallback);
+  }
 
   // ------------------------------------
   // GLAD (function pointer loader)
   // do this after context is created, and before calling any OpenGL function!
 
-  if (!gladLoadGL()) throw "Failed to init GLAD";
+  // load through GLFW, since the context may not come from the native API
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    throw std::runtime_error{"Failed to init GLAD"};
 
   // screen size is different from the input width and height on retina screen
   int width, height;
@@ -135,15 +228,15 @@ void Render::MainLoop() {
   // ------------------------------------
   // shader program
 
-  string path = "/Users/lun/Desktop/Code/LearnOpenGL/LearnOpenGL/";
+  const string& path = options_.asset_path;
   Shader hdrShader(path + "shaders/shader_screen.vs",
                    path + "shaders/shader_hdr.fs");
   Shader textShader(path + "shaders/shader_text.vs",
                     path + "shaders/shader_text.fs");
   Shader lampShader(path + "shaders/shader_lamp.vs",
                     path + "shaders/shader_lamp.fs");
-  Shader blendShader(path + "shaders/shader_screen.vs",
-                     path + "shaders/shader_blend.fs");
+  Shader postShader(path + "shaders/shader_screen.vs",
+                    path + "shaders/shader_post.fs");
   Shader glassShader(path + "shaders/shader_glass.vs",
                      path + "shaders/shader_glass.fs");
   Shader objectShader(path + "shaders/shader_object.vs",
@@ -151,20 +244,35 @@ void Render::MainLoop() {
                       path + "shaders/shader_object.gs");
   Shader skyboxShader(path + "shaders/shader_skybox.vs",
                       path + "shaders/shader_skybox.fs");
-  Shader screenShader(path + "shaders/shader_screen.vs",
-                      path + "shaders/shader_screen.fs");
   Shader planetShader(path + "shaders/shader_planet.vs",
                       path + "shaders/shader_planet.fs");
   Shader asteroidShader(path + "shaders/shader_asteroid.vs",
                         path + "shaders/shader_planet.fs");
   Shader gaussianShader(path + "shaders/shader_screen.vs",
                         path + "shaders/shader_gaussian.fs");
+  Shader bloomDownShader(path + "shaders/shader_screen.vs",
+                         path + "shaders/shader_bloom_down.fs");
+  Shader bloomUpShader(path + "shaders/shader_screen.vs",
+                       path + "shaders/shader_bloom_up.fs");
+  // deferred path writes what shader_object.fs samples to G-buffer, and
+  // lights it in screen space
+  Shader gbufferShader(path + "shaders/shader_object.vs",
+                       path + "shaders/shader_gbuffer.fs",
+                       path + "shaders/shader_object.gs");
+  Shader deferredShader(path + "shaders/shader_screen.vs",
+                        path + "shaders/shader_deferred.fs");
 
 
   // ------------------------------------
   // models
   
-  Text text;
+  // everything written by the CPU every frame: matrices, visible asteroids,
+  // light clusters and text vertices
+  StreamBuffer stream(2 * sizeof(mat4) + StreamBuffer::UniformAlignment() +
+                      options_.num_asteroids * sizeof(mat4) +
+                      LightClusters::MaxUploadSize() + STREAM_TEXT_BYTES);
+  Text text(path + "texture/georgia.ttf", &stream);
+  LightClusters lightClusters(&stream);
   vec3 textColor(0.0f);
 
   Model lamp(path + "texture/cube.obj");
@@ -189,7 +297,7 @@ void Render::MainLoop() {
   GLuint blackTex = loader::LoadTexture(path + "texture/black.jpg", true);
 
   vector<OmniShadow> pointLightShadows;
-  for (int i = 0; i < NUM_POINT_LIGHTS; ++i) {
+  for (int i = 0; i < NUM_POINT_SHADOWS; ++i) {
     pointLightShadows.emplace_back(OmniShadow::PointLightShadow());
   }
 
@@ -208,59 +316,123 @@ void Render::MainLoop() {
   // framebuffer holds color, depth (optinal) and stencil (optional) buffer
   GLuint framebuffer;
   glGenFramebuffers(1, &framebuffer);
-  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+  // every render target comes from this pool. colorBuffer and
+  // depthStencilTex live as long as render size stays the same. others only
+  // live through the passes that write and read them in a frame, and are
+  // given back right after, so that later passes asking for the same size
+  // and format reuse their memory. render size is original size scaled down
+  // when GPU cannot keep up with target frame time, and upscaled bilinearly
+  // by the post pass. targets of each size are kept for a while after it
+  // changes, so going back and forth between sizes does not reallocate them
+  RenderTargetPool targetPool;
+  // only built if enabled, otherwise render size is always original size
+  unique_ptr<ResolutionScaler> resolutionScaler;
+  if (options_.dynamic_resolution)
+    resolutionScaler.reset(new ResolutionScaler(options_.target_frame_ms));
+  ScreenSize renderSize{0, 0};
+  // HDR color needs no alpha, and GL_R11F_G11F_B10F takes half the memory
+  // and bandwidth of GL_RGB16F, which drivers store with alpha
+  const GLenum hdrFormat = options_.compact_hdr ? GL_R11F_G11F_B10F
+                                                : GL_RGB16F;
 
   // framebuffer should have at least one color attachment
-  // use GL_RGB16F to store HDR render results
-  // colorBuffers[0] for all fragments, colorBuffers[1] only for highlights
-  // colorBuffers[2] and colorBuffers[3] are ping-pong buffers
-  GLuint colorBuffers[4];
-  glGenTextures(4, colorBuffers);
-  for (int i = 0; i < 4; ++i) {
-    glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, originalSize.width, originalSize.height, 0, GL_RGB, GL_FLOAT, NULL); // data is set to NULL, because later contents will be rendered to it
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // no need for mipmap
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i,
-                           GL_TEXTURE_2D, colorBuffers[i], 0);
-  }
+  // colorBuffer is HDR render results of all fragments
+  GLuint colorBuffer = 0;
+  // depth and stencil are stored in a texture rather than a render buffer,
+  // so that it comes from the pool as well. deferred lighting also
+  // reconstructs positions from it
+  GLuint depthStencilTex = 0;
+
+  // G-buffer shares depth and stencil with framebuffer above, so that lamps,
+  // planet and others are still drawn forward and tested against it after
+  // lighting. lighting is written to colorBuffer through a framebuffer
+  // without depth, since depth is sampled meanwhile
+  // gBuffers[0]: normal in view space and reflection ratio
+  // gBuffers[1]: diffuse color, gBuffers[2]: specular color
+  // they are only needed until lighting, and acquired every frame
+  GLuint gbufferFramebuffer = 0, lightingFramebuffer = 0;
+  GLuint gBuffers[3]{}, attachedGBuffers[3]{};
+  const GLenum gBufferFormats[3]{GL_RGBA16F, GL_RGBA8, GL_RGBA8};
   // later we have to specify which color buffer(s) to render to
-  GLuint attachments[4]{
+  const GLenum attachments[3]{
       GL_COLOR_ATTACHMENT0,
       GL_COLOR_ATTACHMENT1,
       GL_COLOR_ATTACHMENT2,
-      GL_COLOR_ATTACHMENT3,
   };
-  glBindTexture(GL_TEXTURE_2D, 0);
-
-  // render buffer is preferred when we don't need to sample data (depth/stencil)
-  // otherwise we use texture (color)
-  GLuint RBO;
-  glGenRenderbuffers(1, &RBO);
-  glBindRenderbuffer(GL_RENDERBUFFER, RBO);
-  // enable to store both depth and stencil buffer (also only allocate memory, without content)
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, currentSize.width, currentSize.height);
-  glBindRenderbuffer(GL_RENDERBUFFER, 0);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, RBO);
+  if (options_.deferred) {
+    glGenFramebuffers(1, &gbufferFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, gbufferFramebuffer);
+    glDrawBuffers(3, attachments);
+    glGenFramebuffers(1, &lightingFramebuffer);
+  }
 
+  // when bloom runs at full resolution, highlights are blurred through a
+  // framebuffer whose only attachment is switched between targets
+  GLuint blurFramebuffer = 0;
+  if (options_.bloom_levels <= 0) glGenFramebuffers(1, &blurFramebuffer);
+
+  // final image is copied here to be shown in small size, at a quarter of
+  // original size
+  const ScreenSize insetSize{originalSize.width / 4, originalSize.height / 4};
+  GLuint insetFramebuffer;
+  glGenFramebuffers(1, &insetFramebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, insetFramebuffer);
+  GLuint insetBuffer = targetPool.Acquire(
+      {insetSize.width, insetSize.height, GL_RGBA8, 0}, GL_LINEAR);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, insetBuffer, 0);
   if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-      throw "Frame buffer incomplete";
-
+      throw std::runtime_error{"Inset framebuffer incomplete"};
   glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+  // highlights are blurred over a chain of smaller levels, unless bloom is
+  // asked to run at full resolution
+  unique_ptr<Bloom> bloom;
+  if (options_.bloom_levels > 0) {
+    bloom.reset(new Bloom(bloomDownShader, bloomUpShader, &targetPool,
+                          options_.bloom_levels, options_.bloom_radius,
+                          options_.bloom_high_quality, hdrFormat));
+  }
+
+  // gives targets of the previous size back to the pool, and attaches ones
+  // of the new size
+  auto resizeTargets = [&](ScreenSize size) {
+    targetPool.Release(colorBuffer);
+    targetPool.Release(depthStencilTex);
+    colorBuffer = targetPool.Acquire({size.width, size.height, hdrFormat, 0},
+                                     GL_LINEAR);
+    depthStencilTex = targetPool.Acquire(
+        {size.width, size.height, GL_DEPTH24_STENCIL8, 0}, GL_NEAREST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D, colorBuffer, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                           GL_TEXTURE_2D, depthStencilTex, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      throw std::runtime_error{"Frame buffer incomplete"};
+
+    if (options_.deferred) {
+      // G-buffer is checked when its own targets are attached
+      glBindFramebuffer(GL_FRAMEBUFFER, gbufferFramebuffer);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                             GL_TEXTURE_2D, depthStencilTex, 0);
+
+      glBindFramebuffer(GL_FRAMEBUFFER, lightingFramebuffer);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_TEXTURE_2D, colorBuffer, 0);
+      if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error{"Lighting framebuffer incomplete"};
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    renderSize = size;
+  };
+  resizeTargets(originalSize);
+
 
   // ------------------------------------
   // parameters
 
-  GLuint uboMatrices; // used to store view and projection matrices
-  glGenBuffers(1, &uboMatrices);
-  glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-  glBufferData(GL_UNIFORM_BUFFER, 2 * sizeof(mat4), NULL, GL_DYNAMIC_DRAW); // no data yet
-  glBindBufferBase(GL_UNIFORM_BUFFER, 0, uboMatrices); // or use glBindBufferRange for flexibility
-  glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
   for (Shader& shader : vector<Shader>{
       lampShader,
       glassShader,
@@ -287,16 +459,18 @@ void Render::MainLoop() {
   vec3 planetCenter(0.0f, 5.5f, 0.0f);
   mat4 planetModel = glm::translate(glm::mat4(1.0f), planetCenter);
 
-  vector<mat4> asteroidModels(NUM_ASTEROID);
-  srand(glfwGetTime()); // random seed
+  const int numAsteroids = options_.num_asteroids;
+  vector<mat4> asteroidModels(numAsteroids);
+  // fixed seed when benchmarking, so that every run renders the same scene
+  srand(options_.is_benchmark() ? 0 : glfwGetTime()); // random seed
   float radius = 5.0f, offset = 1.0f, displacement[3];
-  for (int i = 0; i < NUM_ASTEROID; ++i) {
+  for (int i = 0; i < numAsteroids; ++i) {
     for (int j = 0; j < 3; ++j)
       displacement[j] = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
 
     mat4 model = glm::translate(mat4(1.0f), planetCenter);
 
-    float theta = (float)i / NUM_ASTEROID * 360.0f;
+    float theta = (float)i / numAsteroids * 360.0f;
     float x = sin(theta) * radius + displacement[0];
     float y = displacement[1] * 0.4f;
     float z = cos(theta) * radius + displacement[2];
@@ -311,17 +485,20 @@ void Render::MainLoop() {
     asteroidModels[i] = model;
   }
 
-  GLuint VBO;
-  glGenBuffers(1, &VBO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, NUM_ASTEROID * sizeof(mat4), asteroidModels.data(), GL_STATIC_DRAW);
+  // only visible instances are streamed to this buffer every frame, grouped
+  // by level of detail, and each group is drawn with one instanced call
+  InstanceCuller asteroidCuller(asteroid.bounds(), asteroidModels);
+  vector<mat4> asteroidLodModels[kMaxLods];
+  GLintptr asteroidLodOffsets[kMaxLods];
+  glBindBuffer(GL_ARRAY_BUFFER, stream.buffer());
 
-  auto func = []() {
+  // offset is in bytes, where the first instance of a draw starts
+  auto setInstanceAttributes = [](size_t offset) {
     for (int attrib = 3; attrib <= 6; ++attrib) {
       // maximum amount of data allowed as a vertex attribute is equal to a vec4
       // so state that there are 4 vec4s as a workaround
       glVertexAttribPointer(attrib, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(vec4),
-                            (void *)(sizeof(vec4) * (attrib - 3)));
+                            (void *)(offset + sizeof(vec4) * (attrib - 3)));
       glEnableVertexAttribArray(attrib);
       // second parameter means to read next chunk of data after how many instances
       // if stated as 1, model data gets updated only after one entire instance is drawn,
@@ -329,65 +506,74 @@ void Render::MainLoop() {
       glVertexAttribDivisor(attrib, 1);
     }
   };
-  asteroid.AppendData(func);
+  asteroid.AppendData([&]() { setInstanceAttributes(0); });
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
 
   vec3 lightColor(0.4f);
   vec3 ambientColor = lightColor * 0.1f;
   vec3 diffuseColor = lightColor * 0.6f;
 
-  vec3 lampPos[NUM_POINT_LIGHTS]{
+  vec3 lampPos[NUM_LAMPS]{
       vec3( 0.0f, -3.0f,  4.0f),
       vec3(-4.0f, -1.0f, -3.0f),
       vec3( 4.0f,  2.0f, -2.0f),
   };
-  for (int i = 0; i < NUM_POINT_LIGHTS; ++i)
-    pointLightShadows[i].MoveLight(lampPos[i]);
 
-  vec3 lampColor[NUM_POINT_LIGHTS]{
+  vec3 lampColor[NUM_LAMPS]{
       vec3(1.0f, 0.0f, 0.0f),
       vec3(0.0f, 1.0f, 0.0f),
       vec3(0.0f, 0.0f, 1.0f),
   };
 
-  objectShader.Use();
-  objectShader.set_float("material.shininess", 0.2f);
-  for (int i = 0; i < NUM_POINT_LIGHTS; ++i) {
-    string index = std::to_string(i);
-    objectShader.set_float("frustumHeights[" + index + "]",
-                           pointLightShadows[i].frustum_height());
-    objectShader.set_vec3("pointLightsPos[" + index + "]", lampPos[i]);
+  // lamps come first, and are bright enough to reach the whole scene. the
+  // rest are small lights scattered around the floor and the planet, which
+  // are cut off early so that each of them only touches a few clusters
+  const vec3 pointLightAttenuation{1.0f, 0.1f, 0.002f};
+  vector<PointLight> pointLights;
+  for (int i = 0; i < NUM_LAMPS; ++i) {
+    vec3 color = lampColor[i] * 0.5f;
+    pointLights.emplace_back(PointLight{
+        lampPos[i], color,
+        LightClusters::Range(color, pointLightAttenuation), -1});
+  }
+  for (int i = 0; i < options_.num_point_lights; ++i) {
+    float angle = glm::radians((rand() % 3600) / 10.0f);
+    float distance = (rand() % 1000) / 100.0f; // 0 ~ 10
+    float height = (rand() % 1200) / 100.0f - 4.5f; // -4.5 ~ 7.5
+    vec3 color{(rand() % 100) / 100.0f, (rand() % 100) / 100.0f,
+               (rand() % 100) / 100.0f};
+    pointLights.emplace_back(PointLight{
+        vec3(sin(angle) * distance, height, cos(angle) * distance),
+        color * 0.3f, 1.5f + (rand() % 150) / 100.0f, -1}); // range 1.5 ~ 3
   }
 
+  // both paths light with the same parameters
+  Shader& lightingShader = options_.deferred ? deferredShader : objectShader;
+  lightingShader.Use();
+  lightingShader.set_float("material.shininess", 0.2f);
+
   // directional light
-  objectShader.set_vec3("dirLight.ambient", {0.0f, 0.0f, 0.0f});
-  objectShader.set_vec3("dirLight.diffuse", diffuseColor * 0.5f);
-  objectShader.set_vec3("dirLight.specular", ambientColor * 0.5f);
-
-  // point lights
-  for (int i = 0; i < NUM_POINT_LIGHTS; ++i) {
-    string light = "pointLights[" + std::to_string(i) + "]";
-    objectShader.set_float(light + ".constant", 1.0f);
-    objectShader.set_float(light + ".linear", 0.1f);
-    objectShader.set_float(light + ".quadratic", 0.002f);
-    vec3 ambient = ambientColor * lampColor[i];
-    vec3 diffuse = diffuseColor * lampColor[i];
-    vec3 specular = lightColor * lampColor[i];
-    objectShader.set_vec3(light + ".ambient", ambient * 0.5f);
-    objectShader.set_vec3(light + ".diffuse", diffuse * 0.5f);
-    objectShader.set_vec3(light + ".specular", specular * 0.5f);
-  }
+  lightingShader.set_vec3("dirLight.ambient", {0.0f, 0.0f, 0.0f});
+  lightingShader.set_vec3("dirLight.diffuse", diffuseColor * 0.5f);
+  lightingShader.set_vec3("dirLight.specular", ambientColor * 0.5f);
+
+  // point lights, which scale ambient, diffuse and specular of light color
+  // the same way
+  lightingShader.set_vec3("pointLightAttenuation", pointLightAttenuation);
+  lightingShader.set_vec3("pointLightIntensity",
+                          vec3(ambientColor.x, diffuseColor.x, lightColor.x));
 
   // spot light
-  objectShader.set_vec3("spotLight.position", {0.0f, 0.0f, 0.0f});
-  objectShader.set_vec3("spotLight.direction", {0.0f, 0.0f, -1.0f});
-  objectShader.set_float("spotLight.innerCutOff", glm::cos(glm::radians(7.5f)));
-  objectShader.set_float("spotLight.outerCutOff", glm::cos(glm::radians(12.5f)));
-  objectShader.set_float("spotLight.constant", 1.0f);
-  objectShader.set_float("spotLight.linear", 0.1f);
-  objectShader.set_float("spotLight.quadratic", 0.002f);
-  objectShader.set_vec3("spotLight.ambient", ambientColor * 0.5f);
-  objectShader.set_vec3("spotLight.diffuse", diffuseColor * 0.5f);
-  objectShader.set_vec3("spotLight.specular", lightColor * 0.5f);
+  lightingShader.set_vec3("spotLight.position", {0.0f, 0.0f, 0.0f});
+  lightingShader.set_vec3("spotLight.direction", {0.0f, 0.0f, -1.0f});
+  lightingShader.set_float("spotLight.innerCutOff", glm::cos(glm::radians(7.5f)));
+  lightingShader.set_float("spotLight.outerCutOff", glm::cos(glm::radians(12.5f)));
+  lightingShader.set_float("spotLight.constant", 1.0f);
+  lightingShader.set_float("spotLight.linear", 0.1f);
+  lightingShader.set_float("spotLight.quadratic", 0.002f);
+  lightingShader.set_vec3("spotLight.ambient", ambientColor * 0.5f);
+  lightingShader.set_vec3("spotLight.diffuse", diffuseColor * 0.5f);
+  lightingShader.set_vec3("spotLight.specular", lightColor * 0.5f);
 
 
   // ------------------------------------
@@ -396,13 +582,332 @@ void Render::MainLoop() {
   int frameCount = 0, FPS = 0;
   double lastTime = glfwGetTime();
 
+  FrameStats frameStats;
+  // dynamic resolution is driven by GPU time of zones
+  GpuProfiler profiler(
+      !options_.profile_path.empty() || options_.dynamic_resolution,
+      options_.profile_path);
+  int benchmarkFrames = 0;
+  double cullSeconds = 0.0;
+  size_t numCulledAsteroids = 0, numDrawnAsteroids = 0;
+  double benchmarkStart = 0.0, lastFrameEnd = 0.0;
+  auto benchmarkDone = [&]() {
+    if (benchmarkFrames < options_.warmup_frames) return false;
+    bool reachFrames = options_.max_frames > 0 &&
+        frameStats.num_frames() >= static_cast<size_t>(options_.max_frames);
+    bool reachSeconds = options_.max_seconds > 0.0 &&
+        lastFrameEnd - benchmarkStart >= options_.max_seconds;
+    return reachFrames || reachSeconds;
+  };
+
+  // resolve uniforms set every frame once, so that the loop below does not
+  // build strings or look up names
+  auto lampModelUniform = lampShader.get_handle<mat4>("model");
+  auto lampColorUniform = lampShader.get_handle<vec3>("lightColor");
+
+  const LightingUniforms lightingUniforms =
+      getLightingUniforms(lightingShader);
+  auto explosionUniform = objectShader.get_handle<float>("explosion");
+  auto normalUniform = objectShader.get_handle<mat3>("normal");
+  auto objectModelUniform = objectShader.get_handle<mat4>("model");
+  auto gbufferExplosionUniform = gbufferShader.get_handle<float>("explosion");
+  auto gbufferNormalUniform = gbufferShader.get_handle<mat3>("normal");
+  auto gbufferModelUniform = gbufferShader.get_handle<mat4>("model");
+  auto clipToViewUniform = deferredShader.get_handle<mat4>("clipToView");
+  auto viewToWorldUniform = deferredShader.get_handle<mat4>("viewToWorld");
+
+  // G-buffer is bound from GL_TEXTURE6, after shadow maps and environment
+  // map, and light clusters after it
+  deferredShader.Use();
+  deferredShader.set_int("gNormal", 6);
+  deferredShader.set_int("gAlbedo", 7);
+  deferredShader.set_int("gSpecular", 8);
+  deferredShader.set_int("gDepth", 9);
+
+  auto planetModelUniform = planetShader.get_handle<mat4>("model");
+  auto skyboxUniform = skyboxShader.get_handle<int>("skybox");
+  auto glassTexUniform = glassShader.get_handle<int>("texture1");
+  auto hdrTexUniform = hdrShader.get_handle<int>("texture1");
+  auto gaussianTexUniform = gaussianShader.get_handle<int>("texture1");
+  auto horizontalUniform = gaussianShader.get_handle<int>("horizontal");
+  auto exposureUniform = postShader.get_handle<float>("exposure");
+  auto sceneUniform = postShader.get_handle<int>("scene");
+  auto bloomUniform = postShader.get_handle<int>("bloom");
+
+  // everything except skybox and asteroids (which are culled per instance)
+  // is placed in scene, so that draws and shadow casters can be skipped by
+  // visibility queries. only object and floor cast shadows
+  Scene scene;
+  int objectId = scene.Add(object, objectModel);
+  int floorId = scene.Add(glass, floorModel);
+  int glassId = scene.Add(glass, glassModel, false);
+  int planetId = scene.Add(planet, glm::scale(planetModel, vec3(0.5f)), false);
+  mat4 lampModels[NUM_LAMPS], lampOutlineModels[NUM_LAMPS];
+  int lampIds[NUM_LAMPS];
+  for (int i = 0; i < NUM_LAMPS; ++i) {
+    lampModels[i] = glm::scale(glm::translate(mat4(1.0f), lampPos[i]),
+                               vec3(0.8f));
+    lampOutlineModels[i] = glm::scale(glm::translate(mat4(1.0f), lampPos[i]),
+                                      vec3(0.85f));
+    // outline is larger, so it bounds both
+    lampIds[i] = scene.Add(lamp, lampOutlineModels[i], false);
+  }
+  vector<int> visibleIds;
+
+  // main pass is drawn through render queue. within each pass, draws are
+  // sorted by program, textures and depth, and each pass sets the state it
+  // needs, since passes without visible items are skipped
+  enum { kLampPass, kOutlinePass, kOpaquePass, kSkyboxPass, kGlassPass };
+  RenderQueue renderQueue;
+  renderQueue.AddPass(kLampPass, false, []() {
+    // enable any of fragments of lights (lamps) to update stencil buffer with 1
+    // so that later we know where we should not draw outlines
+    glStencilFunc(GL_ALWAYS, 1, 0xFF); // let stencil test always pass
+    glStencilMask(0xFF);
+  });
+  renderQueue.AddPass(kOutlinePass, false, []() {
+    glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
+  });
+  renderQueue.AddPass(kOpaquePass, false, []() {
+    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    glStencilMask(0xFF);
+  });
+  // render this after all oblique objects are rendered
+  // a trick: set depth to be 1.0 by setting gl_Position.zw to 1.0
+  //          and depth function to GL_LEQUAL, so that skybox lays
+  //          right on maximum depth (can either set gl_FragDepth
+  //          to 1.0 in fragment shader, however, in that case OpenGL
+  //          cannot do early depth testing any more)
+  renderQueue.AddPass(kSkyboxPass, false, []() {
+    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    glDepthFunc(GL_LEQUAL);
+  });
+  // render this at last because of alpha blending
+  renderQueue.AddPass(kGlassPass, true, []() {
+    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    glDepthFunc(GL_LESS);
+  });
+
+  mat4 view;
+  // binds shadow maps to GL_TEXTURE0 ~ GL_TEXTURE4 and environment map to
+  // GL_TEXTURE5, and sets lights for lightingShader, which must be in use
+  auto bindLights = [&](GLuint clusterTexUnit) {
+    const LightingUniforms& uniforms = lightingUniforms;
+    for (int i = 0; i < NUM_POINT_SHADOWS; ++i) {
+      pointLightShadows[i].BindShadowMap(GL_TEXTURE0 + i);
+      lightingShader.set(uniforms.pointLightDepthMaps[i], i);
+    }
+    lightingShader.set(uniforms.dirLightSpace, dirLightShadow.light_space());
+    dirLightShadow.BindShadowMap(GL_TEXTURE3);
+    lightingShader.set(uniforms.dirLightDepthMap, 3);
+    lightingShader.set(uniforms.spotLightSpace, spotLightShadow.light_space());
+    spotLightShadow.BindShadowMap(GL_TEXTURE4);
+    lightingShader.set(uniforms.spotLightDepthMap, 4);
+
+    // note! even if we don't need cudemap when render floor, material.cubemap
+    // still must have a value
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTex);
+    lightingShader.set(uniforms.envMap, 5);
+
+    mat3 invView = glm::inverse(glm::mat3(view));
+    lightingShader.set(uniforms.invView, invView);
+
+    // lights direction in camera space
+    vec3 dirLightDir = vec3(view * vec4(dirLight, 0.0f));
+    lightingShader.set(uniforms.dirLightDir, dirLightDir);
+    lightClusters.Bind(lightingShader, uniforms.clusters, clusterTexUnit);
+  };
+  renderQueue.AddProgram(lampShader, 0, []() {
+    glEnable(GL_CULL_FACE);
+  }, [&](const DrawItem& item) {
+    lampShader.set(lampModelUniform, item.transform);
+    lampShader.set(lampColorUniform, item.pass == kOutlinePass ?
+                   vec3(5.0f, 5.0f, 0.0f) : lampColor[item.index]);
+  });
+  // textures of meshes are bound from GL_TEXTURE6, after shadow maps and
+  // environment map, and light clusters after them
+  renderQueue.AddProgram(objectShader, 6, [&]() {
+    glDisable(GL_CULL_FACE); // for explosion effect
+    objectShader.set(explosionUniform, explosion);
+    bindLights(6 + wrapper::opengl::kNumMaterialSlots);
+  }, [&](const DrawItem& item) {
+    mat3 normal = glm::transpose(glm::inverse(mat3(view * item.transform)));
+    objectShader.set(normalUniform, normal);
+    objectShader.set(objectModelUniform, item.transform);
+  });
+  // G-buffer of deferred path is filled by a queue of its own, since lighting
+  // must happen between it and the rest of scene. stencil is left alone,
+  // where lamps mark pixels that outlines must not cover, and nothing is
+  // blended, since alpha channels hold other data
+  RenderQueue gbufferQueue;
+  gbufferQueue.AddPass(kOpaquePass, false, []() {
+    glDisable(GL_STENCIL_TEST);
+    glDisable(GL_BLEND);
+  });
+  gbufferQueue.AddProgram(gbufferShader, 0, [&]() {
+    glDisable(GL_CULL_FACE); // for explosion effect
+    gbufferShader.set(gbufferExplosionUniform, explosion);
+  }, [&](const DrawItem& item) {
+    mat3 normal = glm::transpose(glm::inverse(mat3(view * item.transform)));
+    gbufferShader.set(gbufferNormalUniform, normal);
+    gbufferShader.set(gbufferModelUniform, item.transform);
+  });
+  renderQueue.AddProgram(planetShader, 0, []() {
+    glEnable(GL_CULL_FACE);
+  }, [&](const DrawItem& item) {
+    planetShader.set(planetModelUniform, item.transform);
+  });
+  renderQueue.AddProgram(asteroidShader, 0, []() {
+    glEnable(GL_CULL_FACE);
+  }, [&](const DrawItem& item) {
+    // there is no base instance in OpenGL 3.3, so attributes are pointed at
+    // the group of this level instead
+    glBindBuffer(GL_ARRAY_BUFFER, stream.buffer());
+    item.mesh->AppendData([&]() {
+      setInstanceAttributes(asteroidLodOffsets[item.index]);
+    });
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  });
+  renderQueue.AddProgram(skyboxShader, 0, [&]() {
+    glEnable(GL_CULL_FACE);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTex);
+    skyboxShader.set(skyboxUniform, 0);
+  }, nullptr);
+  renderQueue.AddProgram(glassShader, 0, [&]() {
+    glEnable(GL_CULL_FACE);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, glassTex);
+    glassShader.set(glassTexUniform, 0);
+  }, nullptr);
+
+  // floor is drawn with the glass model, but with a material of its own
+  const Material floorMaterial = wrapper::opengl::BuildMaterials({{
+      {floorTex, TextureType::kDiffuse},
+      {blackTex, TextureType::kSpecular},
+      {blackTex, TextureType::kReflection},
+  }})[0];
+  // floor only samples them through floorMaterial
+  loader::ReleaseTextures({floorTex, blackTex});
+  // how each object in scene is submitted when visible
+  std::unordered_map<int, std::function<void (int, float)>> submitters;
+  // what shader_object.fs would light goes to G-buffer in deferred path
+  RenderQueue& litQueue = options_.deferred ? gbufferQueue : renderQueue;
+  const Shader& litShader = options_.deferred ? gbufferShader : objectShader;
+  submitters[objectId] = [&](int id, float depth) {
+    litQueue.Submit(kOpaquePass, litShader, object, scene.transform(id),
+                    depth);
+  };
+  submitters[floorId] = [&](int id, float depth) {
+    litQueue.Submit(kOpaquePass, litShader, glass, scene.transform(id),
+                    depth, 0, 0, &floorMaterial);
+  };
+  submitters[planetId] = [&](int id, float depth) {
+    renderQueue.Submit(kOpaquePass, planetShader, planet,
+                       scene.transform(id), depth);
+  };
+  submitters[glassId] = [&](int id, float depth) {
+    renderQueue.Submit(kGlassPass, glassShader, glass, scene.transform(id),
+                       depth);
+  };
+  for (int i = 0; i < NUM_LAMPS; ++i) {
+    submitters[lampIds[i]] = [&, i](int /*id*/, float depth) {
+      renderQueue.Submit(kLampPass, lampShader, lamp, lampModels[i], depth, i);
+      renderQueue.Submit(kOutlinePass, lampShader, lamp, lampOutlineModels[i],
+                         depth, i);
+    };
+  }
+  int numQueueFrames = 0;
+  long long numQueueItems = 0, numProgramChanges = 0, numMaterialChanges = 0;
+  long long numTextureBinds = 0;
+  long long numLodTriangles[kMaxLods]{};
+  double clusterSeconds = 0.0;
+  long long numClusterIndices = 0, numDroppedIndices = 0;
+  int maxLightsPerCluster = 0;
+
+  // only lamps, which come first in pointLights, cast shadows, and if there
+  // are more of them than shadow maps, the most important ones get maps. a
+  // lamp keeps its map until it drops out of the most important ones, so
+  // that maps are not recalculated when lamps just swap places in ranking
+  int shadowOwners[NUM_POINT_SHADOWS];
+  std::fill(shadowOwners, shadowOwners + NUM_POINT_SHADOWS, -1);
+  vector<int> lightRanking(NUM_LAMPS);
+  vector<float> lightImportance(NUM_LAMPS);
+  auto assignPointShadows = [&]() {
+    // brightness as seen from the camera
+    for (int i = 0; i < NUM_LAMPS; ++i) {
+      const PointLight& light = pointLights[i];
+      float distance = glm::length(light.position - camera.position());
+      lightImportance[i] =
+          std::max(light.color.x, std::max(light.color.y, light.color.z)) /
+          std::max(distance * distance, 1.0f);
+      lightRanking[i] = i;
+    }
+    const int numShadowed = std::min<int>(NUM_POINT_SHADOWS,
+                                          lightRanking.size());
+    std::partial_sort(
+        lightRanking.begin(), lightRanking.begin() + numShadowed,
+        lightRanking.end(), [&](int a, int b) {
+          return lightImportance[a] > lightImportance[b];
+        });
+    auto isChosen = [&](int light) {
+      return std::find(lightRanking.begin(),
+                       lightRanking.begin() + numShadowed,
+                       light) != lightRanking.begin() + numShadowed;
+    };
+    for (int& owner : shadowOwners) {
+      if (owner >= 0 && !isChosen(owner)) {
+        pointLights[owner].shadow_map = -1;
+        owner = -1;
+      }
+    }
+    lightingShader.Use();
+    for (int i = 0; i < numShadowed; ++i) {
+      PointLight& light = pointLights[lightRanking[i]];
+      if (light.shadow_map >= 0) continue;
+      int map = static_cast<int>(
+          std::find(shadowOwners, shadowOwners + NUM_POINT_SHADOWS, -1) -
+          shadowOwners);
+      shadowOwners[map] = lightRanking[i];
+      light.shadow_map = map;
+      pointLightShadows[map].MoveLight(light.position);
+      lightingShader.set(lightingUniforms.pointLightsPos[map], light.position);
+      lightingShader.set(lightingUniforms.frustumHeights[map],
+                         pointLightShadows[map].frustum_height());
+    }
+  };
+
+  // a whole cube map plus both uni shadows per frame
+  ShadowScheduler shadowScheduler(8);
+
+  long scaledFrame = -1;
+  double scaleSum = 0.0;
+
   while (!glfwWindowShouldClose(window_)) { // until user hit close
+    if (options_.is_benchmark() && benchmarkDone()) break;
     // render to texture of customized framebuffer first
     // later use this texture for default framebuffer
-    // always render in orignal size, let default framebuffer deal with resizing
-    ProcessKeyboardInput();
+    // render in original size or scaled down from it, let default
+    // framebuffer deal with resizing
+    if (!options_.is_benchmark()) ProcessKeyboardInput();
+    profiler.BeginFrame();
+    if (resolutionScaler && profiler.collected_frame() != scaledFrame) {
+      scaledFrame = profiler.collected_frame();
+      resolutionScaler->AddFrame(profiler.collected_frame_ms());
+    }
+    const float scale = resolutionScaler ? resolutionScaler->scale() : 1.0f;
+    const ScreenSize scaledSize{
+        std::max(static_cast<int>(originalSize.width * scale + 0.5f), 1),
+        std::max(static_cast<int>(originalSize.height * scale + 0.5f), 1)};
+    if (scaledSize.width != renderSize.width ||
+        scaledSize.height != renderSize.height)
+      resizeTargets(scaledSize);
+    if (benchmarkFrames > options_.warmup_frames) scaleSum += scale;
+
+    stream.BeginFrame();
     glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-    glViewport(0, 0, originalSize.width, originalSize.height);
+    glViewport(0, 0, renderSize.width, renderSize.height);
 
     // for closed shapes, omit clockwise triangles
     // glass should be double-sided (see vertices of glass)
@@ -425,229 +930,303 @@ void Render::MainLoop() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
     // set once, use anywhere
-    mat4 view = camera.view_matrix();
+    view = camera.view_matrix();
     mat4 projection = camera.proj_matrix();
-    glBindBuffer(GL_UNIFORM_BUFFER, uboMatrices);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(mat4), glm::value_ptr(view));
-    glBufferSubData(GL_UNIFORM_BUFFER, sizeof(mat4), sizeof(mat4), glm::value_ptr(projection));
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-
-
-    // ------------------------------------
-    // render lamps with outlines
-
-    // enable any of fragments of lights (lamps) to update stencil buffer with 1
-    // so that later we know where we should not draw outlines
-    glStencilFunc(GL_ALWAYS, 1, 0xFF); // let stencil test always pass
-    glStencilMask(0xFF);
-
-    lampShader.Use();
-    for (int i = 0; i < NUM_POINT_LIGHTS; ++i) {
-      mat4 lampModel = glm::translate(mat4(1.0f), lampPos[i]);
-      lampModel = glm::scale(lampModel, vec3(0.8f));
-      lampShader.set_mat4("model", lampModel);
-      lampShader.set_vec3("lightColor", lampColor[i]);
-      lamp.Draw(lampShader);
-    }
-
-    glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-
-    for (int i = 0; i < NUM_POINT_LIGHTS; ++i) {
-      mat4 lampModel = glm::translate(mat4(1.0f), lampPos[i]);
-      lampModel = glm::scale(lampModel, vec3(0.85f));
-      lampShader.set_mat4("model", lampModel);
-      lampShader.set_vec3("lightColor", {5.0f, 5.0f, 0.0f});
-      lamp.Draw(lampShader);
+    const mat4 matrices[]{view, projection};
+    GLintptr matricesOffset = stream.Upload(matrices, sizeof(matrices),
+                                            StreamBuffer::UniformAlignment());
+    glBindBufferRange(GL_UNIFORM_BUFFER, 0, stream.buffer(), matricesOffset,
+                      sizeof(matrices));
+
+    // point lights are assigned to clusters of the main camera, which renders
+    // in render size
+    assignPointShadows();
+    double clusterStart = glfwGetTime();
+    lightClusters.Update(view, projection, renderSize.width,
+                         renderSize.height, pointLights);
+    if (benchmarkFrames > options_.warmup_frames) {
+      clusterSeconds += glfwGetTime() - clusterStart;
+      const LightClusters::Stats& stats = lightClusters.stats();
+      numClusterIndices += stats.num_indices;
+      numDroppedIndices += stats.num_dropped;
+      maxLightsPerCluster = std::max(maxLightsPerCluster,
+                                     stats.max_lights_per_cluster);
     }
 
-    glStencilFunc(GL_ALWAYS, 1, 0xFF);
-    glStencilMask(0xFF);
-
-
     // ------------------------------------
-    // render object
+    // update shadows
 
-    vector<Model> models{
-        object,
-        glass,
+    // only shadows that are out of date get calculated, and if many of them
+    // are, updates are spread over frames. lights closer to the camera have
+    // more impact on screen, and spot light follows the camera
+    planetModel = glm::rotate(planetModel, 0.01f, vec3(0.0f, 1.0f, 0.0f));
+    scene.SetTransform(planetId, glm::scale(planetModel, vec3(0.5f)));
+    spotLightShadow.MoveLight(camera.position(), camera.direction());
+    auto requestShadow = [&](const Shadow& shadow, float priority) {
+      int numFaces = shadow.NumDirtyFaces(scene);
+      if (numFaces > 0) shadowScheduler.Request(&shadow, priority, numFaces);
     };
-    vector<mat4> modelMatrices{
-        objectModel,
-        floorModel,
+    for (int i = 0; i < NUM_POINT_SHADOWS; ++i) {
+      if (shadowOwners[i] < 0) continue;
+      requestShadow(pointLightShadows[i], 1.0f / std::max(glm::length(
+          pointLights[shadowOwners[i]].position - camera.position()), 1.0f));
+    }
+    requestShadow(dirLightShadow, 1.0f);
+    requestShadow(spotLightShadow, 2.0f);
+    vector<ShadowScheduler::Grant> shadowGrants = shadowScheduler.Schedule();
+    auto calculateShadow = [&](Shadow& shadow, const string& zone) {
+      auto grant = std::find_if(
+          shadowGrants.begin(), shadowGrants.end(),
+          [&](const ShadowScheduler::Grant& g) { return g.shadow == &shadow; });
+      if (grant == shadowGrants.end()) return;
+      profiler.BeginZone(zone);
+      shadow.CalculateShadow(renderSize.width, renderSize.height,
+                             framebuffer, scene, grant->num_faces);
+      profiler.EndZone();
     };
+    for (int i = 0; i < NUM_POINT_SHADOWS; ++i)
+      calculateShadow(pointLightShadows[i], "point shadow " + std::to_string(i));
+    calculateShadow(dirLightShadow, "dir shadow");
+    calculateShadow(spotLightShadow, "spot shadow");
 
-    for (int i = 0; i < NUM_POINT_LIGHTS; ++i)
-      pointLightShadows[i].CalculateShadow(originalSize.width, originalSize.height,
-                                           framebuffer, models, modelMatrices);
-    dirLightShadow.CalculateShadow(originalSize.width, originalSize.height,
-                                   framebuffer, models, modelMatrices);
-    spotLightShadow.MoveLight(camera.position(), camera.direction());
-    spotLightShadow.CalculateShadow(originalSize.width, originalSize.height,
-                                    framebuffer, models, modelMatrices);
-
-    glDisable(GL_CULL_FACE); // for explosion effect
 
-    objectShader.Use();
-    for (int i = 0; i < NUM_POINT_LIGHTS; ++i) {
-      pointLightShadows[i].BindShadowMap(GL_TEXTURE0 + i);
-      objectShader.set_int("pointLightDepthMaps[" + std::to_string(i) + "]", i);
+    // ------------------------------------
+    // render lamps with outlines, object, floor, planet, asteroids, skybox
+    // and semi-transparent glass
+
+    visibleIds.clear();
+    scene.Query(camera.frustum(), &visibleIds);
+    for (int id : visibleIds) {
+      // distance along view direction
+      vec3 center = scene.world_bounds(id).center();
+      submitters.at(id)(id, -(view * vec4(center, 1.0f)).z);
     }
-    objectShader.set_mat4("dirLightSpace", dirLightShadow.light_space());
-    dirLightShadow.BindShadowMap(GL_TEXTURE3);
-    objectShader.set_int("dirLightDepthMap", 3);
-    objectShader.set_mat4("spotLightSpace", spotLightShadow.light_space());
-    spotLightShadow.BindShadowMap(GL_TEXTURE4);
-    objectShader.set_int("spotLightDepthMap", 4);
-
-    glActiveTexture(GL_TEXTURE5);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTex);
-    objectShader.set_int("material.envMap", 5);
 
-    objectShader.set_float("explosion", explosion);
-    mat3 normal = glm::transpose(glm::inverse(mat3(view * objectModel)));
-    objectShader.set_mat3("normal", normal);
-    mat3 invView = glm::inverse(glm::mat3(view));
-    objectShader.set_mat3("invView", invView);
-
-    // lights direction in camera space
-    vec3 dirLightDir = vec3(view * vec4(dirLight, 0.0f));
-    objectShader.set_vec3("dirLight.direction", dirLightDir);
-    for (int i = 0; i < NUM_POINT_LIGHTS; ++i) {
-      vec3 pointLightDir = vec3(view * vec4(lampPos[i], 1.0f));
-      objectShader.set_vec3("pointLights[" + std::to_string(i) + "].position", pointLightDir);
+    double cullStart = glfwGetTime();
+    size_t numVisibleAsteroids = asteroidCuller.Cull(camera.frustum());
+    if (benchmarkFrames > options_.warmup_frames) {
+      cullSeconds += glfwGetTime() - cullStart;
+      numCulledAsteroids += numAsteroids;
+      numDrawnAsteroids += numVisibleAsteroids;
+    }
+    if (numVisibleAsteroids > 0) {
+      for (auto& models : asteroidLodModels)
+        models.clear();
+      const mat4* visibleAsteroids = asteroidCuller.visible();
+      for (size_t i = 0; i < numVisibleAsteroids; ++i) {
+        int lod = asteroid.SelectLod(visibleAsteroids[i], camera,
+                                     options_.lod_error_pixels);
+        asteroidLodModels[lod].emplace_back(visibleAsteroids[i]);
+      }
+      // behind the planet, since they orbit around it
+      float depth = -(view * vec4(planetCenter, 1.0f)).z;
+      for (int lod = 0; lod < kMaxLods; ++lod) {
+        const vector<mat4>& models = asteroidLodModels[lod];
+        if (models.empty()) continue;
+        asteroidLodOffsets[lod] = stream.Upload(
+            models.data(), models.size() * sizeof(mat4), sizeof(vec4));
+        renderQueue.Submit(kOpaquePass, asteroidShader, asteroid, mat4(1.0f),
+                           depth, lod, (GLsizei)models.size(), nullptr, lod);
+      }
+    }
+    renderQueue.Submit(kSkyboxPass, skyboxShader, skybox, mat4(1.0f), 0.0f);
+
+    if (options_.deferred) {
+      profiler.BeginZone("g-buffer");
+      glBindFramebuffer(GL_FRAMEBUFFER, gbufferFramebuffer);
+      // pool hands out the same targets every frame unless render size
+      // changes, so they are rarely attached again
+      bool gBuffersChanged = false;
+      for (int i = 0; i < 3; ++i) {
+        gBuffers[i] = targetPool.Acquire(
+            {renderSize.width, renderSize.height, gBufferFormats[i], 0},
+            GL_NEAREST);
+        if (gBuffers[i] == attachedGBuffers[i]) continue;
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i,
+                               GL_TEXTURE_2D, gBuffers[i], 0);
+        attachedGBuffers[i] = gBuffers[i];
+        gBuffersChanged = true;
+      }
+      if (gBuffersChanged &&
+          glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error{"G-buffer incomplete"};
+      gbufferQueue.Flush();
+      profiler.EndZone();
+
+      // every pixel covered by G-buffer is lit once, however many times it
+      // was overdrawn. pixels left empty are discarded, and get skybox later
+      profiler.BeginZone("deferred lighting");
+      glBindFramebuffer(GL_FRAMEBUFFER, lightingFramebuffer);
+      glDisable(GL_DEPTH_TEST);
+      glDisable(GL_STENCIL_TEST);
+      glDisable(GL_BLEND);
+      for (int i = 0; i < 3; ++i) {
+        glActiveTexture(GL_TEXTURE6 + i);
+        glBindTexture(GL_TEXTURE_2D, gBuffers[i]);
+      }
+      glActiveTexture(GL_TEXTURE9);
+      glBindTexture(GL_TEXTURE_2D, depthStencilTex);
+      deferredShader.Use();
+      deferredShader.set(clipToViewUniform, glm::inverse(projection));
+      deferredShader.set(viewToWorldUniform, glm::inverse(view));
+      bindLights(10);
+      screen.Draw(deferredShader);
+      for (GLuint gBuffer : gBuffers)
+        targetPool.Release(gBuffer);
+      glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+      glEnable(GL_DEPTH_TEST);
+      glEnable(GL_STENCIL_TEST);
+      glEnable(GL_BLEND);
+      profiler.EndZone();
     }
 
-    objectShader.set_mat4("model", objectModel);
-    object.Draw(objectShader, 6);
-
-    glEnable(GL_CULL_FACE);
-
-    // note! even if we don't need cudemap when render floor, material.cubemap
-    // still must have a value. if we bind floorTex to GL_TEXTURE1, material.cubemap
-    // will become unset, and floor will not get rendered!
-    glActiveTexture(GL_TEXTURE6);
-    glBindTexture(GL_TEXTURE_2D, floorTex);
-    glActiveTexture(GL_TEXTURE7);
-    glBindTexture(GL_TEXTURE_2D, blackTex);
-    objectShader.set_int("material.diffuse0", 6);
-    objectShader.set_int("material.specular0", 7);
-    objectShader.set_int("material.reflection0", 7);
-
-    normal = glm::transpose(glm::inverse(mat3(view * floorModel)));
-    objectShader.set_mat3("normal", normal);
-    objectShader.set_mat4("model", floorModel);
-    glass.Draw(objectShader);
-
-
-    // ------------------------------------
-    // render planet and asteroids
-
-    planetShader.Use();
-    planetModel = glm::rotate(planetModel, 0.01f, vec3(0.0f, 1.0f, 0.0f));
-    planetShader.set_mat4("model", glm::scale(planetModel, vec3(0.5f)));
-    planet.Draw(planetShader);
-    asteroid.DrawInstanced(asteroidShader, NUM_ASTEROID);
-
-
-    // ------------------------------------
-    // render skybox as background
-
-    // render this after all oblique objects are rendered
-    // a trick: set depth to be 1.0 by setting gl_Position.zw to 1.0
-    //          and depth function to GL_LEQUAL, so that skybox lays
-    //          right on maximum depth (can either set gl_FragDepth
-    //          to 1.0 in fragment shader, however, in that case OpenGL
-    //          cannot do early depth testing any more)
-    glDepthFunc(GL_LEQUAL);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTex);
-    skyboxShader.Use();
-    skyboxShader.set_int("skybox", 0);
-    skybox.Draw(skyboxShader);
+    profiler.BeginZone("scene");
+    renderQueue.Flush();
     glDepthFunc(GL_LESS);
+    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    if (benchmarkFrames > options_.warmup_frames) {
+      ++numQueueFrames;
+      for (const RenderQueue* queue : {&gbufferQueue, &renderQueue}) {
+        const RenderQueue::Stats& stats = queue->stats();
+        numQueueItems += stats.num_items;
+        numProgramChanges += stats.num_program_changes;
+        numMaterialChanges += stats.num_material_changes;
+        numTextureBinds += stats.num_texture_binds;
+        for (int i = 0; i < kMaxLods; ++i)
+          numLodTriangles[i] += stats.num_triangles[i];
+      }
+    }
+    profiler.EndZone();
 
-
-    // ------------------------------------
-    // render semi-transparent glass and text
-
-    // render this at last because of alpha blending
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, glassTex);
-    glassShader.Use();
-    glassShader.set_int("texture1", 0);
-    glass.Draw(glassShader);
-
+    profiler.BeginZone("text");
     text.renderText(textShader, "FPS: " + std::to_string(FPS),
                     -0.95f, 0.9f, 1.0f / 1000.0f, textColor);
+    // per-pass breakdown of GPU time, smoothed over recent frames
+    float textY = 0.84f;
+    for (const auto& zone : profiler.zone_stats()) {
+      char line[64];
+      snprintf(line, sizeof(line), "%s: %.3f ms", zone.name.c_str(),
+               zone.gpu_ms);
+      text.renderText(textShader, line, -0.95f, textY, 0.6f / 1000.0f,
+                      textColor);
+      textY -= 0.04f;
+    }
+    profiler.EndZone();
 
 
     // ------------------------------------
-    // render highlights to another texture
-    // and then switch back to default framebuffer
+    // blur highlights, and then composite, tonemap and correct gamma straight
+    // into default framebuffer
 
     glDisable(GL_CULL_FACE);
     glDisable(GL_DEPTH_TEST);
     glDisable(GL_STENCIL_TEST);
     glDisable(GL_BLEND);
 
-    // render highlights from colorBuffers[0] to colorBuffers[1]
-    glDrawBuffers(1, &attachments[1]);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
-    hdrShader.Use();
-    hdrShader.set_int("texture1", 0);
-    screen.Draw(hdrShader);
-
-    // blur highlights in colorBuffers[1]
-    // ping-pong between colorBuffers[2] and colorBuffers[3]
-    // and finally store in colorBuffers[3]
-    gaussianShader.Use();
-    gaussianShader.set_int("texture1", 0);
-    glActiveTexture(GL_TEXTURE0);
-    for (int i = 0; i < 5; ++i) {
-      gaussianShader.set_int("horizontal", 1);
-      glDrawBuffers(1, &attachments[2]);
-      if (i == 0) glBindTexture(GL_TEXTURE_2D, colorBuffers[1]);
-      else        glBindTexture(GL_TEXTURE_2D, colorBuffers[3]);
-      screen.Draw(gaussianShader);
-
-      gaussianShader.set_int("horizontal", 0);
-      glDrawBuffers(1, &attachments[3]);
-      glBindTexture(GL_TEXTURE_2D, colorBuffers[2]);
-      screen.Draw(gaussianShader);
+    // bloomTex is acquired from pool, and given back once read
+    GLuint bloomTex;
+    if (bloom) {
+      // highlights are extracted from colorBuffer by the first downsample
+      bloomTex = bloom->Apply(colorBuffer, renderSize.width,
+                              renderSize.height, screen, &profiler);
+    } else {
+      const RenderTargetDesc blurDesc{renderSize.width, renderSize.height,
+                                      hdrFormat, 0};
+      glBindFramebuffer(GL_FRAMEBUFFER, blurFramebuffer);
+      auto renderTo = [](GLuint target) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D, target, 0);
+      };
+
+      // render highlights from colorBuffer to brightTex
+      profiler.BeginZone("bright pass");
+      GLuint brightTex = targetPool.Acquire(blurDesc);
+      renderTo(brightTex);
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, colorBuffer);
+      hdrShader.Use();
+      hdrShader.set(hdrTexUniform, 0);
+      screen.Draw(hdrShader);
+      profiler.EndZone();
+
+      // blur highlights in brightTex
+      // ping-pong between pingTex and pongTex
+      // and finally store in pongTex
+      // brightTex is no longer needed once read, so pongTex takes its memory
+      profiler.BeginZone("gaussian");
+      gaussianShader.Use();
+      gaussianShader.set(gaussianTexUniform, 0);
+      glActiveTexture(GL_TEXTURE0);
+      GLuint pingTex = targetPool.Acquire(blurDesc), pongTex = 0;
+      for (int i = 0; i < 5; ++i) {
+        gaussianShader.set(horizontalUniform, 1);
+        renderTo(pingTex);
+        if (i == 0) glBindTexture(GL_TEXTURE_2D, brightTex);
+        else        glBindTexture(GL_TEXTURE_2D, pongTex);
+        screen.Draw(gaussianShader);
+        if (i == 0) {
+          targetPool.Release(brightTex);
+          pongTex = targetPool.Acquire(blurDesc);
+        }
+
+        gaussianShader.set(horizontalUniform, 0);
+        renderTo(pongTex);
+        glBindTexture(GL_TEXTURE_2D, pingTex);
+        screen.Draw(gaussianShader);
+      }
+      profiler.EndZone();
+      targetPool.Release(pingTex);
+      bloomTex = pongTex;
     }
 
-    // blend original scene (0) with blurred highlights (3)
-    // store result in colorBuffers[1]
-    glDrawBuffers(1, &attachments[1]);
+    // blend scene (0) with blurred highlights, upscaling bilinearly from
+    // render size to window size
+    profiler.BeginZone("post");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, currentSize.width, currentSize.height);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
+    glBindTexture(GL_TEXTURE_2D, colorBuffer);
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, colorBuffers[3]);
-    blendShader.Use();
-    blendShader.set_float("exposure", 0.8f);
-    blendShader.set_int("scene", 0);
-    blendShader.set_int("bloom", 1);
-    screen.Draw(blendShader);
-
-    glDrawBuffers(1, &attachments[0]);
+    glBindTexture(GL_TEXTURE_2D, bloomTex);
+    postShader.Use();
+    postShader.set(exposureUniform, 0.8f);
+    postShader.set(sceneUniform, 0);
+    postShader.set(bloomUniform, 1);
+    screen.Draw(postShader);
+    targetPool.Release(bloomTex);
+
+    // and in small size. a framebuffer cannot be read and written where
+    // regions overlap, so the result is shrunk into insetFramebuffer first
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, insetFramebuffer);
+    glBlitFramebuffer(0, 0, currentSize.width, currentSize.height,
+                      0, 0, insetSize.width, insetSize.height,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, insetFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, insetSize.width, insetSize.height,
+                      0, 0, currentSize.width / 4, currentSize.height / 4,
+                      GL_COLOR_BUFFER_BIT, GL_LINEAR);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    profiler.EndZone();
 
-    // render to default framebuffer
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, colorBuffers[1]);
-    screenShader.Use();
-    screenShader.set_int("texture1", 0);
-
-    glViewport(0, 0, currentSize.width, currentSize.height);
-    screen.Draw(screenShader); // draw screen in original size
-
-    glViewport(0, 0, currentSize.width / 4, currentSize.height / 4);
-    screen.Draw(screenShader); // draw screen in small size
-
+    stream.EndFrame();
+    targetPool.EndFrame();
     glfwSwapBuffers(window_); // use color buffer to draw
     glfwPollEvents(); // check events (keyboard, mouse, ...)
 
+    if (options_.is_benchmark()) {
+      // wait for GPU so that frame time covers the whole pipeline
+      glFinish();
+      double frameEnd = glfwGetTime();
+      if (benchmarkFrames == options_.warmup_frames) {
+        benchmarkStart = frameEnd;
+      } else if (benchmarkFrames > options_.warmup_frames) {
+        frameStats.AddFrame(frameEnd - lastFrameEnd);
+      }
+      lastFrameEnd = frameEnd;
+      ++benchmarkFrames;
+    }
+
     ++frameCount;
     double currentTime = glfwGetTime();
     if (currentTime - lastTime > 1.0) {
@@ -656,4 +1235,107 @@ void Render::MainLoop() {
       lastTime = currentTime;
     }
   }
+
+  if (options_.is_benchmark()) {
+    frameStats.Print(std::cout);
+    if (cullSeconds > 0.0) {
+      char line[64];
+      snprintf(line, sizeof(line),
+               "asteroid culling: %.0f instances/ms, %.1f%% drawn",
+               numCulledAsteroids / (cullSeconds * 1000.0),
+               100.0 * numDrawnAsteroids / numCulledAsteroids);
+      std::cout << line << std::endl;
+    }
+    // loss and savings of packing vertices, compared with 32-byte vertices
+    // and 32-bit indices, and effect of reordering
+    for (const auto& entry : {std::make_pair("nanosuit", &object),
+                              std::make_pair("rock", &asteroid)}) {
+      size_t unpackedSize = 0;
+      for (const auto& mesh : entry.second->meshes())
+        unpackedSize += mesh.num_vertices() * sizeof(wrapper::opengl::Vertex) +
+                        mesh.num_indices() * sizeof(GLuint);
+      const auto& error = entry.second->quantization_error();
+      char line[160];
+      snprintf(line, sizeof(line), "%s vertex data: %.1f KiB (%.1f KiB "
+               "unpacked), max error: position %.2e, normal %.2f deg, "
+               "uv %.2e", entry.first, entry.second->memory_size() / 1024.0,
+               unpackedSize / 1024.0, error.position, error.normal,
+               error.tex_coord);
+      std::cout << line << std::endl;
+      std::cout << entry.first << " LODs:";
+      for (int i = 0; i < entry.second->num_lods(); ++i) {
+        size_t numTriangles = 0;
+        float lodError = 0.0f;
+        for (const auto& mesh : entry.second->meshes()) {
+          numTriangles += mesh.lod(i).num_indices / 3;
+          lodError = std::max(lodError, mesh.lod(i).error);
+        }
+        snprintf(line, sizeof(line), " %zu triangles (error %.2e)",
+                 numTriangles, lodError);
+        std::cout << line;
+      }
+      std::cout << std::endl;
+      const auto& optimization = entry.second->optimization_stats();
+      snprintf(line, sizeof(line), "%s vertex cache: ACMR %.3f -> %.3f, "
+               "ATVR %.3f -> %.3f, vertices %u -> %u", entry.first,
+               optimization.acmr_before(), optimization.acmr_after(),
+               optimization.atvr_before(), optimization.atvr_after(),
+               optimization.num_vertices_before,
+               optimization.num_vertices_after);
+      std::cout << line << std::endl;
+    }
+    if (numQueueFrames > 0) {
+      char line[128];
+      snprintf(line, sizeof(line), "render queue: %.1f draws, %.1f program "
+               "changes, %.1f material changes, %.1f texture binds per frame",
+               (double)numQueueItems / numQueueFrames,
+               (double)numProgramChanges / numQueueFrames,
+               (double)numMaterialChanges / numQueueFrames,
+               (double)numTextureBinds / numQueueFrames);
+      std::cout << line << std::endl;
+      std::cout << "triangles per frame by LOD:";
+      for (int i = 0; i < kMaxLods; ++i) {
+        snprintf(line, sizeof(line), " %d: %.0f", i,
+                 (double)numLodTriangles[i] / numQueueFrames);
+        std::cout << line;
+      }
+      std::cout << std::endl;
+      snprintf(line, sizeof(line), "light clusters: %zu lights in %.3f ms, "
+               "%.1f indices per frame, %.1f dropped, at most %d lights per "
+               "cluster", pointLights.size(),
+               clusterSeconds * 1000.0 / numQueueFrames,
+               (double)numClusterIndices / numQueueFrames,
+               (double)numDroppedIndices / numQueueFrames,
+               maxLightsPerCluster);
+      std::cout << line << std::endl;
+    }
+    if (resolutionScaler && numQueueFrames > 0) {
+      char line[128];
+      snprintf(line, sizeof(line), "dynamic resolution: mean scale %.3f, "
+               "%d changes", scaleSum / numQueueFrames,
+               resolutionScaler->num_changes());
+      std::cout << line << std::endl;
+    }
+    {
+      // shadow maps keep their content across frames, so they are not
+      // pooled, but count as render targets all the same
+      size_t shadowMapSize = dirLightShadow.memory_size() +
+                             spotLightShadow.memory_size();
+      for (const auto& shadow : pointLightShadows)
+        shadowMapSize += shadow.memory_size();
+      char line[160];
+      snprintf(line, sizeof(line), "render targets: %.1f MiB in %d pooled "
+               "textures (peak %.1f MiB, %d allocations), %.1f MiB in "
+               "shadow maps", targetPool.memory_size() / 1048576.0,
+               targetPool.num_textures(),
+               targetPool.peak_memory_size() / 1048576.0,
+               targetPool.num_allocations(), shadowMapSize / 1048576.0);
+      std::cout << line << std::endl;
+    }
+    std::cout << "stream buffer: "
+              << (stream.persistent() ? "persistently mapped"
+                                      : "mapped per upload")
+              << ", " << stream.num_waits() << " waits for GPU" << std::endl;
+  }
+  profiler.Print(std::cout);
 }
@@ -9,16 +9,64 @@
 #ifndef render_hpp
 #define render_hpp
 
+#include <string>
+
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+struct RenderOptions {
+  std::string asset_path = "/Users/lun/Desktop/Code/LearnOpenGL/LearnOpenGL/";
+  // render without a visible window (and without a display server if GLFW
+  // supports the null platform), then exit after a fixed number of frames
+  // or seconds and print frame time statistics
+  bool headless = false;
+  int max_frames = 0;       // 0 means no limit
+  double max_seconds = 0.0; // 0 means no limit
+  int warmup_frames = 10;   // not counted in statistics
+  // measure GPU time of each render pass, show it on screen and write it to
+  // this file in CSV format. empty means no profiling
+  std::string profile_path;
+  // instances of asteroid around planet. they are frustum culled on CPU, and
+  // culling throughput is printed in benchmark mode
+  int num_asteroids = 750;
+  // largest error on screen in pixels allowed when picking levels of detail
+  // of asteroids. 0 always draws full detail
+  float lod_error_pixels = 1.0f;
+  // small point lights besides the three lamps. all of them are assigned to
+  // clusters of the view frustum on CPU. they never cast shadows, and only
+  // lamps get shadow maps
+  int num_point_lights = 128;
+  // fill a G-buffer and light it in screen space, instead of lighting every
+  // rasterized fragment of objects. other models are still drawn forward
+  bool deferred = false;
+  // highlights are blurred over this many levels, from half resolution
+  // down, each upsampled with a filter of bloom_radius texels. low quality
+  // takes 4 taps per pass instead of 13 and 9. 0 levels blurs at full
+  // resolution with 5 rounds of separable gaussian instead
+  int bloom_levels = 5;
+  float bloom_radius = 1.0f;
+  bool bloom_high_quality = true;
+  // store HDR color in GL_R11F_G11F_B10F instead of GL_RGB16F, which has
+  // less precision but takes half the memory and bandwidth
+  bool compact_hdr = true;
+  // scale render resolution between 50% and 100% of window size, so that
+  // GPU time of frames stays within target_frame_ms. implies GPU profiling
+  bool dynamic_resolution = false;
+  double target_frame_ms = 16.0;
+
+  bool is_benchmark() const {
+    return headless || max_frames > 0 || max_seconds > 0.0;
+  }
+};
+
 class Render {
  public:
-  Render();
+  Render(const RenderOptions& options = RenderOptions{});
   void MainLoop();
 
  private:
   GLFWwindow* window_;
+  RenderOptions options_;
   void ProcessKeyboardInput();
 };
 
@@ -0,0 +1,189 @@
+// lights shared by shader_object.fs (forward) and shader_deferred.fs,
+// included after #version. includer declares struct Material with shininess
+// and envMap, and fragPos (view space), fragPosWorldSpace, diffuseSample and
+// specularSample, which lights below read
+
+#define NUM_POINT_SHADOWS 3
+// must match light_clusters.h
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 8
+#define CLUSTER_SLICES 24
+#define NUM_CLUSTERS (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+
+struct DirLight {
+    vec3 direction;
+    
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float innerCutOff;
+    float outerCutOff;
+    
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+// of lights that own point shadow maps
+uniform float frustumHeights[NUM_POINT_SHADOWS];
+uniform vec3 pointLightsPos[NUM_POINT_SHADOWS]; // world space
+uniform mat3 invView;
+uniform DirLight dirLight;
+// shared by all point lights
+uniform vec3 pointLightAttenuation; // constant, linear, quadratic
+uniform vec3 pointLightIntensity; // ambient, diffuse, specular
+uniform SpotLight spotLight;
+uniform Material material;
+uniform samplerCube pointLightDepthMaps[NUM_POINT_SHADOWS];
+// point lights of each cluster, see wrapper::opengl::LightClusters
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterIndices;
+uniform int clusterLightBase;
+uniform int clusterIndexBase;
+uniform vec2 clusterTileScale;
+uniform vec2 clusterDepthScale;
+uniform sampler2D dirLightDepthMap;
+uniform sampler2D spotLightDepthMap;
+
+float calcOmniShadow(vec3 lightPos, samplerCube depthMap, float frustumHeight) {
+    vec3 fragToLight = fragPosWorldSpace.xyz - lightPos; // both in world space
+    float curDepth = length(fragToLight);
+    float shadow = 0.0, bias = 0.2;
+    // move closer -> smaller radius -> sharper shadow
+    float radius = (1.0 + (curDepth / frustumHeight)) / 25.0;
+    for (int x = -1; x < 2; ++x)
+        for (int y = -1; y < 2; ++y)
+            for (int z = -1; z < 2; ++z) {
+                float hitDepth = texture(depthMap, fragToLight + vec3(x, y, z) * radius).r;
+                hitDepth *= frustumHeight; // [0, 1] -> true depth
+                shadow += curDepth - bias > hitDepth ? 1.0 : 0.0;
+            }
+    return shadow / 27.0;
+}
+
+float calcUniShadow(vec3 lightDir, vec3 normal, vec4 fragPosLightSpace, sampler2D depthMap) {
+    // this line takes no effect on orthographic projection
+    vec3 lightSpaceCoord = fragPosLightSpace.xyz / fragPosLightSpace.w;
+    // if further than far plane, this fragment will not be shadowed
+    if (lightSpaceCoord.z > 1.0) return 0.0;
+    
+    lightSpaceCoord = lightSpaceCoord * 0.5 + 0.5; // [-1, 1] -> [0, 1]
+    float curDepth = lightSpaceCoord.z;
+    // resolution of depth map is limited, so curDepth is precise while hitDepth is not
+    // if they are actually equal, but it appears that hitDepth floats around curDepth,
+    // which results in stripes. a bias is set to ensure no shadow in this case
+    lightDir = normalize(-lightDir);
+    float bias = max(0.002, 0.02 * (1.0 - dot(normal, lightDir)));
+    // resolution of depth map is limited, so we retrieve depth of 9 neighbor pixels
+    // and compute an average
+    float shadow = 0.0;
+    // move closer -> smaller radius -> sharper shadow
+    vec2 radius = (1.0 + curDepth) / textureSize(depthMap, 0);
+    for (int x = -1; x < 2; ++x) {
+        for (int y = -1; y < 2; ++y) {
+            float hitDepth = texture(depthMap, lightSpaceCoord.xy + vec2(x, y) * radius).r;
+            shadow += curDepth - bias > hitDepth ? 1.0 : 0.0;
+        }
+    }
+    return shadow / 9.0;
+}
+
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, float shadow) {
+    vec3 lightDir = normalize(-light.direction);
+    float diff = max(dot(normal, lightDir), 0.0); // for diffuse
+    vec3 halfDir = normalize(lightDir + viewDir); // Blinn-Phong shading
+    float spec = pow(max(dot(normal, halfDir), 0.0), material.shininess); // for specular
+    
+    vec3 ambient  = light.ambient  * diffuseSample; // unaffected by shadow
+    vec3 diffuse  = light.diffuse  * diff * (1.0 - shadow) * diffuseSample;
+    vec3 specular = light.specular * spec * (1.0 - shadow) * specularSample;
+    
+    return ambient + diffuse + specular;
+}
+
+// position is in view space
+vec3 calcPointLight(vec3 position, float range, vec3 color, vec3 normal, vec3 viewDir, float shadow) {
+    vec3 lightDir = normalize(position - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0); // for diffuse
+    vec3 halfDir = normalize(lightDir + viewDir); // Blinn-Phong shading
+    float spec = pow(max(dot(normal, halfDir), 0.0), material.shininess); // for specular
+    
+    // attenuation, faded to zero at range so that lights outside of a cluster
+    // can be skipped
+    float lightDist = length(position - fragPos);
+    float attenuation = 1.0 / dot(pointLightAttenuation, vec3(1.0, lightDist, lightDist * lightDist));
+    float fade = clamp(1.0 - pow(lightDist / range, 4.0), 0.0, 1.0);
+    attenuation *= fade * fade;
+    
+    vec3 ambient  = pointLightIntensity.x * color * diffuseSample;
+    vec3 diffuse  = pointLightIntensity.y * color * diff * (1.0 - shadow) * diffuseSample;
+    vec3 specular = pointLightIntensity.z * color * spec * (1.0 - shadow) * specularSample;
+    
+    return (ambient + diffuse + specular) * attenuation;
+}
+
+float calcPointShadow(int map) {
+    // arrays of samplers can only be indexed with constant expressions
+    if (map == 0) return calcOmniShadow(pointLightsPos[0], pointLightDepthMaps[0], frustumHeights[0]);
+    if (map == 1) return calcOmniShadow(pointLightsPos[1], pointLightDepthMaps[1], frustumHeights[1]);
+    if (map == 2) return calcOmniShadow(pointLightsPos[2], pointLightDepthMaps[2], frustumHeights[2]);
+    return 0.0;
+}
+
+vec3 calcPointLights(vec3 normal, vec3 viewDir) {
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterTileScale),
+                     ivec2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+    int slice = clamp(int(log(-fragPos.z) * clusterDepthScale.x + clusterDepthScale.y),
+                      0, CLUSTER_SLICES - 1);
+    int cluster = (slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x;
+    int offset = int(texelFetch(clusterIndices, clusterIndexBase + 2 * cluster).r);
+    int count = int(texelFetch(clusterIndices, clusterIndexBase + 2 * cluster + 1).r);
+    
+    vec3 outColor = vec3(0.0);
+    for (int i = 0; i < count; ++i) {
+        int index = int(texelFetch(clusterIndices, clusterIndexBase + 2 * NUM_CLUSTERS + offset + i).r);
+        vec4 positionRange = texelFetch(clusterLights, clusterLightBase + 2 * index);
+        vec4 colorShadow = texelFetch(clusterLights, clusterLightBase + 2 * index + 1);
+        float shadow = calcPointShadow(int(colorShadow.w));
+        outColor += calcPointLight(positionRange.xyz, positionRange.w, colorShadow.rgb,
+                                   normal, viewDir, shadow);
+    }
+    return outColor;
+}
+
+vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 viewDir, float shadow) {
+    vec3 lightDir = normalize(light.position - fragPos);
+    float diff = max(dot(normal, lightDir), 0.0); // for diffuse
+    vec3 halfDir = normalize(lightDir + viewDir); // Blinn-Phong shading
+    float spec = pow(max(dot(normal, halfDir), 0.0), material.shininess); // for specular
+    
+    // attenuation
+    float lightDist = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * lightDist + light.quadratic * (lightDist * lightDist));
+    
+    // intensity
+    float theta = dot(-lightDir, normalize(light.direction));
+    float epsilon = light.innerCutOff - light.outerCutOff;
+    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    
+    vec3 ambient  = light.ambient  * diffuseSample;
+    vec3 diffuse  = light.diffuse  * diff * (1.0 - shadow) * diffuseSample;
+    vec3 specular = light.specular * spec * (1.0 - shadow) * specularSample;
+    
+    return (ambient + (diffuse + specular) * intensity) * attenuation;
+}
+
+vec3 calcReflection(vec3 normal, vec3 viewDir) {
+    vec3 reflectDir = reflect(-viewDir, normal);
+    reflectDir = invView * reflectDir; // back to world coordinate
+    return texture(material.envMap, reflectDir).rgb;
+}
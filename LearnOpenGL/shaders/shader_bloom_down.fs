@@ -0,0 +1,75 @@
+#version 330 core
+
+in vec2 texCoord;
+
+out vec4 fragColor;
+
+uniform sampler2D texture1; // level above, twice as large as target
+uniform bool highQuality;
+uniform bool firstLevel; // reading scene at full resolution
+uniform float threshold; // of luma, below which scene is not highlight
+
+float luma(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// average of a box, weighted down if it is bright, so that a single very
+// bright pixel does not flicker as the camera moves (Karis average)
+vec3 weighBox(vec3 a, vec3 b, vec3 c, vec3 d, float boxWeight, inout float weightSum) {
+    vec3 color = (a + b + c + d) * 0.25;
+    float weight = boxWeight / (1.0 + luma(color));
+    weightSum += weight;
+    return color * weight;
+}
+
+vec3 tap(vec2 offset, vec2 texelSize) {
+    vec3 color = texture(texture1, texCoord + offset * texelSize).rgb;
+    // highlights are extracted here, rather than in a pass of their own
+    if (firstLevel && luma(color) <= threshold) return vec3(0.0);
+    return color;
+}
+
+void main() {
+    vec2 texelSize = 1.0 / textureSize(texture1, 0);
+    if (!highQuality) {
+        // each bilinear tap averages 2x2 texels, so 4 of them cover 4x4
+        vec3 color = tap(vec2(-1.0, -1.0), texelSize) + tap(vec2(1.0, -1.0), texelSize)
+                   + tap(vec2(-1.0, 1.0), texelSize) + tap(vec2(1.0, 1.0), texelSize);
+        fragColor = vec4(color * 0.25, 1.0);
+        return;
+    }
+
+    // 13 taps making up five overlapping 4x4 boxes, one at center and one at
+    // each corner
+    vec3 a = tap(vec2(-2.0,  2.0), texelSize);
+    vec3 b = tap(vec2( 0.0,  2.0), texelSize);
+    vec3 c = tap(vec2( 2.0,  2.0), texelSize);
+    vec3 d = tap(vec2(-2.0,  0.0), texelSize);
+    vec3 e = tap(vec2( 0.0,  0.0), texelSize);
+    vec3 f = tap(vec2( 2.0,  0.0), texelSize);
+    vec3 g = tap(vec2(-2.0, -2.0), texelSize);
+    vec3 h = tap(vec2( 0.0, -2.0), texelSize);
+    vec3 i = tap(vec2( 2.0, -2.0), texelSize);
+    vec3 j = tap(vec2(-1.0,  1.0), texelSize);
+    vec3 k = tap(vec2( 1.0,  1.0), texelSize);
+    vec3 l = tap(vec2(-1.0, -1.0), texelSize);
+    vec3 m = tap(vec2( 1.0, -1.0), texelSize);
+
+    vec3 color;
+    if (firstLevel) {
+        float weightSum = 0.0;
+        // center box counts as much as the four corner boxes together
+        color  = weighBox(j, k, l, m, 0.5, weightSum);
+        color += weighBox(a, b, d, e, 0.125, weightSum);
+        color += weighBox(b, c, e, f, 0.125, weightSum);
+        color += weighBox(d, e, g, h, 0.125, weightSum);
+        color += weighBox(e, f, h, i, 0.125, weightSum);
+        color /= weightSum;
+    } else {
+        color  = (j + k + l + m) * 0.125;
+        color += (a + c + g + i) * 0.03125;
+        color += (b + d + f + h) * 0.0625;
+        color += e * 0.125;
+    }
+    fragColor = vec4(color, 1.0);
+}
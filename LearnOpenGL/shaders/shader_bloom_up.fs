@@ -0,0 +1,33 @@
+#version 330 core
+
+in vec2 texCoord;
+
+out vec4 fragColor;
+
+uniform sampler2D texture1; // level below, half as large as target
+uniform bool highQuality;
+uniform float radius; // in texels of texture1
+
+vec3 tap(vec2 offset, vec2 texelSize) {
+    return texture(texture1, texCoord + offset * texelSize).rgb;
+}
+
+void main() {
+    vec2 texelSize = radius / textureSize(texture1, 0);
+    vec3 color;
+    if (highQuality) {
+        // 3x3 tent filter
+        color  = tap(vec2( 0.0,  0.0), texelSize) * 4.0;
+        color += (tap(vec2(-1.0,  0.0), texelSize) + tap(vec2(1.0, 0.0), texelSize)
+                + tap(vec2( 0.0, -1.0), texelSize) + tap(vec2(0.0, 1.0), texelSize)) * 2.0;
+        color += tap(vec2(-1.0, -1.0), texelSize) + tap(vec2(1.0, -1.0), texelSize)
+               + tap(vec2(-1.0,  1.0), texelSize) + tap(vec2(1.0,  1.0), texelSize);
+        color /= 16.0;
+    } else {
+        color  = tap(vec2(-0.5, -0.5), texelSize) + tap(vec2(0.5, -0.5), texelSize)
+               + tap(vec2(-0.5,  0.5), texelSize) + tap(vec2(0.5,  0.5), texelSize);
+        color *= 0.25;
+    }
+    // blended with target, see wrapper::opengl::Bloom
+    fragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,59 @@
+#version 330 core
+
+// lights fragments of G-buffer, written by shader_gbuffer.fs, with the same
+// lights as shader_object.fs (see lighting.glsl). drawn as a full-screen quad
+
+out vec4 fragColor;
+
+struct Material {
+    samplerCube envMap;
+    float shininess;
+};
+
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedo;
+uniform sampler2D gSpecular;
+uniform sampler2D gDepth;
+uniform mat4 clipToView; // inverse of projection
+uniform mat4 viewToWorld; // inverse of view
+uniform mat4 dirLightSpace;
+uniform mat4 spotLightSpace;
+
+// reconstructed from G-buffer in main, in place of inputs of shader_object.fs
+vec3 fragPos; // in view space
+vec4 fragPosWorldSpace;
+vec3 diffuseSample;
+vec3 specularSample;
+
+#include "lighting.glsl"
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, texel, 0).r;
+    if (depth == 1.0) discard; // nothing was drawn, leave it to skybox
+    
+    vec2 ndc = gl_FragCoord.xy / vec2(textureSize(gDepth, 0)) * 2.0 - 1.0;
+    vec4 viewPos = clipToView * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    fragPos = viewPos.xyz / viewPos.w;
+    fragPosWorldSpace = viewToWorld * vec4(fragPos, 1.0);
+    
+    vec4 normalReflection = texelFetch(gNormal, texel, 0);
+    diffuseSample = texelFetch(gAlbedo, texel, 0).rgb;
+    specularSample = texelFetch(gSpecular, texel, 0).rgb;
+    
+    vec3 normal = normalize(normalReflection.xyz);
+    vec3 viewDir = normalize(-fragPos);
+    float dirLightShadow = calcUniShadow(dirLight.direction, normal,
+                                         dirLightSpace * fragPosWorldSpace, dirLightDepthMap);
+    float spotLightShadow = calcUniShadow(vec3(0.0, 0.0, -1.0), normal,
+                                          spotLightSpace * fragPosWorldSpace, spotLightDepthMap);
+    
+    vec3 outColor = vec3(0.0);
+    outColor += calcDirLight(dirLight, normal, viewDir, dirLightShadow);
+    outColor += calcPointLights(normal, viewDir);
+    outColor += calcSpotLight(spotLight, normal, viewDir, spotLightShadow);
+    outColor = mix(outColor, calcReflection(normal, viewDir),
+                   normalReflection.w);
+    
+    fragColor = vec4(outColor, 1.0);
+}
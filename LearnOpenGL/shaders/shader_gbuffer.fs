@@ -0,0 +1,27 @@
+#version 330 core
+
+in vec3 norm;
+in vec3 fragPos;
+in vec2 texCoord;
+
+// lighting is done later by shader_deferred.fs, which reads these and depth
+layout (location = 0) out vec4 gNormal; // normal in view space, reflection ratio
+layout (location = 1) out vec4 gAlbedo; // diffuse color
+layout (location = 2) out vec4 gSpecular; // specular color
+
+struct Material {
+    // textures are layers of arrays, see wrapper::opengl::Material
+    sampler2DArray diffuse;
+    sampler2DArray specular;
+    sampler2DArray reflection;
+    vec3 layers; // diffuse, specular, reflection
+};
+
+uniform Material material;
+
+void main() {
+    float reflection = texture(material.reflection, vec3(texCoord, material.layers.z)).r;
+    gNormal = vec4(normalize(norm), reflection);
+    gAlbedo = vec4(texture(material.diffuse, vec3(texCoord, material.layers.x)).rgb, 1.0);
+    gSpecular = vec4(texture(material.specular, vec3(texCoord, material.layers.y)).rgb, 1.0);
+}
@@ -1,6 +1,9 @@
 #version 330 core
 
 layout (location = 0) in vec3 aPos;
+// positions may be quantized, see vertex_format.h
+layout (location = 7) in vec3 positionOffset;
+layout (location = 8) in vec3 positionScale;
 
 uniform mat4 model;
 layout (std140) uniform Matrices {
@@ -9,5 +12,6 @@ layout (std140) uniform Matrices {
 };
 
 void main() {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	vec3 position = positionOffset + aPos * positionScale;
+	gl_Position = projection * view * model * vec4(position, 1.0);
 }
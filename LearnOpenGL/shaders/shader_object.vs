@@ -3,6 +3,9 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+// positions may be quantized, see vertex_format.h
+layout (location = 7) in vec3 positionOffset;
+layout (location = 8) in vec3 positionScale;
 
 out VS_OUT {
     vec3 norm; // in view space
@@ -23,7 +26,8 @@ layout (std140) uniform Matrices {
 };
 
 void main() {
-    vs_out.fragPosWorldSpace = model * vec4(aPos, 1.0);
+    vec3 position = positionOffset + aPos * positionScale;
+    vs_out.fragPosWorldSpace = model * vec4(position, 1.0);
     vs_out.fragPos = (view * vs_out.fragPosWorldSpace).xyz;
     vs_out.fragPosDirLightSpace = dirLightSpace * vs_out.fragPosWorldSpace;
     vs_out.fragPosSpotLightSpace = spotLightSpace * vs_out.fragPosWorldSpace;
@@ -1,9 +1,17 @@
 #version 330 core
 
 layout (location = 0) in vec3 aPos;
+// positions may be quantized, see vertex_format.h
+layout (location = 7) in vec3 positionOffset;
+layout (location = 8) in vec3 positionScale;
+
+out vec4 fragPos;
 
 uniform mat4 model;
+uniform mat4 lightSpace; // of the cubemap face being rendered
 
 void main() {
-    gl_Position = model * vec4(aPos, 1.0); // in world space
+    vec3 position = positionOffset + aPos * positionScale;
+    fragPos = model * vec4(position, 1.0); // in world space
+    gl_Position = lightSpace * fragPos;
 }
@@ -5,11 +5,12 @@ in vec2 texCoord;
 out vec4 fragColor;
 
 struct Material {
-    sampler2D diffuse0;
+    sampler2DArray diffuse;
+    vec3 layers;
 };
 
 uniform Material material;
 
 void main() {
-    fragColor = texture(material.diffuse0, texCoord);
+    fragColor = texture(material.diffuse, vec3(texCoord, material.layers.x));
 }
@@ -3,6 +3,9 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+// positions may be quantized, see vertex_format.h
+layout (location = 7) in vec3 positionOffset;
+layout (location = 8) in vec3 positionScale;
 
 out vec2 texCoord;
 
@@ -13,6 +16,7 @@ layout (std140) uniform Matrices {
 };
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec3 position = positionOffset + aPos * positionScale;
+    gl_Position = projection * view * model * vec4(position, 1.0);
     texCoord = aTexCoord;
 }
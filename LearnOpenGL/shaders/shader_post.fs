@@ -0,0 +1,19 @@
+#version 330 core
+
+in vec2 texCoord;
+
+out vec4 fragColor;
+
+// composites bloom, tonemaps and corrects gamma in one pass, straight into
+// default framebuffer
+uniform float exposure;
+uniform sampler2D scene;
+uniform sampler2D bloom;
+
+void main() {
+    vec3 hdrColor = texture(scene, texCoord).rgb;
+    vec3 bloomColor = texture(bloom, texCoord).rgb;
+    vec3 linearColor = vec3(1.0) - exp(-(hdrColor + bloomColor) * exposure);
+    // gamma correction at the very last step
+    fragColor = vec4(pow(linearColor, vec3(1.0 / 2.2)), 1.0);
+}
@@ -1,6 +1,9 @@
 #version 330 core
 
 layout (location = 0) in vec3 aPos;
+// positions may be quantized, see vertex_format.h
+layout (location = 7) in vec3 positionOffset;
+layout (location = 8) in vec3 positionScale;
 
 out vec3 texCoord;
 
@@ -10,8 +13,9 @@ layout (std140) uniform Matrices {
 };
 
 void main() {
+    vec3 position = positionOffset + aPos * positionScale;
     // ignore translation, so that camera never moves relative to skybox
-    gl_Position = projection * mat4(mat3(view)) * vec4(aPos, 1.0);
+    gl_Position = projection * mat4(mat3(view)) * vec4(position, 1.0);
     gl_Position.zw = vec2(1.0);
-    texCoord = aPos;
+    texCoord = position;
 }
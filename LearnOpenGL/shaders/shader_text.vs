@@ -5,7 +5,9 @@ layout (location = 1) in vec2 aTexCoord;
 
 out vec2 texCoord;
 
+uniform vec2 offset;
+
 void main() {
-    gl_Position = vec4(aPos, -1.0, 1.0);
+    gl_Position = vec4(aPos + offset, -1.0, 1.0);
     texCoord = aTexCoord;
 }
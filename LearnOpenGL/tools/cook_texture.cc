@@ -0,0 +1,352 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <image/stb_image.h>
+
+#include "../wrapper/texture_format.h"
+
+namespace format = wrapper::opengl::texture_format;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace {
+
+struct Image {
+  int width, height, channel;
+  vector<uint8_t> pixels;
+
+  const uint8_t* pixel(int x, int y) const {
+    // clamp to edge
+    x = std::min(std::max(x, 0), width - 1);
+    y = std::min(std::max(y, 0), height - 1);
+    return &pixels[(y * width + x) * channel];
+  }
+};
+
+struct Options {
+  bool srgb = false;
+  bool compress = false;
+};
+
+Image Decode(const string& path) {
+  Image image;
+  stbi_uc* data = stbi_load(path.c_str(), &image.width, &image.height,
+                            &image.channel, 0);
+  if (!data) throw runtime_error{"Failed to load image from " + path};
+  if (image.channel == 2) {
+    stbi_image_free(data);
+    throw runtime_error{"Unsupported channel count in " + path};
+  }
+  image.pixels.assign(data,
+                      data + image.width * image.height * image.channel);
+  stbi_image_free(data);
+  return image;
+}
+
+float SrgbToLinear(float value) {
+  return value <= 0.04045f ? value / 12.92f :
+      std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float LinearToSrgb(float value) {
+  return value <= 0.0031308f ? value * 12.92f :
+      1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// 2x2 box filter. color channels of sRGB images are averaged in linear space
+Image Downsample(const Image& image, bool srgb) {
+  Image result;
+  result.width = std::max(image.width / 2, 1);
+  result.height = std::max(image.height / 2, 1);
+  result.channel = image.channel;
+  result.pixels.resize(result.width * result.height * result.channel);
+
+  const int num_color = image.channel >= 3 ? 3 : image.channel;
+  for (int y = 0; y < result.height; ++y) {
+    for (int x = 0; x < result.width; ++x) {
+      const uint8_t* samples[4]{
+          image.pixel(2 * x,     2 * y),
+          image.pixel(2 * x + 1, 2 * y),
+          image.pixel(2 * x,     2 * y + 1),
+          image.pixel(2 * x + 1, 2 * y + 1),
+      };
+      uint8_t* dst = &result.pixels[(y * result.width + x) * result.channel];
+      for (int c = 0; c < image.channel; ++c) {
+        bool linearize = srgb && c < num_color;
+        float sum = 0.0f;
+        for (const uint8_t* sample : samples) {
+          float value = sample[c] / 255.0f;
+          sum += linearize ? SrgbToLinear(value) : value;
+        }
+        float average = sum / 4.0f;
+        if (linearize) average = LinearToSrgb(average);
+        dst[c] = static_cast<uint8_t>(
+            std::lround(std::min(std::max(average, 0.0f), 1.0f) * 255.0f));
+      }
+    }
+  }
+  return result;
+}
+
+uint16_t ToRgb565(const float color[3]) {
+  auto quantize = [](float value, int max) {
+    return static_cast<uint16_t>(
+        std::lround(std::min(std::max(value, 0.0f), 255.0f) / 255.0f * max));
+  };
+  return (quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) |
+      quantize(color[2], 31);
+}
+
+void FromRgb565(uint16_t packed, float color[3]) {
+  color[0] = ((packed >> 11) & 31) * 255.0f / 31.0f;
+  color[1] = ((packed >> 5) & 63) * 255.0f / 63.0f;
+  color[2] = (packed & 31) * 255.0f / 31.0f;
+}
+
+void WriteLittleEndian(uint64_t value, int num_bytes, uint8_t* dst) {
+  for (int i = 0; i < num_bytes; ++i)
+    dst[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+// BC1 color block, always in 4-color mode. endpoints are corners of the
+// bounding box of block colors, inset slightly to reduce error
+void EncodeColorBlock(const uint8_t block[16][4], uint8_t* dst) {
+  float min_color[3]{255.0f, 255.0f, 255.0f}, max_color[3]{0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 16; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      min_color[c] = std::min(min_color[c], (float)block[i][c]);
+      max_color[c] = std::max(max_color[c], (float)block[i][c]);
+    }
+  }
+  for (int c = 0; c < 3; ++c) {
+    float inset = (max_color[c] - min_color[c]) / 16.0f;
+    min_color[c] += inset;
+    max_color[c] -= inset;
+  }
+
+  uint16_t color0 = ToRgb565(max_color), color1 = ToRgb565(min_color);
+  if (color0 < color1) std::swap(color0, color1);
+  uint32_t indices = 0;
+  if (color0 != color1) {
+    float palette[4][3];
+    FromRgb565(color0, palette[0]);
+    FromRgb565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+      palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+      palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+    for (int i = 0; i < 16; ++i) {
+      int best = 0;
+      float best_distance = INFINITY;
+      for (int p = 0; p < 4; ++p) {
+        float distance = 0.0f;
+        for (int c = 0; c < 3; ++c) {
+          float diff = block[i][c] - palette[p][c];
+          distance += diff * diff;
+        }
+        if (distance < best_distance) {
+          best = p;
+          best_distance = distance;
+        }
+      }
+      indices |= static_cast<uint32_t>(best) << (2 * i);
+    }
+  }
+  WriteLittleEndian(color0, 2, dst);
+  WriteLittleEndian(color1, 2, dst + 2);
+  WriteLittleEndian(indices, 4, dst + 4);
+}
+
+// BC3 alpha block in 8-alpha mode
+void EncodeAlphaBlock(const uint8_t block[16][4], uint8_t* dst) {
+  uint8_t alpha0 = 0, alpha1 = 255;
+  for (int i = 0; i < 16; ++i) {
+    alpha0 = std::max(alpha0, block[i][3]);
+    alpha1 = std::min(alpha1, block[i][3]);
+  }
+  uint64_t indices = 0;
+  if (alpha0 != alpha1) {
+    float palette[8]{(float)alpha0, (float)alpha1};
+    for (int p = 1; p <= 6; ++p)
+      palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7.0f;
+    for (int i = 0; i < 16; ++i) {
+      int best = 0;
+      for (int p = 1; p < 8; ++p) {
+        if (std::abs(block[i][3] - palette[p]) <
+            std::abs(block[i][3] - palette[best])) best = p;
+      }
+      indices |= static_cast<uint64_t>(best) << (3 * i);
+    }
+  }
+  dst[0] = alpha0;
+  dst[1] = alpha1;
+  WriteLittleEndian(indices, 6, dst + 2);
+}
+
+vector<uint8_t> Compress(const Image& image) {
+  const bool has_alpha = image.channel == 4;
+  const int block_size = has_alpha ? 16 : 8;
+  const int blocks_x = (image.width + 3) / 4, blocks_y = (image.height + 3) / 4;
+  vector<uint8_t> result(blocks_x * blocks_y * block_size);
+  uint8_t* dst = result.data();
+  for (int by = 0; by < blocks_y; ++by) {
+    for (int bx = 0; bx < blocks_x; ++bx) {
+      uint8_t block[16][4];
+      for (int i = 0; i < 16; ++i) {
+        const uint8_t* src = image.pixel(bx * 4 + i % 4, by * 4 + i / 4);
+        for (int c = 0; c < 4; ++c)
+          block[i][c] = c < image.channel ? src[c] : 255;
+      }
+      if (has_alpha) {
+        EncodeAlphaBlock(block, dst);
+        EncodeColorBlock(block, dst + 8);
+      } else {
+        EncodeColorBlock(block, dst);
+      }
+      dst += block_size;
+    }
+  }
+  return result;
+}
+
+void Cook(const vector<string>& sources,
+          const string& output,
+          bool mipmap,
+          const Options& options) {
+  vector<Image> faces;
+  for (const auto& source : sources) {
+    faces.emplace_back(Decode(source));
+    if (faces.back().width != faces[0].width ||
+        faces.back().height != faces[0].height ||
+        faces.back().channel != faces[0].channel)
+      throw runtime_error{"Faces differ in size or format: " + source};
+  }
+  const int channel = faces[0].channel;
+  const bool compress = options.compress && channel != 1;
+
+  format::Header header;
+  std::memcpy(header.magic, format::kMagic, sizeof(format::kMagic));
+  header.version = format::kVersion;
+  header.num_faces = static_cast<uint32_t>(faces.size());
+  header.num_levels = 1;
+  if (mipmap) {
+    int size = std::max(faces[0].width, faces[0].height);
+    while (size > 1) {
+      size /= 2;
+      ++header.num_levels;
+    }
+  }
+  header.compressed = compress;
+  header.srgb = options.srgb;
+  header.reserved = 0;
+  switch (channel) {
+    case 1:
+      header.internal_format = GL_R8;
+      header.format = GL_RED;
+      break;
+    case 3:
+      header.internal_format = compress ?
+          (options.srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT :
+                          GL_COMPRESSED_RGB_S3TC_DXT1_EXT) :
+          (options.srgb ? GL_SRGB8 : GL_RGB8);
+      header.format = GL_RGB;
+      break;
+    case 4:
+      header.internal_format = compress ?
+          (options.srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT :
+                          GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) :
+          (options.srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8);
+      header.format = GL_RGBA;
+      break;
+  }
+
+  vector<format::Level> levels;
+  vector<vector<uint8_t>> level_data;
+  uint64_t offset = sizeof(format::Header) +
+      header.num_faces * header.num_levels * sizeof(format::Level);
+  for (Image& image : faces) {
+    for (uint32_t level = 0; level < header.num_levels; ++level) {
+      if (level > 0) image = Downsample(image, options.srgb);
+      level_data.emplace_back(compress ? Compress(image) : image.pixels);
+      offset = (offset + format::kAlignment - 1) /
+          format::kAlignment * format::kAlignment;
+      levels.emplace_back(format::Level{
+          offset, level_data.back().size(),
+          static_cast<uint32_t>(image.width),
+          static_cast<uint32_t>(image.height)});
+      offset += level_data.back().size();
+    }
+  }
+
+  std::ofstream file{output, std::ios::binary | std::ios::trunc};
+  if (!file.is_open()) throw runtime_error{"Failed to open file: " + output};
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(levels.data()),
+             levels.size() * sizeof(format::Level));
+  for (size_t i = 0; i < levels.size(); ++i) {
+    long padding = levels[i].offset - static_cast<uint64_t>(file.tellp());
+    file.write(string(padding, '\0').data(), padding);
+    file.write(reinterpret_cast<const char*>(level_data[i].data()),
+               level_data[i].size());
+  }
+  if (!file.good()) throw runtime_error{"Failed to write file: " + output};
+
+  std::cout << output << ": " << faces[0].width << "x" << faces[0].height
+            << ", " << header.num_faces << " face(s), " << header.num_levels
+            << " level(s)" << (compress ? ", compressed" : "") << std::endl;
+}
+
+} /* namespace */
+
+// converts images into the cooked texture format (see texture_format.h), with
+// all mip levels baked in their final internal format
+//
+// usage: CookTexture [--srgb] [--compress] IMAGE...
+//            writes IMAGE.ktex for each IMAGE
+//        CookTexture [--srgb] [--compress] --cubemap DIRECTORY FACE...
+//            writes DIRECTORY.ktex from DIRECTORY/FACE (+x, -x, +y, -y, +z, -z)
+//
+// --srgb should match how the texture is loaded (gamma_correction), and makes
+// mip levels filtered in linear space. --compress uses BC1 (RGB) or BC3
+// (RGBA). single channel images are never compressed
+int main(int argc, const char * argv[]) {
+  try {
+    Options options;
+    bool cubemap = false;
+    vector<string> inputs;
+    for (int i = 1; i < argc; ++i) {
+      string arg{argv[i]};
+      if (arg == "--srgb") options.srgb = true;
+      else if (arg == "--compress") options.compress = true;
+      else if (arg == "--cubemap") cubemap = true;
+      else inputs.emplace_back(arg);
+    }
+
+    if (cubemap) {
+      if (inputs.size() != 7)
+        throw runtime_error{"Cubemap needs a directory and 6 faces"};
+      vector<string> faces;
+      for (size_t i = 1; i < inputs.size(); ++i)
+        faces.emplace_back(inputs[0] + '/' + inputs[i]);
+      // skybox is sampled without mipmaps
+      Cook(faces, inputs[0] + format::kExtension, false, options);
+    } else {
+      if (inputs.empty()) throw runtime_error{"No input image"};
+      for (const auto& input : inputs)
+        Cook({input}, input + format::kExtension, true, options);
+    }
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+  }
+  return -1;
+}
@@ -0,0 +1,122 @@
+#include "bloom.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace wrapper {
+namespace opengl {
+namespace {
+
+// each upsampled level is averaged with the one above, so that the result
+// stays as bright as highlights however many levels there are
+const float kUpsampleBlend{0.5f};
+
+} /* namespace */
+
+Bloom::Bloom(const Shader& downsample_shader,
+             const Shader& upsample_shader,
+             RenderTargetPool* pool,
+             int num_levels,
+             float radius,
+             bool high_quality,
+             GLenum format,
+             float threshold)
+    : downsample_shader_{downsample_shader},
+      upsample_shader_{upsample_shader},
+      downsample_texture_{downsample_shader_.get_handle<int>("texture1")},
+      downsample_high_quality_{
+          downsample_shader_.get_handle<int>("highQuality")},
+      downsample_first_level_{
+          downsample_shader_.get_handle<int>("firstLevel")},
+      downsample_threshold_{
+          downsample_shader_.get_handle<float>("threshold")},
+      upsample_texture_{upsample_shader_.get_handle<int>("texture1")},
+      upsample_high_quality_{upsample_shader_.get_handle<int>("highQuality")},
+      upsample_radius_{upsample_shader_.get_handle<float>("radius")},
+      pool_{pool}, max_levels_{std::max(num_levels, 1)},
+      radius_{radius}, high_quality_{high_quality}, format_{format},
+      threshold_{threshold} {}
+
+Bloom::~Bloom() {
+  for (const auto& level : levels_)
+    glDeleteFramebuffers(1, &level.framebuffer);
+}
+
+void Bloom::AcquireLevels(int width, int height) {
+  // stop before levels become smaller than filters. framebuffers of levels
+  // are kept, and textures are attached again only if pool hands out others
+  int num_levels = 0;
+  for (int i = 0; i < max_levels_; ++i) {
+    width /= 2;
+    height /= 2;
+    if (i > 0 && (width < 4 || height < 4)) break;
+    if (i == static_cast<int>(levels_.size())) {
+      levels_.emplace_back(Level{0, 0, 0, 0});
+      glGenFramebuffers(1, &levels_.back().framebuffer);
+    }
+    Level& level = levels_[i];
+    level.width = std::max(width, 1);
+    level.height = std::max(height, 1);
+    // filters rely on bilinear taps
+    GLuint texture = pool_->Acquire({level.width, level.height, format_, 0},
+                                    GL_LINEAR);
+    if (texture != level.texture) {
+      level.texture = texture;
+      glBindFramebuffer(GL_FRAMEBUFFER, level.framebuffer);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_TEXTURE_2D, level.texture, 0);
+      if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        throw std::runtime_error{"Bloom framebuffer incomplete"};
+    }
+    ++num_levels;
+  }
+  for (size_t i = num_levels; i < levels_.size(); ++i)
+    glDeleteFramebuffers(1, &levels_[i].framebuffer);
+  levels_.resize(num_levels);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+GLuint Bloom::Apply(GLuint source, int width, int height, const Model& screen,
+                    GpuProfiler* profiler) {
+  AcquireLevels(width, height);
+  glActiveTexture(GL_TEXTURE0);
+
+  if (profiler) profiler->BeginZone("bloom down");
+  downsample_shader_.Use();
+  downsample_shader_.set(downsample_texture_, 0);
+  downsample_shader_.set(downsample_high_quality_, high_quality_ ? 1 : 0);
+  downsample_shader_.set(downsample_threshold_, threshold_);
+  for (size_t i = 0; i < levels_.size(); ++i) {
+    const Level& level = levels_[i];
+    glBindFramebuffer(GL_FRAMEBUFFER, level.framebuffer);
+    glViewport(0, 0, level.width, level.height);
+    glBindTexture(GL_TEXTURE_2D, i == 0 ? source : levels_[i - 1].texture);
+    downsample_shader_.set(downsample_first_level_, i == 0 ? 1 : 0);
+    screen.Draw(downsample_shader_);
+  }
+  if (profiler) profiler->EndZone();
+
+  if (profiler) profiler->BeginZone("bloom up");
+  upsample_shader_.Use();
+  upsample_shader_.set(upsample_texture_, 0);
+  upsample_shader_.set(upsample_high_quality_, high_quality_ ? 1 : 0);
+  upsample_shader_.set(upsample_radius_, radius_);
+  glEnable(GL_BLEND);
+  glBlendColor(0.0f, 0.0f, 0.0f, kUpsampleBlend);
+  glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+  for (size_t i = levels_.size() - 1; i > 0; --i) {
+    const Level& level = levels_[i - 1];
+    glBindFramebuffer(GL_FRAMEBUFFER, level.framebuffer);
+    glViewport(0, 0, level.width, level.height);
+    glBindTexture(GL_TEXTURE_2D, levels_[i].texture);
+    screen.Draw(upsample_shader_);
+    pool_->Release(levels_[i].texture);
+  }
+  glDisable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  if (profiler) profiler->EndZone();
+  return levels_[0].texture;
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
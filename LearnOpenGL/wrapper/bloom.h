@@ -0,0 +1,82 @@
+#ifndef WRAPPER_OPENGL_BLOOM_H
+#define WRAPPER_OPENGL_BLOOM_H
+
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "model.h"
+#include "profiler.h"
+#include "render_target_pool.h"
+#include "shader.h"
+
+namespace wrapper {
+namespace opengl {
+
+// blurs highlights over a chain of levels, each half the size of the previous
+// one, starting at half resolution (Jimenez 2014, "Next generation post
+// processing in Call of Duty: Advanced Warfare"). highlights, pixels brighter
+// than a threshold, are extracted while the scene is filtered into the first
+// level, so there is no separate bright pass. they are filtered down the
+// chain, then each level is upsampled with a tent filter and blended into the
+// one above, so that wide blur comes from small levels and costs little
+// bandwidth. in high quality, downsampling takes 13 taps and weighs the first
+// level by luma to suppress fireflies, and upsampling takes 9 taps. otherwise
+// both take 4 bilinear taps (Martin 2015, dual filtering). shaders are
+// shader_bloom_down.fs and shader_bloom_up.fs. levels are taken from a pool
+// every time, and all but the first one are given back as soon as they are
+// consumed, so that later passes can reuse their memory
+class Bloom {
+ public:
+  // radius scales the upsampling filter, in texels of each level. levels are
+  // stored in format, which must be able to hold HDR color. threshold is of
+  // luma. pool must outlive this
+  Bloom(const Shader& downsample_shader,
+        const Shader& upsample_shader,
+        RenderTargetPool* pool,
+        int num_levels,
+        float radius,
+        bool high_quality,
+        GLenum format,
+        float threshold = 1.0f);
+  Bloom(const Bloom&) = delete;
+  Bloom& operator=(const Bloom&) = delete;
+  ~Bloom();
+
+  // blurs highlights of texture source, which is of width and height, and
+  // returns them at half resolution of source, drawing screen for every
+  // pass. fewer levels are used if source is too small for all of them. the
+  // texture returned is acquired from pool, and should be released after
+  // it is read. depth test and blending must be disabled. framebuffer and
+  // viewport are changed. profiler may be null
+  GLuint Apply(GLuint source, int width, int height, const Model& screen,
+               GpuProfiler* profiler);
+
+ private:
+  struct Level {
+    GLuint texture, framebuffer;
+    int width, height;
+  };
+
+  // acquires levels for source of width and height
+  void AcquireLevels(int width, int height);
+
+  Shader downsample_shader_, upsample_shader_;
+  UniformHandle<int> downsample_texture_, downsample_high_quality_,
+                     downsample_first_level_;
+  UniformHandle<float> downsample_threshold_;
+  UniformHandle<int> upsample_texture_, upsample_high_quality_;
+  UniformHandle<float> upsample_radius_;
+  RenderTargetPool* pool_;
+  int max_levels_;
+  std::vector<Level> levels_;
+  float radius_;
+  bool high_quality_;
+  GLenum format_;
+  float threshold_;
+};
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_BLOOM_H */
@@ -0,0 +1,146 @@
+#include "bounds.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using glm::mat4;
+using glm::vec3;
+using glm::vec4;
+
+namespace wrapper {
+namespace opengl {
+
+AABB::AABB()
+    : min{std::numeric_limits<float>::max()},
+      max{std::numeric_limits<float>::lowest()} {}
+
+AABB AABB::Enclose(const vec3* points, size_t num_points, size_t stride) {
+  AABB box;
+  const char* address = reinterpret_cast<const char*>(points);
+  for (size_t i = 0; i < num_points; ++i, address += stride)
+    box.Extend(*reinterpret_cast<const vec3*>(address));
+  return box;
+}
+
+float AABB::area() const {
+  if (empty()) return 0.0f;
+  vec3 size = max - min;
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+void AABB::Extend(const vec3& point) {
+  min = glm::min(min, point);
+  max = glm::max(max, point);
+}
+
+void AABB::Extend(const AABB& other) {
+  if (other.empty()) return;
+  min = glm::min(min, other.min);
+  max = glm::max(max, other.max);
+}
+
+bool AABB::Contains(const AABB& other) const {
+  return min.x <= other.min.x && min.y <= other.min.y &&
+         min.z <= other.min.z && max.x >= other.max.x &&
+         max.y >= other.max.y && max.z >= other.max.z;
+}
+
+bool AABB::Intersects(const AABB& other) const {
+  return min.x <= other.max.x && max.x >= other.min.x &&
+         min.y <= other.max.y && max.y >= other.min.y &&
+         min.z <= other.max.z && max.z >= other.min.z;
+}
+
+AABB AABB::Transform(const mat4& matrix) const {
+  if (empty()) return *this;
+  // transform center, and project extent onto each axis of the new space
+  vec3 center = vec3(matrix * vec4(this->center(), 1.0f));
+  vec3 extent = this->extent(), new_extent{0.0f};
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j)
+      new_extent[i] += std::abs(matrix[j][i]) * extent[j];
+  }
+  return AABB{center - new_extent, center + new_extent};
+}
+
+Sphere Sphere::Enclose(const AABB& box,
+                       const vec3* points,
+                       size_t num_points,
+                       size_t stride) {
+  vec3 center = box.center();
+  float radius_squared = 0.0f;
+  const char* address = reinterpret_cast<const char*>(points);
+  for (size_t i = 0; i < num_points; ++i, address += stride) {
+    vec3 offset = *reinterpret_cast<const vec3*>(address) - center;
+    radius_squared = std::max(radius_squared, glm::dot(offset, offset));
+  }
+  return Sphere{center, std::sqrt(radius_squared)};
+}
+
+Sphere Sphere::Transform(const mat4& matrix) const {
+  float scale = std::max({glm::length(vec3(matrix[0])),
+                          glm::length(vec3(matrix[1])),
+                          glm::length(vec3(matrix[2]))});
+  return Sphere{vec3(matrix * vec4(center, 1.0f)), radius * scale};
+}
+
+bool Ray::Intersects(const AABB& box, float max_t, float* t) const {
+  if (box.empty()) return false;
+  // slab test. division by zero gives infinity, which works out
+  float t_near = 0.0f, t_far = max_t;
+  for (int i = 0; i < 3; ++i) {
+    float inv_dir = 1.0f / direction[i];
+    float t0 = (box.min[i] - origin[i]) * inv_dir;
+    float t1 = (box.max[i] - origin[i]) * inv_dir;
+    if (t0 > t1) std::swap(t0, t1);
+    t_near = std::max(t_near, t0);
+    t_far = std::min(t_far, t1);
+    if (t_near > t_far) return false;
+  }
+  *t = t_near;
+  return true;
+}
+
+Frustum::Frustum(const mat4& view_proj) {
+  // Gribb-Hartmann: planes are sums and differences of rows of the matrix.
+  // GLM is in column order, so row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+  vec4 rows[4];
+  for (int i = 0; i < 4; ++i)
+    rows[i] = vec4(view_proj[0][i], view_proj[1][i],
+                   view_proj[2][i], view_proj[3][i]);
+  for (int i = 0; i < 3; ++i) {
+    planes_[2 * i] = rows[3] + rows[i];
+    planes_[2 * i + 1] = rows[3] - rows[i];
+  }
+  // so that distance to plane is in world units, as needed for spheres
+  for (auto& plane : planes_)
+    plane = plane / glm::length(vec3(plane));
+}
+
+bool Frustum::Intersects(const AABB& box) const {
+  if (box.empty()) return false;
+  for (const auto& plane : planes_) {
+    // test the corner that is furthest along the normal
+    vec3 corner{plane.x > 0.0f ? box.max.x : box.min.x,
+                plane.y > 0.0f ? box.max.y : box.min.y,
+                plane.z > 0.0f ? box.max.z : box.min.z};
+    if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z +
+        plane.w < 0.0f)
+      return false;
+  }
+  return true;
+}
+
+bool Frustum::Intersects(const Sphere& sphere) const {
+  const vec3& center = sphere.center;
+  for (const auto& plane : planes_) {
+    if (plane.x * center.x + plane.y * center.y + plane.z * center.z +
+        plane.w < -sphere.radius)
+      return false;
+  }
+  return true;
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
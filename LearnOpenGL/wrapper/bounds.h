@@ -0,0 +1,74 @@
+#ifndef WRAPPER_OPENGL_BOUNDS_H
+#define WRAPPER_OPENGL_BOUNDS_H
+
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+namespace wrapper {
+namespace opengl {
+
+// axis-aligned bounding box. default constructed box is empty, and extending
+// it with the first point makes a box containing only that point
+struct AABB {
+  glm::vec3 min, max;
+
+  AABB();
+  AABB(const glm::vec3& min, const glm::vec3& max) : min{min}, max{max} {}
+  // points may be interleaved with other data, e.g. positions of vertices
+  static AABB Enclose(const glm::vec3* points,
+                      size_t num_points,
+                      size_t stride = sizeof(glm::vec3));
+  bool empty() const { return min.x > max.x; }
+  glm::vec3 center() const { return (min + max) * 0.5f; }
+  glm::vec3 extent() const { return (max - min) * 0.5f; }
+  // surface area, used as cost of bounding volume hierarchy nodes
+  float area() const;
+  void Extend(const glm::vec3& point);
+  void Extend(const AABB& other);
+  bool Contains(const AABB& other) const;
+  bool Intersects(const AABB& other) const;
+  // smallest box containing this box after transformation
+  AABB Transform(const glm::mat4& matrix) const;
+};
+
+struct Sphere {
+  glm::vec3 center;
+  float radius;
+
+  // sphere centered at box center, with radius covering all points
+  static Sphere Enclose(const AABB& box,
+                        const glm::vec3* points,
+                        size_t num_points,
+                        size_t stride = sizeof(glm::vec3));
+  // radius is scaled by largest axis scale of matrix
+  Sphere Transform(const glm::mat4& matrix) const;
+};
+
+struct Ray {
+  glm::vec3 origin;
+  glm::vec3 direction;  // need not be normalized
+
+  // returns false if ray misses box within [0, max_t]. otherwise, *t is set
+  // to the entry point (0 if origin is inside)
+  bool Intersects(const AABB& box, float max_t, float* t) const;
+};
+
+// convex volume defined by planes of clip space of a view-projection matrix
+class Frustum {
+ public:
+  explicit Frustum(const glm::mat4& view_proj);
+  // conservative, may return true for boxes that are close to corners
+  bool Intersects(const AABB& box) const;
+  bool Intersects(const Sphere& sphere) const;
+  // (normal, distance), normals are normalized and point inwards
+  const glm::vec4* planes() const { return planes_; }
+
+ private:
+  glm::vec4 planes_[6];
+};
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_BOUNDS_H */
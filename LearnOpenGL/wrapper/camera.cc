@@ -7,6 +7,7 @@
 
 #include "camera.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include <glm/gtc/matrix_transform.hpp>
@@ -70,6 +71,12 @@ void Camera::ProcessMouseScroll(double y, double min_val, double max_val) {
   UpdateProjMatrix();
 }
 
+float Camera::ProjectedSize(float size, float distance) const {
+  // proj_[1][1] is cot(fov / 2), which maps view space height at distance 1
+  // to half of screen height
+  return size * proj_[1][1] * height_ * 0.5f / std::max(distance, near_);
+}
+
 void Camera::set_screen_size(int width, int height) {
   width_ = width;
   height_ = height;
@@ -10,6 +10,8 @@
 
 #include <glm/glm.hpp>
 
+#include "bounds.h"
+
 namespace wrapper {
 namespace opengl {
 
@@ -37,6 +39,9 @@ class Camera {
   const glm::vec3& direction()    const { return front_; }
   const glm::mat4& view_matrix()  const { return view_; }
   const glm::mat4& proj_matrix()  const { return proj_; }
+  Frustum frustum() const { return Frustum{proj_ * view_}; }
+  // returns height in pixels of an object of size at distance from camera
+  float ProjectedSize(float size, float distance) const;
 
  private:
   glm::vec3 position_, front_, up_, right_;
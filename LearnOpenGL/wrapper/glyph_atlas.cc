@@ -0,0 +1,129 @@
+#include "glyph_atlas.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+using glm::ivec2;
+using std::runtime_error;
+using std::string;
+
+namespace wrapper {
+namespace opengl {
+namespace {
+
+const int kInitialSideLength{512};
+// leave empty pixels between glyphs, so that linear filtering does not
+// sample neighbors
+const int kPadding{1};
+
+} /* namespace */
+
+GlyphAtlas::GlyphAtlas(const string& font_path, int pixel_height)
+    : size_{kInitialSideLength, kInitialSideLength}, generation_{0},
+      cursor_{kPadding, kPadding}, row_height_{0},
+      pixels_(size_.x * size_.y, 0) {
+  if (FT_Init_FreeType(&library_))
+    throw runtime_error{"Failed to init FreeType library"};
+  if (FT_New_Face(library_, font_path.c_str(), 0, &face_)) {
+    FT_Done_FreeType(library_);
+    throw runtime_error{"Failed to load font from " + font_path};
+  }
+  FT_Set_Pixel_Sizes(face_, 0, pixel_height);  // set width to 0 for auto adjustment
+
+  glGenTextures(1, &texture_);
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, size_.x, size_.y, 0,
+               GL_RED, GL_UNSIGNED_BYTE, pixels_.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+GlyphAtlas::~GlyphAtlas() {
+  glDeleteTextures(1, &texture_);
+  FT_Done_Face(face_);
+  FT_Done_FreeType(library_);
+}
+
+const Glyph& GlyphAtlas::GetGlyph(uint32_t code_point) {
+  auto found = glyphs_.find(code_point);
+  if (found != glyphs_.end()) return found->second;
+
+  if (FT_Load_Char(face_, code_point, FT_LOAD_RENDER))
+    throw runtime_error{"Failed to load glyph " + std::to_string(code_point)};
+  const FT_Bitmap& bitmap = face_->glyph->bitmap;
+  ivec2 size(bitmap.width, bitmap.rows);
+  ivec2 offset = Allocate(size);
+
+  // FreeType bitmap rows may be padded, copy row by row. negative pitch means
+  // rows are stored bottom-up, and buffer points to the bottom row
+  const int pitch = std::abs(bitmap.pitch);
+  for (int row = 0; row < size.y; ++row) {
+    const unsigned char* src = bitmap.buffer +
+        (bitmap.pitch >= 0 ? row : size.y - 1 - row) * pitch;
+    std::copy(src, src + size.x,
+              pixels_.begin() + (offset.y + row) * size_.x + offset.x);
+  }
+  if (size.x > 0 && size.y > 0) {
+    // upload the region just copied, rows of which are as long as atlas
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, size_.x);
+    glBindTexture(GL_TEXTURE_2D, texture_);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, offset.x, offset.y, size.x, size.y,
+                    GL_RED, GL_UNSIGNED_BYTE,
+                    pixels_.data() + offset.y * size_.x + offset.x);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
+
+  Glyph glyph{
+      offset,
+      size,
+      ivec2(face_->glyph->bitmap_left, face_->glyph->bitmap_top),
+      // advance is number of 1/64 pixels
+      (GLuint) face_->glyph->advance.x >> 6,
+  };
+  return glyphs_.insert({code_point, glyph}).first->second;
+}
+
+ivec2 GlyphAtlas::Allocate(const ivec2& size) {
+  if (size.x + 2 * kPadding > size_.x)
+    throw runtime_error{"Glyph is wider than atlas"};
+  // start a new row if this one is full
+  if (cursor_.x + size.x + kPadding > size_.x) {
+    cursor_ = ivec2(kPadding, cursor_.y + row_height_ + kPadding);
+    row_height_ = 0;
+  }
+  while (cursor_.y + size.y + kPadding > size_.y)
+    Grow();
+  ivec2 offset = cursor_;
+  cursor_.x += size.x + kPadding;
+  row_height_ = std::max(row_height_, size.y);
+  return offset;
+}
+
+void GlyphAtlas::Grow() {
+  GLint max_size;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+  if (size_.y * 2 > max_size)
+    throw runtime_error{"Glyph atlas exceeds maximum texture size"};
+
+  // existing glyphs keep their pixel offsets, only new rows are appended
+  size_.y *= 2;
+  pixels_.resize(size_.x * size_.y, 0);
+  ++generation_;
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, size_.x, size_.y, 0,
+               GL_RED, GL_UNSIGNED_BYTE, pixels_.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
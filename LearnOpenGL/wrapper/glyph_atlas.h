@@ -0,0 +1,64 @@
+#ifndef WRAPPER_OPENGL_GLYPH_ATLAS_H
+#define WRAPPER_OPENGL_GLYPH_ATLAS_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// avoid exposing FreeType headers, same as FT_Library and FT_Face
+struct FT_LibraryRec_;
+struct FT_FaceRec_;
+
+namespace wrapper {
+namespace opengl {
+
+struct Glyph {
+  glm::ivec2 offset;   // top-left corner in atlas, in pixels
+  glm::ivec2 size;
+  glm::ivec2 bearing;
+  GLuint advance;
+};
+
+// all glyphs of a font packed into one single-channel texture. glyphs are
+// rasterized the first time they are requested, so any code point that the
+// font covers can be drawn. when the atlas is full, it grows taller and
+// generation() changes, after which texture coordinates computed from old
+// size() are no longer valid
+class GlyphAtlas {
+ public:
+  GlyphAtlas(const std::string& font_path, int pixel_height = 48);
+  GlyphAtlas(const GlyphAtlas&) = delete;
+  GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+  ~GlyphAtlas();
+
+  // may upload to the atlas texture, so must be called with GL context
+  const Glyph& GetGlyph(uint32_t code_point);
+  GLuint texture() const { return texture_; }
+  const glm::ivec2& size() const { return size_; }
+  int generation() const { return generation_; }
+
+ private:
+  FT_LibraryRec_* library_;
+  FT_FaceRec_* face_;
+  GLuint texture_;
+  glm::ivec2 size_;
+  int generation_;
+  // shelf packing: glyphs are placed left to right in rows
+  glm::ivec2 cursor_;
+  int row_height_;
+  // copy of texture, so that it can be uploaded again after growing
+  std::vector<unsigned char> pixels_;
+  std::unordered_map<uint32_t, Glyph> glyphs_;
+
+  glm::ivec2 Allocate(const glm::ivec2& size);
+  void Grow();
+};
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_GLYPH_ATLAS_H */
@@ -0,0 +1,185 @@
+#include "instance_culler.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+using glm::mat4;
+using glm::vec3;
+using glm::vec4;
+using std::vector;
+
+namespace wrapper {
+namespace opengl {
+namespace {
+
+#if defined(__AVX__)
+const size_t kBatchSize{8};
+#elif defined(__SSE__) || defined(_M_X64)
+const size_t kBatchSize{4};
+#else
+const size_t kBatchSize{1};
+#endif
+
+// below this many instances per thread, waking threads costs more than it
+// saves
+const size_t kMinChunkSize{4096};
+
+// returns bit i set if sphere i of the batch starting at x, y, z, r
+// intersects all planes
+unsigned TestBatch(const vec4* planes,
+                   const float* x, const float* y, const float* z,
+                   const float* r) {
+#if defined(__AVX__)
+  __m256 cx = _mm256_loadu_ps(x), cy = _mm256_loadu_ps(y);
+  __m256 cz = _mm256_loadu_ps(z);
+  __m256 neg_r = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(r));
+  __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+  for (int i = 0; i < 6; ++i) {
+    __m256 d = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[i].x), cx),
+                      _mm256_mul_ps(_mm256_set1_ps(planes[i].y), cy)),
+        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[i].z), cz),
+                      _mm256_set1_ps(planes[i].w)));
+    inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, neg_r, _CMP_GE_OQ));
+  }
+  return static_cast<unsigned>(_mm256_movemask_ps(inside));
+#elif defined(__SSE__) || defined(_M_X64)
+  __m128 cx = _mm_loadu_ps(x), cy = _mm_loadu_ps(y), cz = _mm_loadu_ps(z);
+  __m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(r));
+  __m128 inside = _mm_cmpeq_ps(cx, cx);  // all bits set unless NaN
+  for (int i = 0; i < 6; ++i) {
+    __m128 d = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[i].x), cx),
+                   _mm_mul_ps(_mm_set1_ps(planes[i].y), cy)),
+        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[i].z), cz),
+                   _mm_set1_ps(planes[i].w)));
+    inside = _mm_and_ps(inside, _mm_cmpge_ps(d, neg_r));
+  }
+  return static_cast<unsigned>(_mm_movemask_ps(inside));
+#else
+  for (int i = 0; i < 6; ++i) {
+    if (planes[i].x * x[0] + planes[i].y * y[0] + planes[i].z * z[0] +
+        planes[i].w < -r[0])
+      return 0;
+  }
+  return 1;
+#endif
+}
+
+} /* namespace */
+
+InstanceCuller::InstanceCuller(const AABB& mesh_bounds,
+                               const vector<mat4>& instances,
+                               int num_threads)
+    : instances_{instances}, visible_(instances.size()),
+      generation_{0}, num_pending_{0}, stopping_{false} {
+  // sphere around box in model space, scaled by largest axis of instance
+  Sphere sphere{mesh_bounds.center(), glm::length(mesh_bounds.extent())};
+  size_t padded_size = (instances_.size() + kBatchSize - 1) /
+                       kBatchSize * kBatchSize;
+  center_x_.resize(padded_size, 0.0f);
+  center_y_.resize(padded_size, 0.0f);
+  center_z_.resize(padded_size, 0.0f);
+  radius_.resize(padded_size, 0.0f);
+  for (size_t i = 0; i < instances_.size(); ++i) {
+    Sphere world_sphere = sphere.Transform(instances_[i]);
+    center_x_[i] = world_sphere.center.x;
+    center_y_[i] = world_sphere.center.y;
+    center_z_[i] = world_sphere.center.z;
+    radius_[i] = world_sphere.radius;
+  }
+
+  if (num_threads <= 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  size_t num_chunks = std::max<size_t>(1, std::min<size_t>(
+      num_threads, instances_.size() / kMinChunkSize));
+  // chunk boundaries are aligned to batches
+  size_t num_batches = padded_size / kBatchSize;
+  for (size_t i = 0; i < num_chunks; ++i) {
+    size_t begin = num_batches * i / num_chunks * kBatchSize;
+    size_t end = std::min(num_batches * (i + 1) / num_chunks * kBatchSize,
+                          instances_.size());
+    chunks_.emplace_back(Chunk{begin, end, 0});
+  }
+  for (size_t i = 1; i < num_chunks; ++i)
+    workers_.emplace_back(&InstanceCuller::WorkerLoop, this, i);
+}
+
+InstanceCuller::~InstanceCuller() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stopping_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto& worker : workers_)
+    worker.join();
+}
+
+void InstanceCuller::CullChunk(Chunk* chunk) {
+  // visible instances of each chunk are compacted to start of its own range
+  size_t num_visible = 0;
+  for (size_t i = chunk->begin; i < chunk->end; i += kBatchSize) {
+    unsigned mask = TestBatch(planes_, &center_x_[i], &center_y_[i],
+                              &center_z_[i], &radius_[i]);
+    for (size_t lane = 0; mask; ++lane, mask >>= 1) {
+      if ((mask & 1) && i + lane < chunk->end)
+        visible_[chunk->begin + num_visible++] = instances_[i + lane];
+    }
+  }
+  chunk->num_visible = num_visible;
+}
+
+void InstanceCuller::WorkerLoop(size_t chunk_index) {
+  unsigned seen_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      start_cv_.wait(lock, [&]() {
+        return stopping_ || generation_ != seen_generation;
+      });
+      if (stopping_) return;
+      seen_generation = generation_;
+    }
+    CullChunk(&chunks_[chunk_index]);
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      --num_pending_;
+    }
+    done_cv_.notify_one();
+  }
+}
+
+size_t InstanceCuller::Cull(const Frustum& frustum) {
+  std::copy(frustum.planes(), frustum.planes() + 6, planes_);
+  if (!workers_.empty()) {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      ++generation_;
+      num_pending_ = static_cast<int>(workers_.size());
+    }
+    start_cv_.notify_all();
+  }
+  CullChunk(&chunks_[0]);
+  if (!workers_.empty()) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    done_cv_.wait(lock, [this]() { return num_pending_ == 0; });
+  }
+
+  // close gaps between chunks
+  size_t num_visible = chunks_[0].num_visible;
+  for (size_t i = 1; i < chunks_.size(); ++i) {
+    std::memmove(&visible_[num_visible], &visible_[chunks_[i].begin],
+                 chunks_[i].num_visible * sizeof(mat4));
+    num_visible += chunks_[i].num_visible;
+  }
+  return num_visible;
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
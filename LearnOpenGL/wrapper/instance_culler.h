@@ -0,0 +1,64 @@
+#ifndef WRAPPER_OPENGL_INSTANCE_CULLER_H
+#define WRAPPER_OPENGL_INSTANCE_CULLER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+namespace wrapper {
+namespace opengl {
+
+// frustum culling of many instances of the same mesh. each instance is bound
+// by a sphere derived from the mesh bounds and its model matrix. spheres are
+// tested in batches with SSE or AVX (if enabled at compile time), and large
+// sets are split into chunks tested on worker threads
+class InstanceCuller {
+ public:
+  // num_threads includes calling thread. 0 means one per hardware thread
+  InstanceCuller(const AABB& mesh_bounds,
+                 const std::vector<glm::mat4>& instances,
+                 int num_threads = 0);
+  InstanceCuller(const InstanceCuller&) = delete;
+  InstanceCuller& operator=(const InstanceCuller&) = delete;
+  ~InstanceCuller();
+
+  // returns number of instances that may be visible. their model matrices
+  // are then available from visible(), in original order
+  size_t Cull(const Frustum& frustum);
+  const glm::mat4* visible() const { return visible_.data(); }
+  size_t num_instances() const { return instances_.size(); }
+
+ private:
+  struct Chunk {
+    size_t begin, end;
+    size_t num_visible;
+  };
+
+  std::vector<glm::mat4> instances_;
+  // bounding spheres in structure of arrays, padded to a multiple of batch
+  std::vector<float> center_x_, center_y_, center_z_, radius_;
+  std::vector<glm::mat4> visible_;  // same size as instances_
+  std::vector<Chunk> chunks_;
+  glm::vec4 planes_[6];
+
+  // workers process chunks_[1..], calling thread processes chunks_[0]
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_cv_, done_cv_;
+  unsigned generation_;
+  int num_pending_;
+  bool stopping_;
+
+  void CullChunk(Chunk* chunk);
+  void WorkerLoop(size_t chunk_index);
+};
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_INSTANCE_CULLER_H */
@@ -0,0 +1,279 @@
+#include "light_clusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using glm::mat4;
+using glm::vec2;
+using glm::vec3;
+using glm::vec4;
+using std::vector;
+
+namespace wrapper {
+namespace opengl {
+namespace {
+
+// lights fade to zero where color times attenuation falls below this
+const float kCutoff{1.0f / 256.0f};
+// below this many lights, waking threads costs more than it saves
+const size_t kMinLightsForWorkers{64};
+const int kTilesPerSlice{kClusterTilesX * kClusterTilesY};
+
+// first and last tile along one axis that a sphere at (x, z) in view space
+// may touch. tile i spans [a_i, a_{i+1}] in NDC, and a point is on the
+// positive side of a_i if scale * x + a_i * z >= 0, since z is negative in
+// front of the camera. returns false if the sphere misses all tiles
+bool TileRange(float x, float z, float radius, float scale, int num_tiles,
+               int* first, int* last) {
+  auto boundary = [num_tiles](int i) { return -1.0f + 2.0f * i / num_tiles; };
+  auto distance = [&](int i) {
+    float a = boundary(i);
+    return (scale * x + a * z) / std::sqrt(scale * scale + a * a);
+  };
+  *first = 0;
+  while (*first < num_tiles && -distance(*first + 1) < -radius)
+    ++*first;
+  *last = num_tiles - 1;
+  while (*last >= 0 && distance(*last) < -radius)
+    --*last;
+  return *first <= *last;
+}
+
+} /* namespace */
+
+LightClusters::LightClusters(StreamBuffer* stream, int num_threads)
+    : stream_{stream}, light_base_{0}, index_base_{0},
+      tile_scale_{0.0f}, depth_scale_{0.0f}, stats_{0, 0, 0, 0},
+      generation_{0}, num_pending_{0}, stopping_{false} {
+  // both views read the same stream buffer, at bases set every frame
+  glGenTextures(1, &light_texture_);
+  glBindTexture(GL_TEXTURE_BUFFER, light_texture_);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, stream_->buffer());
+  glGenTextures(1, &index_texture_);
+  glBindTexture(GL_TEXTURE_BUFFER, index_texture_);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, stream_->buffer());
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+  if (num_threads <= 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  int num_chunks = std::min(num_threads, kClusterSlices);
+  for (int i = 0; i < num_chunks; ++i) {
+    chunks_.emplace_back(Chunk{kClusterSlices * i / num_chunks,
+                               kClusterSlices * (i + 1) / num_chunks, {}, {}});
+  }
+  for (size_t i = 1; i < chunks_.size(); ++i)
+    workers_.emplace_back(&LightClusters::WorkerLoop, this, i);
+}
+
+LightClusters::~LightClusters() {
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    stopping_ = true;
+  }
+  start_cv_.notify_all();
+  for (auto& worker : workers_)
+    worker.join();
+  glDeleteTextures(1, &light_texture_);
+  glDeleteTextures(1, &index_texture_);
+}
+
+GLsizeiptr LightClusters::MaxUploadSize() {
+  // plus padding for alignment of each upload
+  return kMaxClusterLights * 2 * sizeof(vec4) +
+         (2 * kNumClusters + kMaxClusterIndices) * sizeof(uint32_t) +
+         2 * sizeof(vec4);
+}
+
+float LightClusters::Range(const vec3& color, const vec3& attenuation) {
+  // solve quadratic * d^2 + linear * d + constant = intensity / cutoff
+  float intensity = std::max(color.x, std::max(color.y, color.z));
+  float c = attenuation.x - intensity / kCutoff;
+  if (c >= 0.0f) return 0.0f;
+  if (attenuation.z > 0.0f) {
+    float b = attenuation.y, a = attenuation.z;
+    return (-b + std::sqrt(b * b - 4.0f * a * c)) / (2.0f * a);
+  }
+  if (attenuation.y > 0.0f) return -c / attenuation.y;
+  return std::numeric_limits<float>::max();
+}
+
+void LightClusters::AssignChunk(Chunk* chunk) {
+  const int first_cluster = chunk->begin_slice * kTilesPerSlice;
+  const int num_clusters =
+      (chunk->end_slice - chunk->begin_slice) * kTilesPerSlice;
+  vector<uint32_t>& grid = chunk->grid;
+  grid.assign(2 * num_clusters, 0);
+
+  // count first, so that indices can be written in place after
+  auto for_each_cluster = [&](const LightBounds& bounds, auto func) {
+    int z0 = std::max(bounds.z0, chunk->begin_slice);
+    int z1 = std::min(bounds.z1, chunk->end_slice - 1);
+    for (int z = z0; z <= z1; ++z) {
+      for (int y = bounds.y0; y <= bounds.y1; ++y) {
+        int row = z * kTilesPerSlice + y * kClusterTilesX - first_cluster;
+        for (int x = bounds.x0; x <= bounds.x1; ++x)
+          func(row + x);
+      }
+    }
+  };
+  for (const auto& bounds : bounds_)
+    for_each_cluster(bounds, [&](int cluster) { ++grid[2 * cluster + 1]; });
+  uint32_t offset = 0;
+  for (int i = 0; i < num_clusters; ++i) {
+    grid[2 * i] = offset;
+    offset += grid[2 * i + 1];
+    grid[2 * i + 1] = 0;
+  }
+  chunk->indices.resize(offset);
+  for (uint32_t light = 0; light < bounds_.size(); ++light) {
+    for_each_cluster(bounds_[light], [&](int cluster) {
+      chunk->indices[grid[2 * cluster] + grid[2 * cluster + 1]++] = light;
+    });
+  }
+}
+
+void LightClusters::WorkerLoop(size_t chunk_index) {
+  unsigned seen_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock{mutex_};
+      start_cv_.wait(lock, [&]() {
+        return stopping_ || generation_ != seen_generation;
+      });
+      if (stopping_) return;
+      seen_generation = generation_;
+    }
+    AssignChunk(&chunks_[chunk_index]);
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      --num_pending_;
+    }
+    done_cv_.notify_one();
+  }
+}
+
+void LightClusters::Update(const mat4& view,
+                           const mat4& projection,
+                           int width, int height,
+                           const vector<PointLight>& lights) {
+  // recover near and far planes from a perspective projection
+  const float near = projection[3][2] / (projection[2][2] - 1.0f);
+  const float far = projection[3][2] / (projection[2][2] + 1.0f);
+  const float slice_scale = kClusterSlices / std::log(far / near);
+  depth_scale_ = vec2{slice_scale, -std::log(near) * slice_scale};
+  tile_scale_ = vec2{static_cast<float>(kClusterTilesX) / width,
+                     static_cast<float>(kClusterTilesY) / height};
+  auto slice_of = [&](float depth) {
+    int slice = static_cast<int>(std::log(depth) * depth_scale_.x +
+                                 depth_scale_.y);
+    return std::max(0, std::min(slice, kClusterSlices - 1));
+  };
+
+  const size_t num_lights =
+      std::min(lights.size(), static_cast<size_t>(kMaxClusterLights));
+  bounds_.clear();
+  light_data_.clear();
+  for (size_t i = 0; i < num_lights; ++i) {
+    const PointLight& light = lights[i];
+    vec3 center = vec3{view * vec4{light.position, 1.0f}};
+    float range = light.range;
+    light_data_.emplace_back(center, range);
+    light_data_.emplace_back(light.color,
+                             static_cast<float>(light.shadow_map));
+
+    LightBounds bounds{0, -1, 0, -1, 0, -1};  // empty
+    float depth = -center.z;
+    if (range > 0.0f && depth + range >= near && depth - range <= far &&
+        TileRange(center.x, center.z, range, projection[0][0],
+                  kClusterTilesX, &bounds.x0, &bounds.x1) &&
+        TileRange(center.y, center.z, range, projection[1][1],
+                  kClusterTilesY, &bounds.y0, &bounds.y1)) {
+      bounds.z0 = slice_of(std::max(depth - range, near));
+      bounds.z1 = slice_of(std::min(depth + range, far));
+    }
+    bounds_.emplace_back(bounds);
+  }
+
+  const bool use_workers = !workers_.empty() &&
+                           bounds_.size() >= kMinLightsForWorkers;
+  if (use_workers) {
+    {
+      std::lock_guard<std::mutex> lock{mutex_};
+      ++generation_;
+      num_pending_ = static_cast<int>(workers_.size());
+    }
+    start_cv_.notify_all();
+    AssignChunk(&chunks_[0]);
+    std::unique_lock<std::mutex> lock{mutex_};
+    done_cv_.wait(lock, [this]() { return num_pending_ == 0; });
+  } else {
+    for (auto& chunk : chunks_)
+      AssignChunk(&chunk);
+  }
+
+  // chunks are in order of slices, so offsets are made global by adding
+  // sizes of previous chunks. indices over the limit are cut off
+  const uint32_t max_indices = kMaxClusterIndices;
+  stats_ = Stats{static_cast<int>(num_lights), 0, 0, 0};
+  upload_.assign(2 * kNumClusters, 0);
+  uint32_t base = 0;
+  for (const auto& chunk : chunks_) {
+    const int first_cluster = chunk.begin_slice * kTilesPerSlice;
+    for (size_t i = 0; 2 * i < chunk.grid.size(); ++i) {
+      uint32_t offset = base + chunk.grid[2 * i];
+      uint32_t count = chunk.grid[2 * i + 1];
+      uint32_t kept = offset >= max_indices ? 0 :
+                      std::min(count, max_indices - offset);
+      upload_[2 * (first_cluster + i)] = offset;
+      upload_[2 * (first_cluster + i) + 1] = kept;
+      stats_.num_dropped += count - kept;
+      stats_.max_lights_per_cluster =
+          std::max(stats_.max_lights_per_cluster, static_cast<int>(kept));
+    }
+    size_t num_kept = std::min<size_t>(
+        chunk.indices.size(), max_indices - std::min(base, max_indices));
+    upload_.insert(upload_.end(), chunk.indices.begin(),
+                   chunk.indices.begin() + num_kept);
+    base += chunk.indices.size();
+  }
+  stats_.num_indices = static_cast<int>(upload_.size() - 2 * kNumClusters);
+
+  if (!light_data_.empty()) {
+    light_base_ = stream_->Upload(light_data_.data(),
+                                  light_data_.size() * sizeof(vec4),
+                                  sizeof(vec4)) / sizeof(vec4);
+  }
+  index_base_ = stream_->Upload(upload_.data(),
+                                upload_.size() * sizeof(uint32_t),
+                                sizeof(uint32_t)) / sizeof(uint32_t);
+}
+
+LightClusters::Uniforms LightClusters::GetUniforms(const Shader& shader) {
+  return Uniforms{
+      shader.get_handle<int>("clusterLights"),
+      shader.get_handle<int>("clusterIndices"),
+      shader.get_handle<int>("clusterLightBase"),
+      shader.get_handle<int>("clusterIndexBase"),
+      shader.get_handle<vec2>("clusterTileScale"),
+      shader.get_handle<vec2>("clusterDepthScale"),
+  };
+}
+
+void LightClusters::Bind(const Shader& shader,
+                         const Uniforms& uniforms,
+                         GLuint tex_unit) const {
+  glActiveTexture(GL_TEXTURE0 + tex_unit);
+  glBindTexture(GL_TEXTURE_BUFFER, light_texture_);
+  glActiveTexture(GL_TEXTURE0 + tex_unit + 1);
+  glBindTexture(GL_TEXTURE_BUFFER, index_texture_);
+  shader.set(uniforms.lights, static_cast<int>(tex_unit));
+  shader.set(uniforms.indices, static_cast<int>(tex_unit + 1));
+  shader.set(uniforms.light_base, static_cast<int>(light_base_));
+  shader.set(uniforms.index_base, static_cast<int>(index_base_));
+  shader.set(uniforms.tile_scale, tile_scale_);
+  shader.set(uniforms.depth_scale, depth_scale_);
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
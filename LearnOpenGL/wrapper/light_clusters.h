@@ -0,0 +1,129 @@
+#ifndef WRAPPER_OPENGL_LIGHT_CLUSTERS_H
+#define WRAPPER_OPENGL_LIGHT_CLUSTERS_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "stream_buffer.h"
+
+namespace wrapper {
+namespace opengl {
+
+struct PointLight {
+  glm::vec3 position;  // world space
+  glm::vec3 color;
+  float range;         // contribution is faded to zero here
+  int shadow_map;      // index of shadow map, -1 if unshadowed
+};
+
+// clustered forward shading (Olsson et al. 2012). the view frustum is split
+// into kClusterTilesX * kClusterTilesY tiles on screen and kClusterSlices
+// slices along depth, which get exponentially thicker so that clusters stay
+// roughly cubic. every frame, lights are assigned to clusters that their
+// spheres of influence touch, on worker threads that each own a range of
+// slices, and lists are uploaded to a stream buffer. fragments then only
+// loop over lights of their own cluster. in shaders:
+//     uniform samplerBuffer clusterLights;    // 2 texels per light
+//     uniform usamplerBuffer clusterIndices;  // (offset, count) per cluster,
+//                                             // then light indices
+//     uniform int clusterLightBase, clusterIndexBase;  // first texels
+//     uniform vec2 clusterTileScale;    // tiles per pixel
+//     uniform vec2 clusterDepthScale;   // slice = log(depth) * x + y
+// a light texel pair is (position in view space, range) and (color, shadow
+// map). its contribution must be faded to zero at range
+const int kClusterTilesX{16};
+const int kClusterTilesY{8};
+const int kClusterSlices{24};
+const int kNumClusters{kClusterTilesX * kClusterTilesY * kClusterSlices};
+// at most this many lights are uploaded per frame, and at most this many
+// indices. beyond that, clusters of furthest slices lose lights first
+const int kMaxClusterLights{1024};
+const int kMaxClusterIndices{32768};
+
+class LightClusters {
+ public:
+  struct Stats {
+    int num_lights;
+    int num_indices;
+    int num_dropped;  // indices over kMaxClusterIndices
+    int max_lights_per_cluster;
+  };
+  struct Uniforms {
+    UniformHandle<int> lights, indices, light_base, index_base;
+    UniformHandle<glm::vec2> tile_scale, depth_scale;
+  };
+
+  // stream must outlive this object, and have room for MaxUploadSize() per
+  // frame. num_threads includes calling thread. 0 means one per hardware
+  // thread
+  explicit LightClusters(StreamBuffer* stream, int num_threads = 0);
+  LightClusters(const LightClusters&) = delete;
+  LightClusters& operator=(const LightClusters&) = delete;
+  ~LightClusters();
+
+  static GLsizeiptr MaxUploadSize();
+  // distance where a light, whose attenuation is 1 / (constant + linear * d
+  // + quadratic * d^2), falls below a cutoff. a light given this range looks
+  // the same as if it had none
+  static float Range(const glm::vec3& color, const glm::vec3& attenuation);
+
+  // assigns lights to clusters of the frustum of view and projection (which
+  // must be perspective), with a framebuffer of width and height, and
+  // uploads the result
+  void Update(const glm::mat4& view,
+              const glm::mat4& projection,
+              int width, int height,
+              const std::vector<PointLight>& lights);
+  // throws if shader does not sample clusters
+  static Uniforms GetUniforms(const Shader& shader);
+  // binds buffer textures to units tex_unit and tex_unit + 1. shader must be
+  // in use
+  void Bind(const Shader& shader,
+            const Uniforms& uniforms,
+            GLuint tex_unit) const;
+  const Stats& stats() const { return stats_; }
+
+ private:
+  // cluster ranges touched by a light, inclusive
+  struct LightBounds {
+    int x0, x1, y0, y1, z0, z1;
+  };
+  struct Chunk {
+    int begin_slice, end_slice;
+    std::vector<uint32_t> grid;     // (offset, count) per cluster of chunk
+    std::vector<uint32_t> indices;  // offsets are relative to chunk
+  };
+
+  StreamBuffer* stream_;
+  GLuint light_texture_, index_texture_;
+  GLintptr light_base_, index_base_;
+  glm::vec2 tile_scale_, depth_scale_;
+  std::vector<LightBounds> bounds_;
+  std::vector<glm::vec4> light_data_;
+  std::vector<uint32_t> upload_;
+  std::vector<Chunk> chunks_;
+  Stats stats_;
+
+  // workers process chunks_[1..], calling thread processes chunks_[0]
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_cv_, done_cv_;
+  unsigned generation_;
+  int num_pending_;
+  bool stopping_;
+
+  void AssignChunk(Chunk* chunk);
+  void WorkerLoop(size_t chunk_index);
+};
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_LIGHT_CLUSTERS_H */
@@ -7,79 +7,51 @@
 
 #include "loader.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
 #include <unordered_map>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <image/stb_image.h>
-#include <ft2build.h>
-#include FT_FREETYPE_H
 
+#include "mapped_file.h"
+#include "texture_format.h"
+
+using std::function;
 using std::vector;
 using std::runtime_error;
 using std::string;
 using std::unordered_map;
-using glm::vec2;
 
 namespace wrapper {
 namespace opengl {
 namespace loader {
 namespace {
 
-unordered_map<char, Character> LoadCharLib() {
-  unordered_map<char, Character> loaded_chars{};
-
-  FT_Library lib;
-  if (FT_Init_FreeType(&lib))
-    throw runtime_error{"Failed to init FreeType library"};
-
-  FT_Face face;
-  if (FT_New_Face(lib, "/Users/lun/Desktop/Code/LearnOpenGL/LearnOpenGL/texture/georgia.ttf", 0, &face))
-    throw runtime_error{"Failed to load font"};
-
-  FT_Set_Pixel_Sizes(face, 0, 48);  // set width to 0 for auto adjustment
-
-  // disable byte-alignment for texture storage
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  for (int c = 0; c < 128; ++c) {
-    if (FT_Load_Char(face, c, FT_LOAD_RENDER))
-      throw runtime_error{"Failed to load glyph"};
-
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, face->glyph->bitmap.width,
-                 face->glyph->bitmap.rows, 0, GL_RED, GL_UNSIGNED_BYTE,
-                 face->glyph->bitmap.buffer);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    Character ch{
-        texture,
-        vec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-        vec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-        // advance is number of 1/64 pixels
-        (GLuint) face->glyph->advance.x >> 6,
-    };
-    loaded_chars.insert({c, ch});
-  }
-  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-
-  FT_Done_Face(face);
-  FT_Done_FreeType(lib);
+struct Image {
+  stbi_uc* data;
+  int width, height, channel;
+};
 
-  return loaded_chars;
+Image DecodeImage(const string& path) {
+  Image image;
+  image.data = stbi_load(path.c_str(), &image.width, &image.height,
+                         &image.channel, 0);
+  if (!image.data) throw runtime_error{"Failed to load texture from " + path};
+  return image;
 }
 
-void LoadImage(const string& path,
-               GLenum target,
-               bool gamma_correction) {
-  int width, height, channel;
-  stbi_uc* data = stbi_load(path.c_str(), &width, &height, &channel, 0);
-  if (!data) throw runtime_error{"Failed to load texture from " + path};
-
+void UploadImage(const Image& image,
+                 GLenum target,
+                 bool gamma_correction) {
   GLenum internal_format, format;
-  switch (channel) {
+  switch (image.channel) {
     case 1:
       internal_format = format = GL_RED;
       break;
@@ -93,59 +65,282 @@ void LoadImage(const string& path,
       break;
     default:
       throw runtime_error{"Unknown texture format \
-          (channel=" + std::to_string(channel) + ")"};
+          (channel=" + std::to_string(image.channel) + ")"};
   }
   // texture target, minmap level, texture format, width, height, always 0,
   //           image format, dtype, data
-  glTexImage2D(target, 0, internal_format, width, height, 0,
-               format, GL_UNSIGNED_BYTE, data);
+  glTexImage2D(target, 0, internal_format, image.width, image.height, 0,
+               format, GL_UNSIGNED_BYTE, image.data);
+}
+
+// decodes images in parallel on worker threads, and calls on_decoded on the
+// calling thread in the order that images finish decoding, so that uploading
+// overlaps with decoding of remaining images
+void DecodeImages(const vector<string>& paths,
+                  const function<void (size_t, const Image&)>& on_decoded) {
+  size_t num_threads = std::min<size_t>(
+      std::max(std::thread::hardware_concurrency(), 1u), paths.size());
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < paths.size(); ++i) {
+      Image image = DecodeImage(paths[i]);
+      try {
+        on_decoded(i, image);
+      } catch (...) {
+        stbi_image_free(image.data);
+        throw;
+      }
+      stbi_image_free(image.data);
+    }
+    return;
+  }
 
-  stbi_image_free(data);
+  vector<Image> images(paths.size(), Image{nullptr, 0, 0, 0});
+  vector<string> errors(paths.size());
+  std::atomic<size_t> next_index{0};
+  std::mutex mutex;
+  std::condition_variable decoded_cv;
+  std::queue<size_t> decoded;
+
+  auto worker = [&]() {
+    for (size_t i = next_index++; i < paths.size(); i = next_index++) {
+      try {
+        images[i] = DecodeImage(paths[i]);
+      } catch (const std::exception& e) {
+        errors[i] = e.what();
+      }
+      std::lock_guard<std::mutex> lock{mutex};
+      decoded.push(i);
+      decoded_cv.notify_one();
+    }
+  };
+
+  vector<std::thread> threads;
+  for (size_t i = 0; i < num_threads; ++i)
+    threads.emplace_back(worker);
+
+  string error;
+  for (size_t count = 0; count < paths.size(); ++count) {
+    size_t index;
+    {
+      std::unique_lock<std::mutex> lock{mutex};
+      decoded_cv.wait(lock, [&decoded]() { return !decoded.empty(); });
+      index = decoded.front();
+      decoded.pop();
+    }
+    // keep consuming after an error, so that all images get freed and all
+    // threads get joined before throwing
+    if (error.empty()) error = errors[index];
+    if (images[index].data) {
+      if (error.empty()) {
+        try {
+          on_decoded(index, images[index]);
+        } catch (const std::exception& e) {
+          error = e.what();
+        }
+      }
+      stbi_image_free(images[index].data);
+    }
+  }
+
+  for (auto& thread : threads)
+    thread.join();
+  if (!error.empty()) throw runtime_error{error};
 }
 
-} /* namespace */
+bool HasExtension(const char* name) {
+  GLint num_extensions;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+  for (GLint i = 0; i < num_extensions; ++i) {
+    const char* extension = reinterpret_cast<const char*>(
+        glGetStringi(GL_EXTENSIONS, i));
+    if (std::strcmp(extension, name) == 0) return true;
+  }
+  return false;
+}
+
+// returns 0 if the cooked file does not exist, is older than any of its
+// sources, does not match the request, or cannot be used by this driver
+GLuint LoadCookedTexture(const string& cooked_path,
+                         const vector<string>& source_paths,
+                         GLenum target,
+                         uint32_t num_faces,
+                         bool gamma_correction) {
+  namespace format = texture_format;
+  uint64_t cooked_mtime, source_mtime, size;
+  if (!MappedFile::Stat(cooked_path, &cooked_mtime, &size)) return 0;
+  for (const auto& path : source_paths) {
+    if (MappedFile::Stat(path, &source_mtime, &size) &&
+        source_mtime > cooked_mtime) return 0;
+  }
+
+  auto file = MappedFile::Open(cooked_path);
+  if (!file || !file->InRange(0, sizeof(format::Header))) return 0;
+  const auto* header = reinterpret_cast<const format::Header*>(file->data());
+  const size_t num_entries = header->num_faces * header->num_levels;
+  if (std::memcmp(header->magic, format::kMagic, sizeof(format::kMagic)) ||
+      header->version != format::kVersion ||
+      header->num_faces != num_faces || header->num_levels == 0 ||
+      (header->srgb != 0) != gamma_correction ||
+      !file->InRange(sizeof(format::Header),
+                     num_entries * sizeof(format::Level)))
+    return 0;
 
-const Character& LoadCharacter(char character) {
-  static unordered_map<char, Character> kLoadedCharacter{};
-  if (kLoadedCharacter.empty())
-    kLoadedCharacter = LoadCharLib();
-  return kLoadedCharacter[character];
+  static const bool kSupportS3tc =
+      HasExtension("GL_EXT_texture_compression_s3tc");
+  if (header->compressed && !kSupportS3tc) return 0;
+
+  const auto* levels = reinterpret_cast<const format::Level*>(
+      file->data() + sizeof(format::Header));
+  for (size_t i = 0; i < num_entries; ++i) {
+    if (!file->InRange(levels[i].offset, levels[i].size)) return 0;
+  }
+
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(target, texture);
+  // levels are tightly packed, and rows of small levels are not 4-byte aligned
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (uint32_t face = 0; face < header->num_faces; ++face) {
+    GLenum face_target = num_faces == 1 ? target :
+        static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face);
+    for (uint32_t level = 0; level < header->num_levels; ++level) {
+      const format::Level& entry = levels[face * header->num_levels + level];
+      const char* data = file->data() + entry.offset;
+      if (header->compressed) {
+        glCompressedTexImage2D(face_target, level, header->internal_format,
+                               entry.width, entry.height, 0,
+                               static_cast<GLsizei>(entry.size), data);
+      } else {
+        glTexImage2D(face_target, level, header->internal_format,
+                     entry.width, entry.height, 0,
+                     header->format, GL_UNSIGNED_BYTE, data);
+      }
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, header->num_levels - 1);
+  return texture;
+}
+
+void SetTexture2DParameters() {
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 }
 
+std::mutex kLoadedTextureMutex;
+unordered_map<string, GLuint> kLoadedTexture{};
+
+GLuint CacheTexture(const string& path, GLuint texture) {
+  std::lock_guard<std::mutex> lock{kLoadedTextureMutex};
+  auto inserted = kLoadedTexture.insert({path, texture});
+  if (!inserted.second) glDeleteTextures(1, &texture);  // loaded elsewhere
+  return inserted.first->second;
+}
+
+} /* namespace */
+
 GLuint LoadTexture(const string& path, bool gamma_correction) {
-  static unordered_map<string, GLuint> kLoadedTexture{};
-  auto loaded = kLoadedTexture.find(path);
-  if (loaded == kLoadedTexture.end()) {
+  return LoadTextures({TextureRequest{path, gamma_correction}})[0];
+}
+
+vector<GLuint> LoadTextures(const vector<TextureRequest>& requests) {
+  vector<GLuint> textures(requests.size(), 0);
+
+  // find textures not loaded yet, and only load each of them once
+  vector<string> paths;
+  vector<bool> gamma_corrections;
+  unordered_map<string, size_t> path_indices;
+  {
+    std::lock_guard<std::mutex> lock{kLoadedTextureMutex};
+    for (size_t i = 0; i < requests.size(); ++i) {
+      auto loaded = kLoadedTexture.find(requests[i].path);
+      if (loaded != kLoadedTexture.end()) {
+        textures[i] = loaded->second;
+      } else if (path_indices.insert({requests[i].path, paths.size()}).second) {
+        paths.emplace_back(requests[i].path);
+        gamma_corrections.emplace_back(requests[i].gamma_correction);
+      }
+    }
+  }
+  if (paths.empty()) return textures;
+
+  // prefer cooked textures, which need neither decoding nor mipmap generation
+  vector<GLuint> uploaded(paths.size(), 0);
+  vector<string> decode_paths;
+  vector<size_t> decode_indices;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    GLuint texture = LoadCookedTexture(
+        paths[i] + texture_format::kExtension, {paths[i]},
+        GL_TEXTURE_2D, 1, gamma_corrections[i]);
+    if (texture != 0) {
+      SetTexture2DParameters();
+      glBindTexture(GL_TEXTURE_2D, 0);
+      uploaded[i] = CacheTexture(paths[i], texture);
+    } else {
+      decode_paths.emplace_back(paths[i]);
+      decode_indices.emplace_back(i);
+    }
+  }
+
+  DecodeImages(decode_paths, [&](size_t decode_index, const Image& image) {
+    size_t index = decode_indices[decode_index];
     GLuint texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
-    LoadImage(path, GL_TEXTURE_2D, gamma_correction);
+    UploadImage(image, GL_TEXTURE_2D, gamma_corrections[index]);
 
     // automatically generate all required minmaps
     glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    SetTexture2DParameters();
     glBindTexture(GL_TEXTURE_2D, 0);
+    uploaded[index] = CacheTexture(paths[index], texture);
+  });
+
+  for (size_t i = 0; i < requests.size(); ++i) {
+    if (textures[i] == 0)
+      textures[i] = uploaded[path_indices[requests[i].path]];
+  }
+  return textures;
+}
 
-    loaded = kLoadedTexture.insert({path, texture}).first;
+void ReleaseTextures(const vector<GLuint>& textures) {
+  if (textures.empty()) return;
+  {
+    std::lock_guard<std::mutex> lock{kLoadedTextureMutex};
+    for (auto it = kLoadedTexture.begin(); it != kLoadedTexture.end();) {
+      if (std::find(textures.begin(), textures.end(), it->second) !=
+          textures.end())
+        it = kLoadedTexture.erase(it);
+      else
+        ++it;
+    }
   }
-  return loaded->second;
+  glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
 }
 
 GLuint LoadCubemap(const string& directory,
                    const vector<string>& filenames,
                    const bool gamma_correction) {
-  GLuint texture;
-  glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+  vector<string> filepaths;
+  for (const auto& filename : filenames)
+    filepaths.emplace_back(directory + '/' + filename);
 
-  for (size_t i = 0; i < filenames.size(); ++i) {
-    string filepath = directory + '/' + filenames[i];
-    LoadImage(filepath, static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i),
-              gamma_correction);
+  GLuint texture = LoadCookedTexture(
+      directory + texture_format::kExtension, filepaths,
+      GL_TEXTURE_CUBE_MAP, static_cast<uint32_t>(filenames.size()),
+      gamma_correction);
+  if (texture == 0) {
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+    DecodeImages(filepaths, [gamma_correction](size_t index,
+                                               const Image& image) {
+      UploadImage(image,
+                  static_cast<GLenum>(GL_TEXTURE_CUBE_MAP_POSITIVE_X + index),
+                  gamma_correction);
+    });
   }
 
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -18,15 +18,19 @@ namespace wrapper {
 namespace opengl {
 namespace loader {
 
-struct Character {
-  GLuint texture;
-  glm::ivec2 size;
-  glm::ivec2 bearing;
-  GLuint advance;
+struct TextureRequest {
+  std::string path;
+  bool gamma_correction;
 };
 
-const Character& LoadCharacter(char character);
 GLuint LoadTexture(const std::string& path, bool gamma_correction);
+// images are decoded on worker threads and uploaded on the calling thread as
+// soon as each of them is decoded. returned textures are in the same order
+// as requests. must be called on the thread that owns the GL context
+std::vector<GLuint> LoadTextures(const std::vector<TextureRequest>& requests);
+// deletes textures and forgets their paths, so that later requests for those
+// paths load them again
+void ReleaseTextures(const std::vector<GLuint>& textures);
 GLuint LoadCubemap(const std::string& directory,
                    const std::vector<std::string>& filenames,
                    bool gamma_correction);
@@ -0,0 +1,43 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::string;
+using std::unique_ptr;
+
+namespace wrapper {
+namespace opengl {
+
+unique_ptr<MappedFile> MappedFile::Open(const string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return nullptr;
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close(fd);
+    return nullptr;
+  }
+  size_t size = static_cast<size_t>(info.st_size);
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);  // mapping stays valid after closing
+  if (data == MAP_FAILED) return nullptr;
+  return unique_ptr<MappedFile>{
+      new MappedFile{static_cast<const char*>(data), size}};
+}
+
+bool MappedFile::Stat(const string& path, uint64_t* mtime, uint64_t* size) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) return false;
+  *mtime = static_cast<uint64_t>(info.st_mtime);
+  *size = static_cast<uint64_t>(info.st_size);
+  return true;
+}
+
+MappedFile::~MappedFile() {
+  munmap(const_cast<char*>(data_), size_);
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
@@ -0,0 +1,39 @@
+#ifndef WRAPPER_OPENGL_MAPPED_FILE_H
+#define WRAPPER_OPENGL_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace wrapper {
+namespace opengl {
+
+// read-only memory mapping of a whole file
+class MappedFile {
+ public:
+  // returns nullptr if file does not exist or cannot be mapped
+  static std::unique_ptr<MappedFile> Open(const std::string& path);
+  // returns false if file does not exist
+  static bool Stat(const std::string& path, uint64_t* mtime, uint64_t* size);
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  // whether [offset, offset + length) lies within the file
+  bool InRange(uint64_t offset, uint64_t length) const {
+    return offset <= size_ && length <= size_ - offset;
+  }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const char* data_;
+  size_t size_;
+  MappedFile(const char* data, size_t size) : data_{data}, size_{size} {}
+};
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_MAPPED_FILE_H */
@@ -0,0 +1,224 @@
+#include "material.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+using glm::vec3;
+using std::vector;
+
+namespace wrapper {
+namespace opengl {
+namespace {
+
+const char* const kSamplerNames[kNumMaterialSlots]{
+    "material.diffuse", "material.specular", "material.reflection",
+};
+const char kLayersName[]{"material.layers"};
+
+// textures are only packed together if all of these match
+struct Format {
+  GLint width, height;
+  GLint internal_format;
+  GLint compressed;
+  GLint num_levels;
+
+  bool operator<(const Format& other) const {
+    return std::tie(width, height, internal_format, compressed, num_levels) <
+           std::tie(other.width, other.height, other.internal_format,
+                    other.compressed, other.num_levels);
+  }
+};
+
+Format QueryFormat(GLuint texture) {
+  Format format;
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &format.width);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT,
+                           &format.height);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT,
+                           &format.internal_format);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED,
+                           &format.compressed);
+  // cooked textures set max level, and others have mipmaps generated down
+  // to 1x1
+  GLint max_level;
+  glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &max_level);
+  int full_levels = 1 + static_cast<int>(
+      std::log2(std::max(format.width, format.height)));
+  format.num_levels = std::min(full_levels, max_level + 1);
+  return format;
+}
+
+// uncompressed levels are read back as RGBA8, which converts from whatever
+// channels they have, and written back to the internal format of array
+GLint LevelSize(const Format& format, GLint level) {
+  if (format.compressed) {
+    GLint size;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, level,
+                             GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+    return size;
+  }
+  return std::max(1, format.width >> level) *
+         std::max(1, format.height >> level) * 4;
+}
+
+// creates an array for textures, which must all have format. data is copied
+// through a pixel buffer, so that it never leaves GPU
+GLuint PackTextures(const vector<GLuint>& textures, const Format& format) {
+  const GLsizei num_layers = static_cast<GLsizei>(textures.size());
+  GLuint array;
+  glGenTextures(1, &array);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+  glBindTexture(GL_TEXTURE_2D, textures[0]);
+  for (GLint level = 0; level < format.num_levels; ++level) {
+    GLsizei width = std::max(1, format.width >> level);
+    GLsizei height = std::max(1, format.height >> level);
+    if (format.compressed) {
+      glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level,
+                             format.internal_format, width, height,
+                             num_layers, 0,
+                             LevelSize(format, level) * num_layers, NULL);
+    } else {
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, level, format.internal_format,
+                   width, height, num_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                   NULL);
+    }
+  }
+
+  GLuint buffer;
+  glGenBuffers(1, &buffer);
+  for (GLint layer = 0; layer < num_layers; ++layer) {
+    glBindTexture(GL_TEXTURE_2D, textures[layer]);
+    for (GLint level = 0; level < format.num_levels; ++level) {
+      GLsizei width = std::max(1, format.width >> level);
+      GLsizei height = std::max(1, format.height >> level);
+      GLint size = LevelSize(format, level);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+      glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_COPY);
+      if (format.compressed) {
+        glGetCompressedTexImage(GL_TEXTURE_2D, level, 0);
+      } else {
+        glGetTexImage(GL_TEXTURE_2D, level, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+      }
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+      if (format.compressed) {
+        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+                                  width, height, 1, format.internal_format,
+                                  size, 0);
+      } else {
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+                        width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+      }
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+  }
+  glDeleteBuffers(1, &buffer);
+
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL,
+                  format.num_levels - 1);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return array;
+}
+
+} /* namespace */
+
+Material::Material() {
+  for (auto& slot : slots_)
+    slot = TextureLayer{0, 0};
+}
+
+Material::Material(const TextureLayer (&slots)[kNumMaterialSlots]) {
+  for (int i = 0; i < kNumMaterialSlots; ++i)
+    slots_[i] = slots[i];
+}
+
+void Material::SetSamplers(const Shader& shader, GLuint tex_offset) {
+  for (int i = 0; i < kNumMaterialSlots; ++i) {
+    if (shader.has_uniform(kSamplerNames[i]))
+      shader.set_int(kSamplerNames[i], tex_offset + i);
+  }
+}
+
+UniformHandle<vec3> Material::GetLayersHandle(const Shader& shader) {
+  return shader.has_uniform(kLayersName) ?
+      shader.get_handle<vec3>(kLayersName) : UniformHandle<vec3>{};
+}
+
+int Material::Bind(const Shader& shader,
+                   UniformHandle<vec3> layers,
+                   GLuint tex_offset,
+                   const Material* previous) const {
+  if (empty()) return 0;
+  int num_binds = 0;
+  for (int i = 0; i < kNumMaterialSlots; ++i) {
+    // slots without texture are unbound, so that they read black rather
+    // than textures of previous material
+    if (previous && previous->slots_[i].array == slots_[i].array) continue;
+    glActiveTexture(GL_TEXTURE0 + tex_offset + i);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, slots_[i].array);
+    ++num_binds;
+  }
+  if (layers.valid()) {
+    shader.set(layers, vec3{slots_[0].layer, slots_[1].layer,
+                            slots_[2].layer});
+  }
+  return num_binds;
+}
+
+void Material::Bind(const Shader& shader, GLuint tex_offset) const {
+  if (empty()) return;
+  SetSamplers(shader, tex_offset);
+  Bind(shader, GetLayersHandle(shader), tex_offset, nullptr);
+}
+
+bool Material::empty() const {
+  return std::all_of(std::begin(slots_), std::end(slots_),
+                     [](const TextureLayer& slot) { return slot.array == 0; });
+}
+
+vector<Material> BuildMaterials(const vector<vector<Texture>>& texture_lists) {
+  // group distinct textures by format, keeping order of first use
+  vector<vector<GLuint>> slot_textures;
+  std::map<Format, vector<GLuint>> groups;
+  std::unordered_map<GLuint, TextureLayer> layers;
+  for (const auto& textures : texture_lists) {
+    vector<GLuint> ids(kNumMaterialSlots, 0);
+    for (const auto& texture : textures) {
+      GLuint& id = ids[static_cast<int>(texture.type)];
+      if (id == 0) id = texture.id;
+    }
+    for (GLuint id : ids) {
+      if (id != 0 && layers.insert({id, TextureLayer{0, 0}}).second)
+        groups[QueryFormat(id)].emplace_back(id);
+    }
+    slot_textures.emplace_back(std::move(ids));
+  }
+
+  for (const auto& group : groups) {
+    GLuint array = PackTextures(group.second, group.first);
+    for (size_t i = 0; i < group.second.size(); ++i)
+      layers[group.second[i]] = TextureLayer{array, static_cast<GLint>(i)};
+  }
+
+  vector<Material> materials;
+  for (const auto& ids : slot_textures) {
+    TextureLayer slots[kNumMaterialSlots];
+    for (int i = 0; i < kNumMaterialSlots; ++i)
+      slots[i] = ids[i] != 0 ? layers[ids[i]] : TextureLayer{0, 0};
+    materials.emplace_back(slots);
+  }
+  return materials;
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
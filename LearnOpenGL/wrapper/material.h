@@ -0,0 +1,84 @@
+#ifndef WRAPPER_OPENGL_MATERIAL_H
+#define WRAPPER_OPENGL_MATERIAL_H
+
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+namespace wrapper {
+namespace opengl {
+
+enum class TextureType {
+  kDiffuse, kSpecular, kReflection,
+};
+
+struct Texture {
+  GLuint id;
+  TextureType type;
+};
+
+// one slot per texture type, and slot i is always bound to unit
+// tex_offset + i
+const int kNumMaterialSlots{3};
+
+// a layer of a 2D texture array
+struct TextureLayer {
+  GLuint array;  // 0 if there is no texture
+  GLint layer;
+};
+
+// textures of a material are layers of texture arrays. in shaders, they are
+// sampled from
+//     uniform struct {
+//       sampler2DArray diffuse, specular, reflection;
+//       vec3 layers;  // in the same order
+//     } material;
+// textures with the same size, format and number of levels share an array,
+// so switching between materials whose textures are in the same arrays only
+// changes layers
+class Material {
+ public:
+  Material();
+  explicit Material(const TextureLayer (&slots)[kNumMaterialSlots]);
+
+  // points samplers of shader at units from tex_offset. since units of slots
+  // never change, this is only needed once per program. shader must be in use
+  static void SetSamplers(const Shader& shader, GLuint tex_offset);
+  // returns handle of layers, which is invalid if shader does not sample
+  // materials
+  static UniformHandle<glm::vec3> GetLayersHandle(const Shader& shader);
+
+  // binds arrays that are not already bound by previous (may be null), and
+  // sets layers if the handle is valid. returns number of arrays bound.
+  // samplers must have been set. empty materials bind nothing
+  int Bind(const Shader& shader,
+           UniformHandle<glm::vec3> layers,
+           GLuint tex_offset,
+           const Material* previous) const;
+  // slow path that also sets samplers and resolves layers by name
+  void Bind(const Shader& shader, GLuint tex_offset) const;
+
+  bool empty() const;
+  const TextureLayer& slot(TextureType type) const {
+    return slots_[static_cast<int>(type)];
+  }
+
+ private:
+  TextureLayer slots_[kNumMaterialSlots];
+};
+
+// returns a material for each list of textures. a material has one slot per
+// type, so only the first texture of each type in a list is used, and later
+// ones of the same type are ignored. textures are copied into arrays on GPU
+// and left as they are, so callers that no longer need the originals should
+// release them. must be called on the thread that owns the GL context
+std::vector<Material> BuildMaterials(
+    const std::vector<std::vector<Texture>>& texture_lists);
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_MATERIAL_H */
@@ -8,51 +8,95 @@
 #ifndef WRAPPER_OPENGL_MESH_H
 #define WRAPPER_OPENGL_MESH_H
 
+#include <algorithm>
 #include <functional>
 #include <vector>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "bounds.h"
+#include "material.h"
 #include "shader.h"
+#include "vertex_format.h"
 
 namespace wrapper {
 namespace opengl {
 
-enum class TextureType {
-  kDiffuse, kSpecular, kReflection,
+// range of index buffer that draws one level of detail. all levels of a mesh
+// share its vertices
+struct MeshLod {
+  GLsizei first_index;
+  GLsizei num_indices;
+  float error;  // see mesh_simplifier::Simplify, in model space
 };
 
-struct Texture {
-  GLuint id;
-  TextureType type;
-};
+// including full detail
+const int kMaxLods{4};
 
-struct Vertex {
-  glm::vec3 position;
-  glm::vec3 normal;
-  glm::vec2 tex_coord;
+// where a mesh is in vertex and index buffers shared by all meshes of a
+// model, which are bound to vao. indices are relative to base_vertex
+struct MeshRange {
+  GLuint vao;
+  GLint base_vertex;
+  size_t num_vertices;
+  size_t index_offset;  // in bytes
+  size_t num_indices;
+  GLenum index_type;
+  GLsizei vertex_size;
+  // see VertexLayout
+  glm::vec3 position_offset, position_scale;
 };
 
+// a range of geometry of a model with its own material. buffers are owned by
+// the model
 class Mesh {
  public:
-  Mesh(const std::vector<Vertex>& vertices,
-       const std::vector<GLuint>& indices,
-       const std::vector<Texture>& textures);
+  // bounds are computed beforehand, e.g. when importing. lods are ranges of
+  // indices relative to the mesh, finest first. if empty, all indices make
+  // up the only level
+  Mesh(const MeshRange& range,
+       const Material& material,
+       const AABB& bounds,
+       const Sphere& bounding_sphere,
+       const std::vector<MeshLod>& lods = {});
+  // lod is clamped to the coarsest level
   void Draw(const Shader& shader,
             GLuint tex_offset,
-            bool load_texture) const;
+            bool load_texture,
+            int lod = 0) const;
   void DrawInstanced(const Shader& shader,
                      GLuint amount,
                      GLuint tex_offset,
-                     bool load_texture) const;
+                     bool load_texture,
+                     int lod = 0) const;
+  // calls func with VAO bound, which is shared by all meshes of the model
   void AppendData(const std::function<void ()>& func) const;
+  const Material& material() const { return material_; }
+  size_t num_vertices() const { return range_.num_vertices; }
+  // of all levels of detail
+  size_t num_indices() const { return range_.num_indices; }
+  const MeshRange& range() const { return range_; }
+  // offset in bytes into index buffer where a level starts
+  size_t IndexOffset(int level) const;
+  int num_lods() const { return static_cast<int>(lods_.size()); }
+  const MeshLod& lod(int level) const { return lods_[ClampLod(level)]; }
+  int ClampLod(int level) const {
+    return std::max(0, std::min(level, num_lods() - 1));
+  }
+  // of vertex and index buffers
+  size_t memory_size() const { return memory_size_; }
+  // in model space
+  const AABB& bounds() const { return bounds_; }
+  const Sphere& bounding_sphere() const { return bounding_sphere_; }
 
  private:
-  GLuint vao_, vbo_, ebo_;
-  const std::vector<Vertex> vertices_;
-  const std::vector<GLuint> indices_;
-  const std::vector<Texture> textures_;
+  MeshRange range_;
+  AABB bounds_;
+  Sphere bounding_sphere_;
+  size_t memory_size_;
+  Material material_;
+  std::vector<MeshLod> lods_;
 };
 
 } /* namespace opengl */
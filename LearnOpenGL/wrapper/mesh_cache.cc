@@ -0,0 +1,263 @@
+#include "mesh_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace wrapper {
+namespace opengl {
+namespace mesh_cache {
+namespace {
+
+const char kMagic[8]{'L', 'O', 'G', 'L', 'M', 'E', 'S', 'H'};
+const uint32_t kVersion{6};
+const size_t kAlignment{16};
+const string kCacheSuffix{".meshcache"};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t vertex_size;
+  uint64_t source_mtime;
+  uint64_t source_size;
+  uint32_t num_meshes;
+  uint32_t reserved;
+};
+
+struct LodEntry {
+  uint32_t first_index;
+  uint32_t num_indices;
+  float error;
+  uint32_t reserved;
+};
+
+struct MeshEntry {
+  uint64_t texture_offset;
+  uint32_t num_textures;
+  uint32_t index_type;
+  uint64_t vertex_offset;
+  uint64_t num_vertices;
+  uint64_t index_offset;
+  uint64_t num_indices;
+  float bounds_min[3];
+  float bounds_max[3];
+  float sphere_center[3];
+  float sphere_radius;
+  float error_position;
+  float error_normal;
+  float error_tex_coord;
+  uint32_t num_triangles;
+  uint32_t num_vertices_before;
+  uint32_t num_vertices_after;
+  uint32_t num_transforms_before;
+  uint32_t num_transforms_after;
+  uint32_t num_lods;
+  uint32_t reserved;
+  LodEntry lods[kMaxLods];
+};
+
+struct TextureEntry {
+  uint32_t type;
+  uint32_t path_length;  // followed by path without null terminator
+};
+
+size_t Align(size_t offset) {
+  return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+} /* namespace */
+
+unique_ptr<MappedCache> MappedCache::Open(const string& source_path) {
+  uint64_t source_mtime, source_size;
+  if (!MappedFile::Stat(source_path, &source_mtime, &source_size))
+    return nullptr;
+
+  auto file = MappedFile::Open(source_path + kCacheSuffix);
+  if (!file || !file->InRange(0, sizeof(Header))) return nullptr;
+  unique_ptr<MappedCache> cache{new MappedCache{std::move(file)}};
+  if (!cache->Parse(source_mtime, source_size)) return nullptr;
+  return cache;
+}
+
+bool MappedCache::Parse(uint64_t source_mtime, uint64_t source_size) {
+  const char* base = file_->data();
+  const Header* header = reinterpret_cast<const Header*>(base);
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header->version != kVersion ||
+      header->vertex_size != sizeof(PackedVertex) ||
+      header->source_mtime != source_mtime ||
+      header->source_size != source_size)
+    return false;
+
+  const size_t table_size = header->num_meshes * sizeof(MeshEntry);
+  if (!file_->InRange(sizeof(Header), table_size)) return false;
+  const MeshEntry* entries =
+      reinterpret_cast<const MeshEntry*>(base + sizeof(Header));
+  auto in_range = [this](uint64_t offset, uint64_t length) {
+    return file_->InRange(offset, length);
+  };
+
+  meshes_.reserve(header->num_meshes);
+  for (uint32_t i = 0; i < header->num_meshes; ++i) {
+    const MeshEntry& entry = entries[i];
+    GLenum index_type = entry.index_type;
+    if ((index_type != GL_UNSIGNED_SHORT && index_type != GL_UNSIGNED_INT) ||
+        !in_range(entry.vertex_offset,
+                  entry.num_vertices * sizeof(PackedVertex)) ||
+        !in_range(entry.index_offset,
+                  entry.num_indices * IndexSize(index_type)) ||
+        entry.num_lods == 0 || entry.num_lods > kMaxLods)
+      return false;
+
+    vector<MeshLod> lods;
+    for (uint32_t j = 0; j < entry.num_lods; ++j) {
+      const LodEntry& lod = entry.lods[j];
+      if (uint64_t{lod.first_index} + lod.num_indices > entry.num_indices)
+        return false;
+      lods.emplace_back(MeshLod{static_cast<GLsizei>(lod.first_index),
+                                static_cast<GLsizei>(lod.num_indices),
+                                lod.error});
+    }
+
+    vector<TextureRef> textures;
+    uint64_t offset = entry.texture_offset;
+    for (uint32_t j = 0; j < entry.num_textures; ++j) {
+      if (!in_range(offset, sizeof(TextureEntry))) return false;
+      const TextureEntry* texture =
+          reinterpret_cast<const TextureEntry*>(base + offset);
+      offset += sizeof(TextureEntry);
+      if (!in_range(offset, texture->path_length)) return false;
+      textures.emplace_back(TextureRef{
+          string{base + offset, texture->path_length},
+          static_cast<TextureType>(texture->type)});
+      offset += texture->path_length;
+    }
+
+    meshes_.emplace_back(MeshView{
+        reinterpret_cast<const PackedVertex*>(base + entry.vertex_offset),
+        static_cast<size_t>(entry.num_vertices),
+        base + entry.index_offset,
+        static_cast<size_t>(entry.num_indices),
+        index_type,
+        std::move(textures),
+        AABB{glm::vec3{entry.bounds_min[0], entry.bounds_min[1],
+                       entry.bounds_min[2]},
+             glm::vec3{entry.bounds_max[0], entry.bounds_max[1],
+                       entry.bounds_max[2]}},
+        Sphere{glm::vec3{entry.sphere_center[0], entry.sphere_center[1],
+                         entry.sphere_center[2]},
+               entry.sphere_radius},
+        QuantizationError{entry.error_position, entry.error_normal,
+                          entry.error_tex_coord},
+        mesh_optimizer::Stats{entry.num_triangles, entry.num_vertices_before,
+                              entry.num_vertices_after,
+                              entry.num_transforms_before,
+                              entry.num_transforms_after},
+        std::move(lods)});
+  }
+  return true;
+}
+
+void Write(const string& source_path, const vector<MeshData>& meshes) {
+  uint64_t source_mtime, source_size;
+  if (!MappedFile::Stat(source_path, &source_mtime, &source_size)) return;
+
+  // compute layout: header, mesh table, then for each mesh texture references
+  // followed by aligned vertex and index data
+  vector<MeshEntry> entries(meshes.size());
+  size_t offset = sizeof(Header) + meshes.size() * sizeof(MeshEntry);
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    MeshEntry& entry = entries[i];
+    entry.texture_offset = offset;
+    entry.num_textures = static_cast<uint32_t>(meshes[i].textures.size());
+    entry.index_type = meshes[i].packed.index_type;
+    for (const auto& texture : meshes[i].textures)
+      offset += sizeof(TextureEntry) + texture.path.size();
+    offset = Align(offset);
+    entry.vertex_offset = offset;
+    const PackedMesh& packed = meshes[i].packed;
+    entry.num_vertices = packed.vertices.size();
+    offset = Align(offset + packed.vertices.size() * sizeof(PackedVertex));
+    entry.index_offset = offset;
+    entry.num_indices = packed.num_indices;
+    offset = Align(offset + packed.indices.size());
+    for (int j = 0; j < 3; ++j) {
+      entry.bounds_min[j] = meshes[i].bounds.min[j];
+      entry.bounds_max[j] = meshes[i].bounds.max[j];
+      entry.sphere_center[j] = meshes[i].bounding_sphere.center[j];
+    }
+    entry.sphere_radius = meshes[i].bounding_sphere.radius;
+    entry.error_position = packed.error.position;
+    entry.error_normal = packed.error.normal;
+    entry.error_tex_coord = packed.error.tex_coord;
+    const mesh_optimizer::Stats& stats = meshes[i].optimization;
+    entry.num_triangles = stats.num_triangles;
+    entry.num_vertices_before = stats.num_vertices_before;
+    entry.num_vertices_after = stats.num_vertices_after;
+    entry.num_transforms_before = stats.num_transforms_before;
+    entry.num_transforms_after = stats.num_transforms_after;
+    entry.num_lods = static_cast<uint32_t>(meshes[i].lods.size());
+    for (size_t j = 0; j < meshes[i].lods.size(); ++j) {
+      const MeshLod& lod = meshes[i].lods[j];
+      entry.lods[j] = LodEntry{static_cast<uint32_t>(lod.first_index),
+                               static_cast<uint32_t>(lod.num_indices),
+                               lod.error, 0};
+    }
+  }
+
+  vector<char> buffer(offset, 0);
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.vertex_size = sizeof(PackedVertex);
+  header.source_mtime = source_mtime;
+  header.source_size = source_size;
+  header.num_meshes = static_cast<uint32_t>(meshes.size());
+  header.reserved = 0;
+  std::memcpy(buffer.data(), &header, sizeof(Header));
+  std::memcpy(buffer.data() + sizeof(Header), entries.data(),
+              entries.size() * sizeof(MeshEntry));
+
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    char* dst = buffer.data() + entries[i].texture_offset;
+    for (const auto& texture : meshes[i].textures) {
+      TextureEntry texture_entry{static_cast<uint32_t>(texture.type),
+                                 static_cast<uint32_t>(texture.path.size())};
+      std::memcpy(dst, &texture_entry, sizeof(TextureEntry));
+      dst += sizeof(TextureEntry);
+      std::memcpy(dst, texture.path.data(), texture.path.size());
+      dst += texture.path.size();
+    }
+    const PackedMesh& packed = meshes[i].packed;
+    std::memcpy(buffer.data() + entries[i].vertex_offset,
+                packed.vertices.data(),
+                packed.vertices.size() * sizeof(PackedVertex));
+    std::memcpy(buffer.data() + entries[i].index_offset,
+                packed.indices.data(), packed.indices.size());
+  }
+
+  // write to a temporary file first, so that other processes never see a
+  // partially written cache
+  string cache_path = source_path + kCacheSuffix;
+  string temp_path = cache_path + ".tmp";
+  {
+    std::ofstream file{temp_path, std::ios::binary | std::ios::trunc};
+    if (!file.is_open()) return;
+    file.write(buffer.data(), buffer.size());
+    if (!file.good()) {
+      file.close();
+      std::remove(temp_path.c_str());
+      return;
+    }
+  }
+  if (std::rename(temp_path.c_str(), cache_path.c_str()) != 0)
+    std::remove(temp_path.c_str());
+}
+
+} /* namespace mesh_cache */
+} /* namespace opengl */
+} /* namespace wrapper */
@@ -0,0 +1,80 @@
+#ifndef WRAPPER_OPENGL_MESH_CACHE_H
+#define WRAPPER_OPENGL_MESH_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "bounds.h"
+#include "mapped_file.h"
+#include "mesh.h"
+#include "mesh_optimizer.h"
+#include "vertex_format.h"
+
+namespace wrapper {
+namespace opengl {
+namespace mesh_cache {
+
+// meshes are cached in a binary file next to the source asset, so that warm
+// startup only maps the file and uploads vertex and index data straight from
+// the mapped pages. vertices are stored packed (see PackedVertex) with
+// positions quantized within bounds of the whole model, and indices of all
+// levels of detail are stored one after another. the cache is
+// invalidated when the format version, layout of PackedVertex, or
+// modification time and size of the source file change
+
+struct TextureRef {
+  std::string path;  // relative to texture directory
+  TextureType type;
+};
+
+struct MeshData {
+  PackedMesh packed;
+  std::vector<TextureRef> textures;
+  AABB bounds;
+  Sphere bounding_sphere;
+  mesh_optimizer::Stats optimization;
+  std::vector<MeshLod> lods;  // ranges of packed.indices
+};
+
+// points into mapped memory, only valid while MappedCache is alive
+struct MeshView {
+  const PackedVertex* vertices;
+  size_t num_vertices;
+  const void* indices;
+  size_t num_indices;
+  GLenum index_type;
+  std::vector<TextureRef> textures;
+  AABB bounds;
+  Sphere bounding_sphere;
+  QuantizationError error;
+  mesh_optimizer::Stats optimization;
+  std::vector<MeshLod> lods;
+};
+
+class MappedCache {
+ public:
+  // returns nullptr if cache does not exist, is out of date or corrupted
+  static std::unique_ptr<MappedCache> Open(const std::string& source_path);
+  const std::vector<MeshView>& meshes() const { return meshes_; }
+
+ private:
+  std::unique_ptr<MappedFile> file_;
+  std::vector<MeshView> meshes_;
+  explicit MappedCache(std::unique_ptr<MappedFile> file)
+      : file_{std::move(file)} {}
+  bool Parse(uint64_t source_mtime, uint64_t source_size);
+};
+
+// fails silently, since the asset directory may be read-only
+void Write(const std::string& source_path, const std::vector<MeshData>& meshes);
+
+} /* namespace mesh_cache */
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_MESH_CACHE_H */
@@ -0,0 +1,299 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+using glm::vec3;
+using std::vector;
+
+namespace wrapper {
+namespace opengl {
+namespace mesh_optimizer {
+namespace {
+
+const GLuint kInvalidIndex = ~0u;
+
+// vertices are compared bitwise, since they are copied from the same source
+struct VertexHash {
+  size_t operator()(const Vertex& vertex) const {
+    // FNV-1a
+    const unsigned char* bytes =
+        reinterpret_cast<const unsigned char*>(&vertex);
+    size_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < sizeof(Vertex); ++i) {
+      hash ^= bytes[i];
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+};
+
+struct VertexEqual {
+  bool operator()(const Vertex& a, const Vertex& b) const {
+    return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+  }
+};
+
+// triangles that use each vertex, in compressed rows
+struct Adjacency {
+  vector<size_t> offsets;  // size is num_vertices + 1
+  vector<size_t> triangles;
+
+  Adjacency(const vector<GLuint>& indices, size_t num_vertices)
+      : offsets(num_vertices + 1, 0), triangles(indices.size()) {
+    for (GLuint index : indices)
+      ++offsets[index + 1];
+    for (size_t i = 0; i < num_vertices; ++i)
+      offsets[i + 1] += offsets[i];
+    vector<size_t> cursors{offsets.begin(), offsets.end() - 1};
+    for (size_t i = 0; i < indices.size(); ++i)
+      triangles[cursors[indices[i]]++] = i / 3;
+  }
+};
+
+bool IsTriangleList(const vector<GLuint>& indices) {
+  return !indices.empty() && indices.size() % 3 == 0;
+}
+
+} /* namespace */
+
+void Stats::Accumulate(const Stats& other) {
+  num_triangles += other.num_triangles;
+  num_vertices_before += other.num_vertices_before;
+  num_vertices_after += other.num_vertices_after;
+  num_transforms_before += other.num_transforms_before;
+  num_transforms_after += other.num_transforms_after;
+}
+
+float Stats::acmr_before() const {
+  return num_triangles ? (float) num_transforms_before / num_triangles : 0.0f;
+}
+
+float Stats::acmr_after() const {
+  return num_triangles ? (float) num_transforms_after / num_triangles : 0.0f;
+}
+
+float Stats::atvr_before() const {
+  return num_vertices_before ?
+      (float) num_transforms_before / num_vertices_before : 0.0f;
+}
+
+float Stats::atvr_after() const {
+  return num_vertices_after ?
+      (float) num_transforms_after / num_vertices_after : 0.0f;
+}
+
+uint32_t CountTransforms(const vector<GLuint>& indices, size_t num_vertices) {
+  // FIFO cache, a vertex is in cache if it was pushed less than kCacheSize
+  // pushes ago
+  vector<uint32_t> pushed_at(num_vertices, 0);
+  uint32_t num_transforms = 0;
+  for (GLuint index : indices) {
+    if (pushed_at[index] == 0 ||
+        num_transforms - pushed_at[index] >= kCacheSize) {
+      ++num_transforms;
+      pushed_at[index] = num_transforms;
+    }
+  }
+  return num_transforms;
+}
+
+void DeduplicateVertices(vector<Vertex>* vertices, vector<GLuint>* indices) {
+  std::unordered_map<Vertex, GLuint, VertexHash, VertexEqual> unique;
+  unique.reserve(vertices->size());
+  vector<GLuint> remap(vertices->size());
+  vector<Vertex> deduplicated;
+  for (size_t i = 0; i < vertices->size(); ++i) {
+    auto inserted = unique.insert(
+        {(*vertices)[i], static_cast<GLuint>(deduplicated.size())});
+    if (inserted.second) deduplicated.emplace_back((*vertices)[i]);
+    remap[i] = inserted.first->second;
+  }
+  for (auto& index : *indices)
+    index = remap[index];
+  *vertices = std::move(deduplicated);
+}
+
+vector<size_t> OptimizeVertexCache(vector<GLuint>* indices,
+                                   size_t num_vertices) {
+  const vector<GLuint>& input = *indices;
+  const size_t num_triangles = input.size() / 3;
+  Adjacency adjacency{input, num_vertices};
+  vector<int> live_triangles(num_vertices);
+  for (size_t i = 0; i < num_vertices; ++i)
+    live_triangles[i] = static_cast<int>(adjacency.offsets[i + 1] -
+                                         adjacency.offsets[i]);
+
+  vector<GLuint> output;
+  output.reserve(input.size());
+  vector<size_t> cluster_offsets;
+  vector<bool> emitted(num_triangles, false);
+  // time when each vertex entered the cache
+  vector<int> cache_time(num_vertices, 0);
+  int time = kCacheSize + 1;
+  vector<GLuint> dead_end;  // recently used vertices, as a stack
+  size_t scan_cursor = 0;
+  vector<GLuint> candidates;
+
+  GLuint fanning = num_vertices > 0 ? 0 : kInvalidIndex;
+  cluster_offsets.emplace_back(0);
+  while (fanning != kInvalidIndex) {
+    // emit all triangles around the fanning vertex
+    candidates.clear();
+    for (size_t i = adjacency.offsets[fanning];
+         i < adjacency.offsets[fanning + 1]; ++i) {
+      size_t triangle = adjacency.triangles[i];
+      if (emitted[triangle]) continue;
+      emitted[triangle] = true;
+      for (int j = 0; j < 3; ++j) {
+        GLuint vertex = input[triangle * 3 + j];
+        output.emplace_back(vertex);
+        dead_end.emplace_back(vertex);
+        candidates.emplace_back(vertex);
+        --live_triangles[vertex];
+        if (time - cache_time[vertex] > kCacheSize)
+          cache_time[vertex] = time++;
+      }
+    }
+
+    // prefer the candidate that will still be in cache when its remaining
+    // triangles are emitted, and among those the oldest one
+    GLuint next = kInvalidIndex;
+    int best_priority = -1;
+    for (GLuint vertex : candidates) {
+      if (live_triangles[vertex] <= 0) continue;
+      int priority = 0;
+      if (time - cache_time[vertex] + 2 * live_triangles[vertex] <= kCacheSize)
+        priority = time - cache_time[vertex];
+      if (priority > best_priority) {
+        best_priority = priority;
+        next = vertex;
+      }
+    }
+    if (next != kInvalidIndex) {
+      fanning = next;
+      continue;
+    }
+
+    // dead end: cache contents are of no use from here on
+    if (output.size() > cluster_offsets.back() &&
+        output.size() < input.size())
+      cluster_offsets.emplace_back(output.size());
+    while (!dead_end.empty() && next == kInvalidIndex) {
+      GLuint vertex = dead_end.back();
+      dead_end.pop_back();
+      if (live_triangles[vertex] > 0) next = vertex;
+    }
+    while (scan_cursor < num_vertices && next == kInvalidIndex) {
+      if (live_triangles[scan_cursor] > 0)
+        next = static_cast<GLuint>(scan_cursor);
+      ++scan_cursor;
+    }
+    fanning = next;
+  }
+
+  *indices = std::move(output);
+  return cluster_offsets;
+}
+
+void OptimizeOverdraw(vector<GLuint>* indices,
+                      const vector<size_t>& cluster_offsets,
+                      const vector<Vertex>& vertices) {
+  struct Cluster {
+    size_t begin, end;
+    float sort_key;
+  };
+
+  // centroid of the whole mesh, weighted by triangle area
+  auto triangle = [&](size_t offset, vec3* center, vec3* normal) {
+    const vec3& a = vertices[(*indices)[offset]].position;
+    const vec3& b = vertices[(*indices)[offset + 1]].position;
+    const vec3& c = vertices[(*indices)[offset + 2]].position;
+    *center = (a + b + c) / 3.0f;
+    *normal = glm::cross(b - a, c - a);  // length is twice the area
+  };
+  vec3 mesh_center{0.0f};
+  float mesh_area = 0.0f;
+  for (size_t i = 0; i < indices->size(); i += 3) {
+    vec3 center, normal;
+    triangle(i, &center, &normal);
+    float area = glm::length(normal);
+    mesh_center += center * area;
+    mesh_area += area;
+  }
+  if (mesh_area > 0.0f) mesh_center = mesh_center / mesh_area;
+
+  // clusters that face away from the center are on the outside
+  vector<Cluster> clusters;
+  for (size_t i = 0; i < cluster_offsets.size(); ++i) {
+    size_t begin = cluster_offsets[i];
+    size_t end = i + 1 < cluster_offsets.size() ? cluster_offsets[i + 1]
+                                                : indices->size();
+    vec3 cluster_center{0.0f}, cluster_normal{0.0f};
+    float cluster_area = 0.0f;
+    for (size_t j = begin; j < end; j += 3) {
+      vec3 center, normal;
+      triangle(j, &center, &normal);
+      float area = glm::length(normal);
+      cluster_center += center * area;
+      cluster_normal += normal;
+      cluster_area += area;
+    }
+    float sort_key = 0.0f;
+    if (cluster_area > 0.0f && glm::length(cluster_normal) > 0.0f) {
+      cluster_center = cluster_center / cluster_area;
+      sort_key = glm::dot(cluster_center - mesh_center,
+                          glm::normalize(cluster_normal));
+    }
+    clusters.emplace_back(Cluster{begin, end, sort_key});
+  }
+  std::stable_sort(clusters.begin(), clusters.end(),
+                   [](const Cluster& a, const Cluster& b) {
+                     return a.sort_key > b.sort_key;
+                   });
+
+  vector<GLuint> output;
+  output.reserve(indices->size());
+  for (const auto& cluster : clusters)
+    output.insert(output.end(), indices->begin() + cluster.begin,
+                  indices->begin() + cluster.end);
+  *indices = std::move(output);
+}
+
+void OptimizeVertexFetch(vector<Vertex>* vertices, vector<GLuint>* indices) {
+  vector<GLuint> remap(vertices->size(), kInvalidIndex);
+  vector<Vertex> reordered;
+  reordered.reserve(vertices->size());
+  for (auto& index : *indices) {
+    if (remap[index] == kInvalidIndex) {
+      remap[index] = static_cast<GLuint>(reordered.size());
+      reordered.emplace_back((*vertices)[index]);
+    }
+    index = remap[index];
+  }
+  // vertices that no triangle uses are dropped
+  *vertices = std::move(reordered);
+}
+
+Stats Optimize(vector<Vertex>* vertices, vector<GLuint>* indices) {
+  Stats stats;
+  stats.num_triangles = static_cast<uint32_t>(indices->size() / 3);
+  stats.num_vertices_before = static_cast<uint32_t>(vertices->size());
+  stats.num_transforms_before = CountTransforms(*indices, vertices->size());
+
+  if (IsTriangleList(*indices)) {
+    DeduplicateVertices(vertices, indices);
+    vector<size_t> clusters = OptimizeVertexCache(indices, vertices->size());
+    OptimizeOverdraw(indices, clusters, *vertices);
+    OptimizeVertexFetch(vertices, indices);
+  }
+
+  stats.num_vertices_after = static_cast<uint32_t>(vertices->size());
+  stats.num_transforms_after = CountTransforms(*indices, vertices->size());
+  return stats;
+}
+
+} /* namespace mesh_optimizer */
+} /* namespace opengl */
+} /* namespace wrapper */
@@ -0,0 +1,64 @@
+#ifndef WRAPPER_OPENGL_MESH_OPTIMIZER_H
+#define WRAPPER_OPENGL_MESH_OPTIMIZER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "vertex_format.h"
+
+namespace wrapper {
+namespace opengl {
+namespace mesh_optimizer {
+
+// counts from simulating a FIFO post-transform cache, before and after
+// optimization. ACMR is transforms per triangle, ATVR is transforms per
+// vertex (1.0 is optimal)
+struct Stats {
+  uint32_t num_triangles;
+  uint32_t num_vertices_before, num_vertices_after;
+  uint32_t num_transforms_before, num_transforms_after;
+
+  void Accumulate(const Stats& other);
+  float acmr_before() const;
+  float acmr_after() const;
+  float atvr_before() const;
+  float atvr_after() const;
+};
+
+// number of vertices the simulated (and assumed) post-transform cache holds
+const int kCacheSize{16};
+
+// returns number of vertex shader invocations when drawing triangles
+uint32_t CountTransforms(const std::vector<GLuint>& indices,
+                         size_t num_vertices);
+
+// merges vertices that are identical in every attribute
+void DeduplicateVertices(std::vector<Vertex>* vertices,
+                         std::vector<GLuint>* indices);
+
+// reorders triangles for locality in post-transform cache, with Tipsify
+// (Sander et al. 2007). returns offsets into indices where clusters start,
+// i.e. where the cache is effectively flushed
+std::vector<size_t> OptimizeVertexCache(std::vector<GLuint>* indices,
+                                        size_t num_vertices);
+
+// reorders clusters so that those facing outwards, which likely occlude
+// others, are drawn first
+void OptimizeOverdraw(std::vector<GLuint>* indices,
+                      const std::vector<size_t>& cluster_offsets,
+                      const std::vector<Vertex>& vertices);
+
+// reorders vertices in order of first use, for locality in vertex fetching
+void OptimizeVertexFetch(std::vector<Vertex>* vertices,
+                         std::vector<GLuint>* indices);
+
+// runs all of above. meshes that are not made of triangles are kept as is
+Stats Optimize(std::vector<Vertex>* vertices, std::vector<GLuint>* indices);
+
+} /* namespace mesh_optimizer */
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_MESH_OPTIMIZER_H */
@@ -0,0 +1,300 @@
+#include "mesh_simplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+using glm::dvec3;
+using glm::vec3;
+using std::vector;
+
+namespace wrapper {
+namespace opengl {
+namespace mesh_simplifier {
+namespace {
+
+// errors of border planes are weighted up, so that silhouettes of open
+// meshes are kept longer than interior details
+const double kBorderWeight = 10.0;
+// below this many triangles, further levels would not save anything
+const size_t kMinLodTriangles{32};
+// a level is only kept if it has at most this fraction of indices of the
+// previous level
+const float kMinLodReduction{0.75f};
+
+// sum of squared distances to weighted planes, as
+//     p^T a p + 2 b.p + c
+// where a is symmetric. double precision, since terms nearly cancel out
+struct Quadric {
+  double a00, a01, a02, a11, a12, a22;
+  double b0, b1, b2;
+  double c;
+  double weight;
+
+  static Quadric FromPlane(const dvec3& normal, double distance,
+                           double weight) {
+    const dvec3 n = normal * weight;
+    return Quadric{n.x * normal.x, n.x * normal.y, n.x * normal.z,
+                   n.y * normal.y, n.y * normal.z, n.z * normal.z,
+                   n.x * distance, n.y * distance, n.z * distance,
+                   weight * distance * distance, weight};
+  }
+
+  void Add(const Quadric& other) {
+    a00 += other.a00; a01 += other.a01; a02 += other.a02;
+    a11 += other.a11; a12 += other.a12; a22 += other.a22;
+    b0 += other.b0; b1 += other.b1; b2 += other.b2;
+    c += other.c;
+    weight += other.weight;
+  }
+
+  // returns root of weighted mean squared distance, i.e. in model space
+  double Error(const vec3& point) const {
+    if (weight <= 0.0) return 0.0;
+    const double x = point.x, y = point.y, z = point.z;
+    double squared = x * (a00 * x + a01 * y + a02 * z) +
+                     y * (a01 * x + a11 * y + a12 * z) +
+                     z * (a02 * x + a12 * y + a22 * z) +
+                     2.0 * (b0 * x + b1 * y + b2 * z) + c;
+    return std::sqrt(std::max(squared, 0.0) / weight);
+  }
+};
+
+struct Collapse {
+  GLuint source, target;
+  double error;
+};
+
+uint64_t EdgeKey(GLuint a, GLuint b) {
+  return a < b ? (uint64_t{a} << 32) | b : (uint64_t{b} << 32) | a;
+}
+
+// vertices that share their position with another vertex
+vector<bool> FindSeams(const vector<Vertex>& vertices) {
+  struct PositionHash {
+    size_t operator()(const vec3& position) const {
+      uint32_t bits[3];
+      std::memcpy(bits, &position, sizeof(bits));
+      return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^
+             (bits[2] * 83492791u);
+    }
+  };
+  std::unordered_map<vec3, GLuint, PositionHash> first_of;
+  first_of.reserve(vertices.size());
+  vector<bool> seam(vertices.size(), false);
+  for (GLuint i = 0; i < vertices.size(); ++i) {
+    auto inserted = first_of.insert({vertices[i].position, i});
+    if (!inserted.second) {
+      seam[i] = true;
+      seam[inserted.first->second] = true;
+    }
+  }
+  return seam;
+}
+
+// triangles that use each vertex, in compressed rows
+struct Adjacency {
+  vector<size_t> offsets;
+  vector<size_t> triangles;
+
+  Adjacency(const vector<GLuint>& indices, size_t num_vertices)
+      : offsets(num_vertices + 1, 0), triangles(indices.size()) {
+    for (GLuint index : indices)
+      ++offsets[index + 1];
+    for (size_t i = 0; i < num_vertices; ++i)
+      offsets[i + 1] += offsets[i];
+    vector<size_t> cursors{offsets.begin(), offsets.end() - 1};
+    for (size_t i = 0; i < indices.size(); ++i)
+      triangles[cursors[indices[i]]++] = i / 3;
+  }
+};
+
+// whether moving source onto target turns any remaining triangle around
+// source upside down
+bool FlipsTriangles(const vector<Vertex>& vertices,
+                    const vector<GLuint>& indices,
+                    const Adjacency& adjacency,
+                    GLuint source, GLuint target) {
+  for (size_t i = adjacency.offsets[source];
+       i < adjacency.offsets[source + 1]; ++i) {
+    const GLuint* triangle = &indices[adjacency.triangles[i] * 3];
+    if (triangle[0] == target || triangle[1] == target ||
+        triangle[2] == target)
+      continue;  // removed by this collapse
+    vec3 before[3], after[3];
+    for (int j = 0; j < 3; ++j) {
+      before[j] = vertices[triangle[j]].position;
+      after[j] = triangle[j] == source ? vertices[target].position
+                                       : before[j];
+    }
+    vec3 normal_before = glm::cross(before[1] - before[0],
+                                    before[2] - before[0]);
+    vec3 normal_after = glm::cross(after[1] - after[0], after[2] - after[0]);
+    if (glm::dot(normal_before, normal_after) <= 0.0f) return true;
+  }
+  return false;
+}
+
+} /* namespace */
+
+vector<GLuint> Simplify(const vector<Vertex>& vertices,
+                        const vector<GLuint>& indices,
+                        size_t target_num_indices,
+                        float* error) {
+  const size_t num_vertices = vertices.size();
+  const vector<bool> seam = FindSeams(vertices);
+
+  // edges used by only one triangle are on open borders
+  std::unordered_map<uint64_t, int> edge_uses;
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    for (int j = 0; j < 3; ++j)
+      ++edge_uses[EdgeKey(indices[i + j], indices[i + (j + 1) % 3])];
+  }
+  vector<bool> border(num_vertices, false);
+
+  // quadrics are built from original triangles, so errors are always
+  // measured against full detail
+  vector<Quadric> quadrics(num_vertices, Quadric{});
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    dvec3 p[3];
+    for (int j = 0; j < 3; ++j)
+      p[j] = dvec3{vertices[indices[i + j]].position};
+    dvec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+    double double_area = glm::length(normal);
+    if (double_area <= 0.0) continue;
+    normal /= double_area;
+    Quadric face = Quadric::FromPlane(normal, -glm::dot(normal, p[0]),
+                                      double_area * 0.5);
+    for (int j = 0; j < 3; ++j) {
+      GLuint a = indices[i + j], b = indices[i + (j + 1) % 3];
+      quadrics[a].Add(face);
+      if (edge_uses[EdgeKey(a, b)] != 1) continue;
+      // plane through border edge, perpendicular to the triangle
+      border[a] = border[b] = true;
+      dvec3 edge = p[(j + 1) % 3] - p[j];
+      double length = glm::length(edge);
+      if (length <= 0.0) continue;
+      dvec3 border_normal = glm::normalize(glm::cross(edge, normal));
+      Quadric constraint = Quadric::FromPlane(
+          border_normal, -glm::dot(border_normal, p[j]),
+          length * length * kBorderWeight);
+      quadrics[a].Add(constraint);
+      quadrics[b].Add(constraint);
+    }
+  }
+
+  auto can_move = [&](GLuint source, bool border_edge) {
+    return !seam[source] && (!border[source] || border_edge);
+  };
+
+  vector<GLuint> result = indices;
+  vector<GLuint> collapse_to(num_vertices);
+  vector<bool> touched(num_vertices);
+  vector<Collapse> collapses;
+  double max_error = 0.0;
+  // collapses are done in passes. in each pass, cheapest collapses that do
+  // not share any triangle are done together, and costs are recomputed after
+  while (result.size() > target_num_indices) {
+    Adjacency adjacency{result, num_vertices};
+    edge_uses.clear();
+    for (size_t i = 0; i < result.size(); i += 3) {
+      for (int j = 0; j < 3; ++j)
+        ++edge_uses[EdgeKey(result[i + j], result[i + (j + 1) % 3])];
+    }
+
+    collapses.clear();
+    for (const auto& edge : edge_uses) {
+      GLuint a = static_cast<GLuint>(edge.first >> 32);
+      GLuint b = static_cast<GLuint>(edge.first & 0xFFFFFFFFu);
+      bool border_edge = edge.second == 1;
+      Quadric merged = quadrics[a];
+      merged.Add(quadrics[b]);
+      Collapse best{0, 0, -1.0};
+      if (can_move(a, border_edge))
+        best = Collapse{a, b, merged.Error(vertices[b].position)};
+      if (can_move(b, border_edge)) {
+        double error = merged.Error(vertices[a].position);
+        if (best.error < 0.0 || error < best.error)
+          best = Collapse{b, a, error};
+      }
+      if (best.error >= 0.0) collapses.emplace_back(best);
+    }
+    if (collapses.empty()) break;
+    std::sort(collapses.begin(), collapses.end(),
+              [](const Collapse& a, const Collapse& b) {
+                return a.error < b.error;
+              });
+
+    // each collapse removes about two triangles. only do part of what is
+    // left, so that later collapses see updated costs
+    size_t num_excess = (result.size() - target_num_indices) / 3;
+    size_t max_collapses = std::max<size_t>(1, num_excess / 4);
+    size_t num_collapses = 0;
+    for (GLuint i = 0; i < num_vertices; ++i)
+      collapse_to[i] = i;
+    std::fill(touched.begin(), touched.end(), false);
+    for (const auto& collapse : collapses) {
+      if (num_collapses >= max_collapses) break;
+      if (touched[collapse.source] || touched[collapse.target]) continue;
+      if (FlipsTriangles(vertices, result, adjacency, collapse.source,
+                         collapse.target))
+        continue;
+      // lock the neighborhood, so collapses in this pass are independent
+      for (size_t i = adjacency.offsets[collapse.source];
+           i < adjacency.offsets[collapse.source + 1]; ++i) {
+        for (int j = 0; j < 3; ++j)
+          touched[result[adjacency.triangles[i] * 3 + j]] = true;
+      }
+      collapse_to[collapse.source] = collapse.target;
+      quadrics[collapse.target].Add(quadrics[collapse.source]);
+      max_error = std::max(max_error, collapse.error);
+      ++num_collapses;
+    }
+    if (num_collapses == 0) break;
+
+    // drop triangles that have become degenerate
+    size_t num_kept = 0;
+    for (size_t i = 0; i < result.size(); i += 3) {
+      GLuint a = collapse_to[result[i]];
+      GLuint b = collapse_to[result[i + 1]];
+      GLuint c = collapse_to[result[i + 2]];
+      if (a == b || b == c || c == a) continue;
+      result[num_kept++] = a;
+      result[num_kept++] = b;
+      result[num_kept++] = c;
+    }
+    result.resize(num_kept);
+  }
+
+  *error = static_cast<float>(max_error);
+  return result;
+}
+
+vector<Lod> BuildLods(const vector<Vertex>& vertices,
+                      const vector<GLuint>& indices,
+                      size_t max_lods) {
+  vector<Lod> lods;
+  lods.emplace_back(Lod{indices, 0.0f});
+  if (indices.empty() || indices.size() % 3 != 0) return lods;
+
+  // each level is simplified from full detail rather than from the previous
+  // level, so that its error is relative to the original mesh
+  while (lods.size() < max_lods) {
+    const size_t num_previous = lods.back().indices.size();
+    if (num_previous / 3 < kMinLodTriangles) break;
+    float error;
+    vector<GLuint> simplified =
+        Simplify(vertices, indices, num_previous / 6 * 3, &error);
+    if (simplified.empty() ||
+        simplified.size() > num_previous * kMinLodReduction)
+      break;
+    lods.emplace_back(Lod{std::move(simplified), error});
+  }
+  return lods;
+}
+
+} /* namespace mesh_simplifier */
+} /* namespace opengl */
+} /* namespace wrapper */
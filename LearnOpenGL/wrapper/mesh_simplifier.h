@@ -0,0 +1,49 @@
+#ifndef WRAPPER_OPENGL_MESH_SIMPLIFIER_H
+#define WRAPPER_OPENGL_MESH_SIMPLIFIER_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "vertex_format.h"
+
+namespace wrapper {
+namespace opengl {
+namespace mesh_simplifier {
+
+// reduces triangles by collapsing edges in order of quadric error (Garland and
+// Heckbert 1997). an edge is collapsed onto one of its existing vertices, so
+// the result only has new indices and reuses vertices of the original mesh.
+// vertices on attribute seams (same position with different normal or
+// texture coordinates) are never moved, so that no cracks open, and vertices
+// on open borders only move along them. returns indices of the simplified
+// mesh, which may have more than target_num_indices if collapses run out, and
+// sets *error to the largest error of collapses done. error of a collapse is
+// the root of area weighted mean squared distance from the kept vertex to
+// planes of original triangles merged into it. it is a distance in model
+// space, but an average one, so the result may locally be further than that
+// from original surface
+std::vector<GLuint> Simplify(const std::vector<Vertex>& vertices,
+                             const std::vector<GLuint>& indices,
+                             size_t target_num_indices,
+                             float* error);
+
+struct Lod {
+  std::vector<GLuint> indices;
+  float error;
+};
+
+// returns levels of detail with max_lods levels at most. level 0 is original
+// indices, and each following level has about half of the triangles of the
+// previous one. stops early if simplification cannot make enough progress.
+// meshes that are not made of triangles only have level 0
+std::vector<Lod> BuildLods(const std::vector<Vertex>& vertices,
+                           const std::vector<GLuint>& indices,
+                           size_t max_lods);
+
+} /* namespace mesh_simplifier */
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_MESH_SIMPLIFIER_H */
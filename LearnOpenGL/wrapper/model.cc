@@ -7,12 +7,18 @@
 
 #include "model.h"
 
+#include <algorithm>
+
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #include <glm/glm.hpp>
 
 #include "loader.h"
+#include "material.h"
+#include "mesh_cache.h"
+#include "mesh_simplifier.h"
 
+using glm::mat4;
 using glm::vec3;
 using std::string;
 using std::vector;
@@ -21,24 +27,75 @@ namespace wrapper {
 namespace opengl {
 namespace {
 
-vector<Texture> LoadMaterialTextures(const string& directory,
-                                     const aiMaterial* material,
-                                     aiTextureType ai_type,
-                                     TextureType type) {
-  vector<Texture> textures(material->GetTextureCount(ai_type));
-  for (int i = 0; i < textures.size(); ++i) {
+void AppendMaterialTextures(vector<mesh_cache::TextureRef>* textures,
+                            const aiMaterial* material,
+                            aiTextureType ai_type,
+                            TextureType type) {
+  for (unsigned i = 0; i < material->GetTextureCount(ai_type); ++i) {
     aiString path;
     material->GetTexture(ai_type, i, &path);
-    GLuint texture = loader::LoadTexture(
-        directory + "/" + path.C_Str(), type == TextureType::kDiffuse);
-    textures[i] = Texture{texture, type};
+    textures->emplace_back(mesh_cache::TextureRef{path.C_Str(), type});
+  }
+}
+
+// queues textures of all meshes at once, so that they are decoded in parallel
+vector<vector<Texture>> LoadTextures(
+    const string& directory,
+    const vector<const vector<mesh_cache::TextureRef>*>& mesh_refs) {
+  vector<loader::TextureRequest> requests;
+  for (const auto* refs : mesh_refs) {
+    for (const auto& ref : *refs) {
+      requests.emplace_back(loader::TextureRequest{
+          directory + "/" + ref.path, ref.type == TextureType::kDiffuse});
+    }
+  }
+  vector<GLuint> loaded = loader::LoadTextures(requests);
+
+  vector<vector<Texture>> textures;
+  auto next = loaded.begin();
+  for (const auto* refs : mesh_refs) {
+    textures.emplace_back();
+    for (const auto& ref : *refs)
+      textures.back().emplace_back(Texture{*next++, ref.type});
   }
   return textures;
 }
 
-Mesh ProcessMesh(const string& directory,
-                 const aiMesh* mesh,
-                 const aiScene* scene) {
+// textures only live in arrays of materials afterwards, so the originals are
+// released from the loader
+vector<Material> LoadMaterials(
+    const string& directory,
+    const vector<const vector<mesh_cache::TextureRef>*>& mesh_refs) {
+  vector<vector<Texture>> textures = LoadTextures(directory, mesh_refs);
+  vector<Material> materials = BuildMaterials(textures);
+  vector<GLuint> ids;
+  for (const auto& list : textures) {
+    for (const auto& texture : list)
+      ids.emplace_back(texture.id);
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  loader::ReleaseTextures(ids);
+  return materials;
+}
+
+// mesh before packing, which has to wait for bounds of the whole model
+struct ImportedMesh {
+  vector<Vertex> vertices;
+  vector<GLuint> indices;  // of all levels of detail
+  mesh_cache::MeshData data;  // all but packed
+};
+
+// packed geometry of a mesh, either imported or mapped from cache
+struct Geometry {
+  const PackedVertex* vertices;
+  size_t num_vertices;
+  const void* indices;
+  size_t num_indices;
+  GLenum index_type;
+};
+
+ImportedMesh ProcessMesh(const aiMesh* mesh, const aiScene* scene) {
   // load vertices (position, normal, texCoord)
   vector<Vertex> vertices(mesh->mNumVertices);
   aiVector3D* ai_tex_coords = mesh->mTextureCoords[0];
@@ -62,40 +119,61 @@ Mesh ProcessMesh(const string& directory,
                    face.mIndices + face.mNumIndices);
   }
 
-  // load textures
-  vector<Texture> textures{};
+  // collect textures, in the order of diffuse, specular and reflection
+  vector<mesh_cache::TextureRef> textures{};
   if (scene->HasMaterials()) {
     aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-    vector<Texture> diff_maps = LoadMaterialTextures(
-        directory, material, aiTextureType_DIFFUSE, TextureType::kDiffuse);
-    vector<Texture> spec_maps = LoadMaterialTextures(
-        directory, material, aiTextureType_SPECULAR, TextureType::kSpecular);
-    vector<Texture> refl_maps = LoadMaterialTextures(
-        directory, material, aiTextureType_AMBIENT, TextureType::kReflection);
+    AppendMaterialTextures(&textures, material, aiTextureType_DIFFUSE,
+                           TextureType::kDiffuse);
+    AppendMaterialTextures(&textures, material, aiTextureType_SPECULAR,
+                           TextureType::kSpecular);
+    AppendMaterialTextures(&textures, material, aiTextureType_AMBIENT,
+                           TextureType::kReflection);
+  }
+
+  // welding, reordering and bounds are all computed once here, and then
+  // cached along with the mesh
+  mesh_optimizer::Stats optimization =
+      mesh_optimizer::Optimize(&vertices, &indices);
+  const vec3* positions = &vertices.data()->position;
+  AABB bounds = AABB::Enclose(positions, vertices.size(), sizeof(Vertex));
+  Sphere bounding_sphere = Sphere::Enclose(bounds, positions, vertices.size(),
+                                           sizeof(Vertex));
 
-    textures.insert(textures.end(), diff_maps.begin(), diff_maps.end());
-    textures.insert(textures.end(), spec_maps.begin(), spec_maps.end());
-    textures.insert(textures.end(), refl_maps.begin(), refl_maps.end());
+  // coarser levels of detail reuse vertices and only add indices, which are
+  // reordered for the vertex cache on their own
+  vector<mesh_simplifier::Lod> lods =
+      mesh_simplifier::BuildLods(vertices, indices, kMaxLods);
+  vector<GLuint> lod_indices;
+  vector<MeshLod> ranges;
+  for (auto& lod : lods) {
+    if (!ranges.empty())
+      mesh_optimizer::OptimizeVertexCache(&lod.indices, vertices.size());
+    ranges.emplace_back(MeshLod{static_cast<GLsizei>(lod_indices.size()),
+                                static_cast<GLsizei>(lod.indices.size()),
+                                lod.error});
+    lod_indices.insert(lod_indices.end(), lod.indices.begin(),
+                       lod.indices.end());
   }
 
-  return Mesh{vertices, indices, textures};
+  return ImportedMesh{
+      std::move(vertices), std::move(lod_indices),
+      mesh_cache::MeshData{PackedMesh{}, std::move(textures), bounds,
+                           bounding_sphere, optimization, std::move(ranges)}};
 }
 
-void ProcessNode(vector<Mesh>* meshes,
-                 const string& directory,
+void ProcessNode(vector<ImportedMesh>* meshes,
                  const aiNode* node,
                  const aiScene* scene) {
   for (int i = 0; i < node->mNumMeshes; ++i) {
     aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-    meshes->emplace_back(ProcessMesh(directory, mesh, scene));
+    meshes->emplace_back(ProcessMesh(mesh, scene));
   }
   for (int i = 0; i < node->mNumChildren; ++i)
-    ProcessNode(meshes, directory, node->mChildren[i], scene);
+    ProcessNode(meshes, node->mChildren[i], scene);
 }
 
-} /* namespace */
-
-Model::Model(const string& obj_path, const string& tex_path) {
+vector<mesh_cache::MeshData> ImportMeshes(const string& obj_path) {
   Assimp::Importer importer;
   // other useful options:
   // aiProcess_GenNormals: create normal for vertices
@@ -111,7 +189,230 @@ Model::Model(const string& obj_path, const string& tex_path) {
       throw std::runtime_error{string{"Failed to import scene: "} +
           importer.GetErrorString()};
 
-  ProcessNode(&meshes_, tex_path, scene->mRootNode, scene);
+  vector<ImportedMesh> imported;
+  ProcessNode(&imported, scene->mRootNode, scene);
+
+  // vertices are quantized once here, and then only the packed form is
+  // cached and uploaded. all meshes are quantized within the same bounds, so
+  // that they can be drawn together
+  AABB bounds;
+  for (const auto& mesh : imported)
+    bounds.Extend(mesh.data.bounds);
+  vector<mesh_cache::MeshData> meshes;
+  for (auto& mesh : imported) {
+    mesh.data.packed = Pack(mesh.vertices, mesh.indices, bounds);
+    meshes.emplace_back(std::move(mesh.data));
+  }
+  return meshes;
+}
+
+// uploads geometry of all meshes to one vertex buffer and one index buffer,
+// and returns where each mesh is. positions must be quantized within bounds
+vector<MeshRange> UploadGeometry(const vector<Geometry>& geometries,
+                                 const AABB& bounds,
+                                 GLuint* vao, GLuint* vbo, GLuint* ebo) {
+  // indices are relative to base vertex of each mesh, so 16-bit indices
+  // suffice if every mesh has them
+  GLenum index_type = GL_UNSIGNED_SHORT;
+  size_t num_vertices = 0, num_indices = 0;
+  for (const auto& geometry : geometries) {
+    if (geometry.index_type != GL_UNSIGNED_SHORT)
+      index_type = GL_UNSIGNED_INT;
+    num_vertices += geometry.num_vertices;
+    num_indices += geometry.num_indices;
+  }
+  const size_t index_size = IndexSize(index_type);
+  const VertexLayout& layout = VertexLayout::Packed();
+  vec3 position_offset{0.0f}, position_scale{1.0f};
+  if (!bounds.empty()) {
+    position_offset = bounds.min;
+    position_scale = bounds.max - bounds.min;
+  }
+
+  glGenVertexArrays(1, vao);
+  glBindVertexArray(*vao);
+  glGenBuffers(1, vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, *vbo);
+  glBufferData(GL_ARRAY_BUFFER, num_vertices * layout.stride, NULL,
+               GL_STATIC_DRAW);
+  glGenBuffers(1, ebo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, num_indices * index_size, NULL,
+               GL_STATIC_DRAW);
+
+  vector<MeshRange> ranges;
+  vector<GLuint> widened;
+  size_t vertex_cursor = 0, index_cursor = 0;
+  for (const auto& geometry : geometries) {
+    glBufferSubData(GL_ARRAY_BUFFER, vertex_cursor * layout.stride,
+                    geometry.num_vertices * layout.stride, geometry.vertices);
+    const void* indices = geometry.indices;
+    if (geometry.index_type != index_type) {
+      // small meshes are widened to 32-bit indices of other meshes
+      const uint16_t* narrow = static_cast<const uint16_t*>(indices);
+      widened.assign(narrow, narrow + geometry.num_indices);
+      indices = widened.data();
+    }
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, index_cursor * index_size,
+                    geometry.num_indices * index_size, indices);
+    ranges.emplace_back(MeshRange{
+        *vao, static_cast<GLint>(vertex_cursor), geometry.num_vertices,
+        index_cursor * index_size, geometry.num_indices, index_type,
+        layout.stride, position_offset, position_scale});
+    vertex_cursor += geometry.num_vertices;
+    index_cursor += geometry.num_indices;
+  }
+  layout.Apply();
+
+  // unbind
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  return ranges;
+}
+
+} /* namespace */
+
+Model::Model(const string& obj_path, const string& tex_path)
+    : quantization_error_{0.0f, 0.0f, 0.0f},
+      optimization_stats_{0, 0, 0, 0, 0} {
+  // on cache hit, upload straight from the mapped file without Assimp
+  auto cache = mesh_cache::MappedCache::Open(obj_path);
+  if (cache) {
+    const auto& meshes = cache->meshes();
+    vector<const vector<mesh_cache::TextureRef>*> refs;
+    vector<Geometry> geometries;
+    for (const auto& mesh : meshes) {
+      refs.emplace_back(&mesh.textures);
+      geometries.emplace_back(Geometry{mesh.vertices, mesh.num_vertices,
+                                       mesh.indices, mesh.num_indices,
+                                       mesh.index_type});
+      bounds_.Extend(mesh.bounds);
+    }
+    vector<Material> materials = LoadMaterials(tex_path, refs);
+    vector<MeshRange> ranges =
+        UploadGeometry(geometries, bounds_, &vao_, &vbo_, &ebo_);
+    for (size_t i = 0; i < meshes.size(); ++i) {
+      meshes_.emplace_back(ranges[i], materials[i], meshes[i].bounds,
+                           meshes[i].bounding_sphere, meshes[i].lods);
+      quantization_error_.Extend(meshes[i].error);
+      optimization_stats_.Accumulate(meshes[i].optimization);
+    }
+    AggregateMeshes();
+    return;
+  }
+
+  vector<mesh_cache::MeshData> meshes = ImportMeshes(obj_path);
+  vector<const vector<mesh_cache::TextureRef>*> refs;
+  vector<Geometry> geometries;
+  for (const auto& mesh : meshes) {
+    refs.emplace_back(&mesh.textures);
+    geometries.emplace_back(Geometry{
+        mesh.packed.vertices.data(), mesh.packed.vertices.size(),
+        mesh.packed.indices.data(), mesh.packed.num_indices,
+        mesh.packed.index_type});
+    bounds_.Extend(mesh.bounds);
+  }
+  vector<Material> materials = LoadMaterials(tex_path, refs);
+  vector<MeshRange> ranges =
+      UploadGeometry(geometries, bounds_, &vao_, &vbo_, &ebo_);
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    meshes_.emplace_back(ranges[i], materials[i], meshes[i].bounds,
+                         meshes[i].bounding_sphere, meshes[i].lods);
+    quantization_error_.Extend(meshes[i].packed.error);
+    optimization_stats_.Accumulate(meshes[i].optimization);
+  }
+  AggregateMeshes();
+  mesh_cache::Write(obj_path, meshes);
+}
+
+void Model::Draw(const Shader& shader,
+                 GLuint tex_offset,
+                 bool load_texture,
+                 int lod) const {
+  shader.Use();
+  if (load_texture) {
+    // only arrays that differ from the previous mesh are bound
+    Material::SetSamplers(shader, tex_offset);
+    const auto layers = Material::GetLayersHandle(shader);
+    const Material* previous = nullptr;
+    for (const auto& mesh : meshes_) {
+      mesh.material().Bind(shader, layers, tex_offset, previous);
+      mesh.Draw(shader, tex_offset, false, lod);
+      previous = &mesh.material();
+    }
+    return;
+  }
+  if (meshes_.empty()) return;
+  const int num_levels = static_cast<int>(multi_draws_.size());
+  const MultiDraw& draw =
+      multi_draws_[std::max(0, std::min(lod, num_levels - 1))];
+  // all meshes share position range and index type
+  const MeshRange& range = meshes_.front().range();
+  SetPositionRange(range.position_offset, range.position_scale);
+  glBindVertexArray(vao_);
+  glMultiDrawElementsBaseVertex(
+      GL_TRIANGLES, draw.counts.data(), range.index_type, draw.offsets.data(),
+      static_cast<GLsizei>(draw.counts.size()), draw.base_vertices.data());
+  glBindVertexArray(0);
+}
+
+size_t Model::memory_size() const {
+  size_t size = 0;
+  for (const auto& mesh : meshes_)
+    size += mesh.memory_size();
+  return size;
+}
+
+int Model::SelectLod(const mat4& transform,
+                     const Camera& camera,
+                     float max_pixel_error) const {
+  if (num_lods() <= 1 || max_pixel_error <= 0.0f) return 0;
+  // errors are in model space, and scaled along with the model
+  Sphere sphere = bounding_sphere_.Transform(transform);
+  float scale = bounding_sphere_.radius > 0.0f ?
+      sphere.radius / bounding_sphere_.radius : 1.0f;
+  float distance = glm::length(sphere.center - camera.position()) -
+                   sphere.radius;
+  int lod = 0;
+  for (int i = 1; i < num_lods(); ++i) {
+    if (camera.ProjectedSize(lod_errors_[i] * scale, distance) >
+        max_pixel_error)
+      break;
+    lod = i;
+  }
+  return lod;
+}
+
+void Model::AggregateMeshes() {
+  // bounds_ is extended before uploading, since positions are quantized
+  // within it
+  // sphere around box center that covers spheres of all meshes
+  bounding_sphere_ = Sphere{bounds_.center(), 0.0f};
+  for (const auto& mesh : meshes_) {
+    const Sphere& sphere = mesh.bounding_sphere();
+    bounding_sphere_.radius = std::max(
+        bounding_sphere_.radius,
+        glm::length(sphere.center - bounding_sphere_.center) + sphere.radius);
+  }
+
+  // level is as coarse as its coarsest mesh. meshes with fewer levels draw
+  // their last one
+  int num_levels = 0;
+  for (const auto& mesh : meshes_)
+    num_levels = std::max(num_levels, mesh.num_lods());
+  lod_errors_.assign(num_levels, 0.0f);
+  multi_draws_.assign(num_levels, MultiDraw{});
+  for (int i = 0; i < num_levels; ++i) {
+    MultiDraw& draw = multi_draws_[i];
+    for (const auto& mesh : meshes_) {
+      lod_errors_[i] = std::max(lod_errors_[i], mesh.lod(i).error);
+      draw.counts.emplace_back(mesh.lod(i).num_indices);
+      draw.offsets.emplace_back(
+          reinterpret_cast<const void*>(mesh.IndexOffset(i)));
+      draw.base_vertices.emplace_back(mesh.range().base_vertex);
+    }
+  }
 }
 
 } /* namespace opengl */
@@ -14,40 +14,90 @@
 
 #include <assimp/scene.h>
 
+#include "bounds.h"
+#include "camera.h"
 #include "mesh.h"
+#include "mesh_optimizer.h"
 #include "shader.h"
 
 namespace wrapper {
 namespace opengl {
 
+// all meshes of a model share one vertex buffer and one index buffer, and
+// are drawn as ranges of them with base vertex. positions of all meshes are
+// quantized within bounds of the model
 class Model {
  public:
   Model(const std::string& obj_path, const std::string& tex_path = "");
 
+  // if textures are not loaded, e.g. for shadow maps, meshes are not
+  // distinguished and all of them are drawn with a single call
   void Draw(const Shader& shader,
             GLuint tex_offset = 0,
-            bool load_texture = true) const {
-    shader.Use();
-    for (const auto& mesh : meshes_)
-      mesh.Draw(shader, tex_offset, load_texture);
-  }
+            bool load_texture = true,
+            int lod = 0) const;
 
   void DrawInstanced(const Shader& shader,
                      GLuint amount,
                      GLuint tex_offset = 0,
-                     bool load_texture = true) const {
+                     bool load_texture = true,
+                     int lod = 0) const {
     shader.Use();
     for (const auto& mesh : meshes_)
-      mesh.DrawInstanced(shader, amount, tex_offset, load_texture);
+      mesh.DrawInstanced(shader, amount, tex_offset, load_texture, lod);
   }
 
+  // returns the coarsest level of detail whose error, projected to screen
+  // with model transformed by transform, stays within max_pixel_error. error
+  // is a distance from full detail averaged over the surface (see
+  // mesh_simplifier::Simplify), so a few pixels may deviate by more.
+  // non-positive max_pixel_error always selects full detail
+  int SelectLod(const glm::mat4& transform,
+                const Camera& camera,
+                float max_pixel_error) const;
+
+  // calls func with VAO of the model bound
   void AppendData(const std::function<void ()>& func) const {
-    for (const auto& mesh : meshes_)
-      mesh.AppendData(func);
+    glBindVertexArray(vao_);
+    func();
+    glBindVertexArray(0);
+  }
+
+  const std::vector<Mesh>& meshes() const { return meshes_; }
+  // in model space
+  const AABB& bounds() const { return bounds_; }
+  const Sphere& bounding_sphere() const { return bounding_sphere_; }
+  int num_lods() const { return static_cast<int>(lod_errors_.size()); }
+  // of vertex and index buffers of all meshes
+  size_t memory_size() const;
+  // largest of all meshes, caused by packing vertices
+  const QuantizationError& quantization_error() const {
+    return quantization_error_;
+  }
+  // post-transform cache efficiency of all meshes, before and after import
+  // optimization
+  const mesh_optimizer::Stats& optimization_stats() const {
+    return optimization_stats_;
   }
 
  private:
+  // arguments of glMultiDrawElementsBaseVertex for each level of detail
+  struct MultiDraw {
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> base_vertices;
+  };
+
+  GLuint vao_, vbo_, ebo_;
+  AABB bounds_;
+  Sphere bounding_sphere_;
+  QuantizationError quantization_error_;
+  mesh_optimizer::Stats optimization_stats_;
+  std::vector<float> lod_errors_;  // largest of all meshes at each level
   std::vector<Mesh> meshes_;
+  std::vector<MultiDraw> multi_draws_;
+
+  void AggregateMeshes();
 };
 
 } /* namespace opengl */
@@ -0,0 +1,176 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace wrapper {
+namespace opengl {
+namespace {
+
+const double kSmoothing{0.9};
+
+} /* namespace */
+
+double FrameStats::Percentile(double fraction) const {
+  if (frame_times_.empty()) return 0.0;
+  vector<double> sorted{frame_times_};
+  // nearest-rank method
+  size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+  size_t index = std::min(std::max(rank, size_t{1}), sorted.size()) - 1;
+  std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+  return sorted[index];
+}
+
+double FrameStats::Mean() const {
+  if (frame_times_.empty()) return 0.0;
+  return std::accumulate(frame_times_.begin(), frame_times_.end(), 0.0) /
+      frame_times_.size();
+}
+
+void FrameStats::Print(std::ostream& out) const {
+  // print in milliseconds
+  std::ios::fmtflags flags = out.flags();
+  out << std::fixed << std::setprecision(3)
+      << "frames: " << num_frames() << '\n'
+      << "mean:   " << Mean() * 1000.0 << " ms" << '\n'
+      << "p50:    " << Percentile(0.50) * 1000.0 << " ms" << '\n'
+      << "p95:    " << Percentile(0.95) * 1000.0 << " ms" << '\n'
+      << "p99:    " << Percentile(0.99) * 1000.0 << " ms" << std::endl;
+  out.flags(flags);
+}
+
+GpuProfiler::GpuProfiler(bool enabled,
+                         const string& output_path,
+                         int num_frames_in_flight)
+    : enabled_{enabled}, in_zone_{false}, frame_index_{-1}, num_dropped_{0},
+      collected_frame_{-1}, collected_frame_ms_{0.0},
+      slots_(num_frames_in_flight, FrameSlot{{}, {}, -1}) {
+  if (!enabled_ || output_path.empty()) return;
+  output_.open(output_path);
+  if (!output_.is_open())
+    throw runtime_error{"Failed to open file: " + output_path};
+  output_ << "frame,zone,gpu_ms,primitives,samples" << std::endl;
+}
+
+GpuProfiler::~GpuProfiler() {
+  for (auto& slot : slots_) {
+    for (auto& query : slot.queries)
+      glDeleteQueries(4, &query.begin);
+  }
+}
+
+void GpuProfiler::BeginFrame() {
+  if (!enabled_) return;
+  if (in_zone_) throw runtime_error{"Zone not ended"};
+  ++frame_index_;
+  FrameSlot& slot = slots_[frame_index_ % slots_.size()];
+  if (slot.frame_index >= 0) Collect(&slot);
+  slot.zone_ids.clear();
+  slot.frame_index = frame_index_;
+}
+
+void GpuProfiler::BeginZone(const string& name) {
+  if (!enabled_) return;
+  if (frame_index_ < 0) throw runtime_error{"Frame not begun"};
+  if (in_zone_) throw runtime_error{"Zones cannot nest: " + name};
+  in_zone_ = true;
+
+  auto found = zone_ids_.find(name);
+  if (found == zone_ids_.end()) {
+    found = zone_ids_.insert({name, (int)zone_stats_.size()}).first;
+    zone_stats_.emplace_back(ZoneStats{name, 0.0, 0.0, 0, 0, 0});
+  }
+
+  FrameSlot& slot = slots_[frame_index_ % slots_.size()];
+  if (slot.zone_ids.size() == slot.queries.size()) {
+    // query objects are reused once created
+    Query query;
+    glGenQueries(4, &query.begin);
+    slot.queries.emplace_back(query);
+  }
+  const Query& query = slot.queries[slot.zone_ids.size()];
+  slot.zone_ids.emplace_back(found->second);
+
+  glQueryCounter(query.begin, GL_TIMESTAMP);
+  glBeginQuery(GL_PRIMITIVES_GENERATED, query.primitives);
+  glBeginQuery(GL_SAMPLES_PASSED, query.samples);
+}
+
+void GpuProfiler::EndZone() {
+  if (!enabled_) return;
+  if (!in_zone_) throw runtime_error{"Zone not begun"};
+  in_zone_ = false;
+
+  const FrameSlot& slot = slots_[frame_index_ % slots_.size()];
+  const Query& query = slot.queries[slot.zone_ids.size() - 1];
+  glEndQuery(GL_SAMPLES_PASSED);
+  glEndQuery(GL_PRIMITIVES_GENERATED);
+  glQueryCounter(query.end, GL_TIMESTAMP);
+}
+
+void GpuProfiler::Collect(FrameSlot* slot) {
+  if (slot->zone_ids.empty()) return;
+
+  // queries finish in order, so if the last one is available, so are others.
+  // otherwise drop this frame rather than stall the pipeline
+  const Query& last = slot->queries[slot->zone_ids.size() - 1];
+  GLint available;
+  glGetQueryObjectiv(last.end, GL_QUERY_RESULT_AVAILABLE, &available);
+  if (available) glGetQueryObjectiv(last.samples, GL_QUERY_RESULT_AVAILABLE,
+                                    &available);
+  if (!available) {
+    ++num_dropped_;
+    return;
+  }
+
+  double frame_ms = 0.0;
+  for (size_t i = 0; i < slot->zone_ids.size(); ++i) {
+    const Query& query = slot->queries[i];
+    GLuint64 begin, end, primitives, samples;
+    glGetQueryObjectui64v(query.begin, GL_QUERY_RESULT, &begin);
+    glGetQueryObjectui64v(query.end, GL_QUERY_RESULT, &end);
+    glGetQueryObjectui64v(query.primitives, GL_QUERY_RESULT, &primitives);
+    glGetQueryObjectui64v(query.samples, GL_QUERY_RESULT, &samples);
+    double elapsed_ms = (end - begin) / 1e6; // timestamps are in nanoseconds
+    frame_ms += elapsed_ms;
+
+    ZoneStats& stats = zone_stats_[slot->zone_ids[i]];
+    stats.gpu_ms = stats.num_samples == 0 ? elapsed_ms :
+        stats.gpu_ms * kSmoothing + elapsed_ms * (1.0 - kSmoothing);
+    stats.total_ms += elapsed_ms;
+    ++stats.num_samples;
+    stats.primitives = primitives;
+    stats.samples = samples;
+
+    if (output_.is_open()) {
+      output_ << slot->frame_index << ',' << stats.name << ','
+              << elapsed_ms << ',' << primitives << ',' << samples << '\n';
+    }
+  }
+  collected_frame_ = slot->frame_index;
+  collected_frame_ms_ = frame_ms;
+}
+
+void GpuProfiler::Print(std::ostream& out) const {
+  if (!enabled_) return;
+  std::ios::fmtflags flags = out.flags();
+  out << std::fixed << std::setprecision(3);
+  for (const auto& stats : zone_stats_) {
+    double mean_ms = stats.num_samples ? stats.total_ms / stats.num_samples : 0;
+    out << std::left << std::setw(16) << stats.name << std::right
+        << std::setw(9) << mean_ms << " ms"
+        << std::setw(12) << stats.primitives << " prims"
+        << std::setw(12) << stats.samples << " samples" << '\n';
+  }
+  out << "dropped frames: " << num_dropped_ << std::endl;
+  out.flags(flags);
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
@@ -0,0 +1,92 @@
+#ifndef WRAPPER_OPENGL_PROFILER_H
+#define WRAPPER_OPENGL_PROFILER_H
+
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+
+namespace wrapper {
+namespace opengl {
+
+class FrameStats {
+ public:
+  void AddFrame(double seconds) { frame_times_.emplace_back(seconds); }
+  // returns frame time (in seconds) below which the given fraction of frames
+  // fall, where fraction is in range [0, 1]
+  double Percentile(double fraction) const;
+  double Mean() const;
+  void Print(std::ostream& out) const;
+  size_t num_frames() const { return frame_times_.size(); }
+
+ private:
+  std::vector<double> frame_times_;
+};
+
+// measures GPU time of zones in a frame with GL_TIMESTAMP queries, and counts
+// primitives generated and samples passed in each zone. zones must not nest,
+// since only one query of each type can be active at a time. queries of the
+// last few frames are kept in a ring and read back only after they become
+// available, so the CPU never waits for the GPU
+class GpuProfiler {
+ public:
+  struct ZoneStats {
+    std::string name;
+    double gpu_ms;      // smoothed over recent frames
+    double total_ms;    // accumulated over all collected frames
+    int num_samples;
+    GLuint64 primitives;
+    GLuint64 samples;
+  };
+
+  // if output_path is not empty, results of every frame are written to it
+  // in CSV format
+  GpuProfiler(bool enabled,
+              const std::string& output_path = "",
+              int num_frames_in_flight = 4);
+  GpuProfiler(const GpuProfiler&) = delete;
+  GpuProfiler& operator=(const GpuProfiler&) = delete;
+  ~GpuProfiler();
+
+  void BeginFrame();
+  void BeginZone(const std::string& name);
+  void EndZone();
+  void Print(std::ostream& out) const;
+  bool enabled() const { return enabled_; }
+  const std::vector<ZoneStats>& zone_stats() const { return zone_stats_; }
+  // GPU time of all zones of the latest collected frame, which is a few
+  // frames behind the current one, and index of that frame (-1 if none)
+  double collected_frame_ms() const { return collected_frame_ms_; }
+  long collected_frame() const { return collected_frame_; }
+
+ private:
+  struct Query {
+    GLuint begin, end, primitives, samples;
+  };
+  struct FrameSlot {
+    std::vector<Query> queries;
+    std::vector<int> zone_ids;
+    long frame_index;
+  };
+
+  bool enabled_;
+  bool in_zone_;
+  long frame_index_;
+  int num_dropped_;
+  long collected_frame_;
+  double collected_frame_ms_;
+  std::vector<FrameSlot> slots_;
+  std::vector<ZoneStats> zone_stats_;
+  std::unordered_map<std::string, int> zone_ids_;
+  std::ofstream output_;
+
+  void Collect(FrameSlot* slot);
+};
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_PROFILER_H */
@@ -0,0 +1,117 @@
+#include "program_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "mapped_file.h"
+
+using std::string;
+using std::vector;
+
+namespace wrapper {
+namespace opengl {
+namespace program_cache {
+namespace {
+
+const char kMagic[8]{'L', 'O', 'G', 'L', 'P', 'R', 'O', 'G'};
+const uint32_t kVersion{1};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t binary_format;
+  uint64_t key;
+  uint64_t binary_size;  // followed by binary
+};
+
+} /* namespace */
+
+bool IsSupported() {
+  // core since 4.1, otherwise needs ARB_get_program_binary. without either,
+  // the query is an invalid enum and leaves the value untouched. entry points
+  // are checked as well, since GLAD leaves them null if it was generated
+  // without the extension, even where the driver supports it
+  static const bool kSupported = []() {
+    if (glProgramBinary == nullptr || glGetProgramBinary == nullptr ||
+        glProgramParameteri == nullptr)
+      return false;
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    while (glGetError() != GL_NO_ERROR) {}
+    return num_formats > 0;
+  }();
+  return kSupported;
+}
+
+void MarkRetrievable(GLuint program) {
+  if (IsSupported())
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+GLuint Load(const string& cache_path, uint64_t key) {
+  if (!IsSupported()) return 0;
+  auto file = MappedFile::Open(cache_path);
+  if (!file || !file->InRange(0, sizeof(Header))) return 0;
+  const auto* header = reinterpret_cast<const Header*>(file->data());
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header->version != kVersion || header->key != key ||
+      !file->InRange(sizeof(Header), header->binary_size))
+    return 0;
+
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, header->binary_format,
+                  file->data() + sizeof(Header),
+                  static_cast<GLsizei>(header->binary_size));
+  GLint success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  if (!success) {
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+void Write(const string& cache_path, uint64_t key, GLuint program) {
+  if (!IsSupported()) return;
+  GLint binary_size;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binary_size);
+  if (binary_size <= 0) return;
+
+  vector<char> buffer(sizeof(Header) + binary_size);
+  GLenum binary_format;
+  GLsizei written;
+  glGetProgramBinary(program, binary_size, &written, &binary_format,
+                     buffer.data() + sizeof(Header));
+  if (written <= 0) return;
+
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.binary_format = binary_format;
+  header.key = key;
+  header.binary_size = static_cast<uint64_t>(written);
+  std::memcpy(buffer.data(), &header, sizeof(Header));
+  buffer.resize(sizeof(Header) + written);
+
+  // write to a temporary file first, so that other processes never see a
+  // partially written cache
+  string temp_path = cache_path + ".tmp";
+  {
+    std::ofstream file{temp_path, std::ios::binary | std::ios::trunc};
+    if (!file.is_open()) return;
+    file.write(buffer.data(), buffer.size());
+    if (!file.good()) {
+      file.close();
+      std::remove(temp_path.c_str());
+      return;
+    }
+  }
+  if (std::rename(temp_path.c_str(), cache_path.c_str()) != 0)
+    std::remove(temp_path.c_str());
+}
+
+} /* namespace program_cache */
+} /* namespace opengl */
+} /* namespace wrapper */
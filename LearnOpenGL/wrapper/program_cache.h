@@ -0,0 +1,32 @@
+#ifndef WRAPPER_OPENGL_PROGRAM_CACHE_H
+#define WRAPPER_OPENGL_PROGRAM_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include <glad/glad.h>
+
+namespace wrapper {
+namespace opengl {
+namespace program_cache {
+
+// on-disk cache of linked program binaries. key should identify everything
+// that affects the binary: shader sources and the driver. a binary is only
+// used if its key matches, and the driver may still reject it (e.g. after
+// updating), in which case program should be compiled from source
+
+// whether driver can save and load program binaries. must be called with
+// GL context
+bool IsSupported();
+// should be called before linking a program that will be written
+void MarkRetrievable(GLuint program);
+// returns 0 if cache does not exist, does not match key or is rejected
+GLuint Load(const std::string& cache_path, uint64_t key);
+// fails silently, since the asset directory may be read-only
+void Write(const std::string& cache_path, uint64_t key, GLuint program);
+
+} /* namespace program_cache */
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_PROGRAM_CACHE_H */
@@ -0,0 +1,187 @@
+#include "render_queue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+using glm::mat4;
+using std::vector;
+
+namespace wrapper {
+namespace opengl {
+namespace {
+
+const int kPassBits{4};
+const int kProgramBits{8};
+const int kMaterialBits{16};
+// of material bits, for layers within a group of arrays
+const int kLayerBits{8};
+const int kDepthBits{24};
+
+uint64_t Mask(int bits) { return (uint64_t{1} << bits) - 1; }
+
+// non-negative floats compare the same as their bit patterns. the sign bit is
+// always 0, and low bits of mantissa are dropped
+uint64_t QuantizeDepth(float depth) {
+  depth = std::max(depth, 0.0f);
+  uint32_t bits;
+  std::memcpy(&bits, &depth, sizeof(bits));
+  return bits >> (31 - kDepthBits);
+}
+
+// opaque:      pass | program | material | depth | unused
+// transparent: pass | ~depth  | program  | material | unused
+uint64_t MakeKey(int pass, bool transparent, uint64_t program,
+                 uint64_t material, uint64_t depth) {
+  uint64_t key = static_cast<uint64_t>(pass) << (64 - kPassBits);
+  if (transparent) {
+    depth = Mask(kDepthBits) - depth;
+    int shift = 64 - kPassBits - kDepthBits;
+    key |= depth << shift;
+    key |= program << (shift -= kProgramBits);
+    key |= material << (shift - kMaterialBits);
+  } else {
+    int shift = 64 - kPassBits - kProgramBits;
+    key |= program << shift;
+    key |= material << (shift -= kMaterialBits);
+    key |= depth << (shift - kDepthBits);
+  }
+  return key;
+}
+
+} /* namespace */
+
+void RenderQueue::AddPass(int pass,
+                          bool transparent,
+                          const std::function<void ()>& pass_state) {
+  if (pass < 0 || static_cast<uint64_t>(pass) > Mask(kPassBits))
+    throw std::runtime_error{"Pass out of range"};
+  passes_[pass] = Pass{transparent, pass_state};
+}
+
+void RenderQueue::AddProgram(
+    const Shader& shader,
+    GLuint tex_offset,
+    const std::function<void ()>& on_bind,
+    const std::function<void (const DrawItem&)>& per_item) {
+  auto found = programs_.find(shader.program_id());
+  uint64_t index = found == programs_.end() ? programs_.size()
+                                            : found->second.index;
+  if (index > Mask(kProgramBits))
+    throw std::runtime_error{"Too many programs in render queue"};
+  shader.Use();
+  Material::SetSamplers(shader, tex_offset);
+  programs_[shader.program_id()] = Program{
+      index, tex_offset, Material::GetLayersHandle(shader), on_bind, per_item};
+}
+
+uint64_t RenderQueue::MaterialIndex(const Material& material) {
+  auto found = materials_.find(&material);
+  if (found != materials_.end()) return found->second;
+
+  std::array<GLuint, kNumMaterialSlots> arrays;
+  std::array<GLint, kNumMaterialSlots> layers;
+  for (int i = 0; i < kNumMaterialSlots; ++i) {
+    const TextureLayer& slot = material.slot(static_cast<TextureType>(i));
+    arrays[i] = slot.array;
+    layers[i] = slot.layer;
+  }
+  uint64_t group = array_groups_.insert(
+      {arrays, array_groups_.size()}).first->second;
+  if (group > Mask(kMaterialBits - kLayerBits))
+    throw std::runtime_error{"Too many texture arrays in render queue"};
+
+  // local indices are counted per group
+  auto begin = material_indices_.lower_bound({group, {}});
+  auto end = material_indices_.lower_bound({group + 1, {}});
+  uint64_t num_in_group = std::distance(begin, end);
+  auto inserted = material_indices_.insert(
+      {{group, layers}, (group << kLayerBits) | num_in_group});
+  if (inserted.second && num_in_group > Mask(kLayerBits))
+    throw std::runtime_error{"Too many materials in render queue"};
+  uint64_t index = inserted.first->second;
+  materials_[&material] = index;
+  return index;
+}
+
+void RenderQueue::Submit(int pass,
+                         const Shader& shader,
+                         const Model& model,
+                         const mat4& transform,
+                         float depth,
+                         int index,
+                         GLsizei num_instances,
+                         const Material* material,
+                         int lod) {
+  const Pass& pass_info = passes_.at(pass);
+  uint64_t program = programs_.at(shader.program_id()).index;
+  uint64_t quantized_depth = QuantizeDepth(depth);
+  for (const auto& mesh : model.meshes()) {
+    const Material* mesh_material = material ? material : &mesh.material();
+    uint64_t key = MakeKey(pass, pass_info.transparent, program,
+                           MaterialIndex(*mesh_material), quantized_depth);
+    keys_.emplace_back(key, items_.size());
+    items_.emplace_back(DrawItem{pass, &shader, &mesh, mesh_material,
+                                 transform, num_instances, index,
+                                 mesh.ClampLod(lod)});
+  }
+}
+
+void RenderQueue::Flush() {
+  std::sort(keys_.begin(), keys_.end());
+  stats_ = Stats{static_cast<int>(items_.size()), 0, 0, 0, {}};
+
+  int pass = -1;
+  const Program* program = nullptr;
+  const Material* material = nullptr;
+  // units are not per program, so arrays bound for one program are still
+  // there for the next one if it uses the same units
+  const Material* bound = nullptr;
+  GLuint bound_offset = 0;
+  for (const auto& key : keys_) {
+    const DrawItem& item = items_[key.second];
+    if (item.pass != pass) {
+      pass = item.pass;
+      passes_.at(pass).pass_state();
+    }
+    const Program* item_program = &programs_.at(item.shader->program_id());
+    if (item_program != program) {
+      program = item_program;
+      item.shader->Use();
+      if (program->on_bind) program->on_bind();
+      material = nullptr;  // layers are per program
+      ++stats_.num_program_changes;
+    }
+    // materials with same textures share one index, so compare indices
+    // rather than pointers
+    if (!material ||
+        MaterialIndex(*material) != MaterialIndex(*item.material)) {
+      material = item.material;
+      const Material* previous =
+          bound_offset == program->tex_offset ? bound : nullptr;
+      stats_.num_texture_binds += material->Bind(
+          *item.shader, program->layers, program->tex_offset, previous);
+      if (!material->empty()) {
+        bound = material;
+        bound_offset = program->tex_offset;
+      }
+      ++stats_.num_material_changes;
+    }
+    if (program->per_item) program->per_item(item);
+    if (item.num_instances > 0) {
+      item.mesh->DrawInstanced(*item.shader, item.num_instances,
+                               program->tex_offset, false, item.lod);
+    } else {
+      item.mesh->Draw(*item.shader, program->tex_offset, false, item.lod);
+    }
+    stats_.num_triangles[item.lod] +=
+        item.mesh->lod(item.lod).num_indices / 3 *
+        static_cast<size_t>(std::max(item.num_instances, 1));
+  }
+  keys_.clear();
+  items_.clear();
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
@@ -0,0 +1,115 @@
+#ifndef WRAPPER_OPENGL_RENDER_QUEUE_H
+#define WRAPPER_OPENGL_RENDER_QUEUE_H
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "material.h"
+#include "mesh.h"
+#include "model.h"
+#include "shader.h"
+
+namespace wrapper {
+namespace opengl {
+
+struct DrawItem {
+  int pass;
+  const Shader* shader;
+  const Mesh* mesh;
+  const Material* material;
+  glm::mat4 transform;
+  GLsizei num_instances;  // 0 if not instanced
+  int index;              // defined by caller, e.g. index of light
+  int lod;                // level of detail
+};
+
+// collects draws of a frame and submits them sorted by a 64-bit key, so that
+// programs and textures are only switched when they actually change. from
+// high to low bits, the key holds pass, program, material and depth, nearest
+// first. materials whose textures are in the same arrays get adjacent
+// indices, so switching between them only changes layers. in transparent
+// passes depth comes before program and furthest is drawn first, as
+// blending requires
+class RenderQueue {
+ public:
+  struct Stats {
+    int num_items;
+    int num_program_changes;
+    int num_material_changes;
+    int num_texture_binds;
+    // triangles drawn at each level of detail, counting all instances
+    size_t num_triangles[kMaxLods];
+  };
+
+  // pass_state is called before the first item of a pass is drawn, and should
+  // set all fixed-function state that the pass depends on. passes are drawn
+  // in increasing order. at most 16 passes
+  void AddPass(int pass,
+               bool transparent,
+               const std::function<void ()>& pass_state);
+  // on_bind is called right after the program is put in use, to set uniforms
+  // shared by all items. per_item is called before each item is drawn, to set
+  // uniforms such as model matrix. materials of items are bound to units from
+  // tex_offset, and samplers are set here once
+  void AddProgram(const Shader& shader,
+                  GLuint tex_offset,
+                  const std::function<void ()>& on_bind,
+                  const std::function<void (const DrawItem&)>& per_item);
+
+  // adds an item for each mesh of model. depth is distance to camera along
+  // view direction. material, if not null, replaces materials of all meshes,
+  // and must stay alive while the queue is in use
+  void Submit(int pass,
+              const Shader& shader,
+              const Model& model,
+              const glm::mat4& transform,
+              float depth,
+              int index = 0,
+              GLsizei num_instances = 0,
+              const Material* material = nullptr,
+              int lod = 0);
+  // draws all items in key order, and clears the queue
+  void Flush();
+  // of the last flush
+  const Stats& stats() const { return stats_; }
+
+ private:
+  struct Pass {
+    bool transparent;
+    std::function<void ()> pass_state;
+  };
+  struct Program {
+    uint64_t index;
+    GLuint tex_offset;
+    UniformHandle<glm::vec3> layers;
+    std::function<void ()> on_bind;
+    std::function<void (const DrawItem&)> per_item;
+  };
+
+  std::unordered_map<int, Pass> passes_;
+  std::unordered_map<GLuint, Program> programs_;
+  // material indices are (group of arrays, layers within group), so that
+  // meshes sharing textures are drawn together. cached per material
+  std::map<std::array<GLuint, kNumMaterialSlots>, uint64_t> array_groups_;
+  std::map<std::pair<uint64_t, std::array<GLint, kNumMaterialSlots>>,
+           uint64_t> material_indices_;
+  std::unordered_map<const Material*, uint64_t> materials_;
+  std::vector<DrawItem> items_;
+  std::vector<std::pair<uint64_t, size_t>> keys_;  // (key, index of item)
+  Stats stats_{};
+
+  uint64_t MaterialIndex(const Material& material);
+};
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_RENDER_QUEUE_H */
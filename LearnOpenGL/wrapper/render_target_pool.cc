@@ -0,0 +1,121 @@
+#include "render_target_pool.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+namespace wrapper {
+namespace opengl {
+namespace {
+
+struct PixelFormat {
+  // required by glTexImage2D along with internal format, although no data
+  // is uploaded
+  GLenum format, type;
+  size_t bytes;
+};
+
+PixelFormat GetPixelFormat(GLenum internal_format) {
+  switch (internal_format) {
+    case GL_R11F_G11F_B10F:
+      // no alpha and no sign, which HDR color needs neither
+      return {GL_RGB, GL_FLOAT, 4};
+    case GL_RGB16F:
+      // most drivers store it as GL_RGBA16F
+      return {GL_RGB, GL_FLOAT, 8};
+    case GL_RGBA16F:
+      return {GL_RGBA, GL_FLOAT, 8};
+    case GL_RGBA8:
+      return {GL_RGBA, GL_UNSIGNED_BYTE, 4};
+    case GL_DEPTH24_STENCIL8:
+      return {GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 4};
+    default:
+      throw std::runtime_error{"Unsupported render target format: " +
+                               std::to_string(internal_format)};
+  }
+}
+
+} /* namespace */
+
+RenderTargetPool::RenderTargetPool(int max_idle_frames)
+    : max_idle_frames_{max_idle_frames}, frame_{0}, num_allocations_{0},
+      memory_size_{0}, peak_memory_size_{0} {}
+
+RenderTargetPool::~RenderTargetPool() {
+  for (const auto& target : targets_)
+    glDeleteTextures(1, &target.texture);
+}
+
+size_t RenderTargetPool::MemorySize(const RenderTargetDesc& desc) {
+  return static_cast<size_t>(desc.width) * desc.height *
+      std::max(desc.samples, 1) * GetPixelFormat(desc.internal_format).bytes;
+}
+
+GLuint RenderTargetPool::Acquire(const RenderTargetDesc& desc,
+                                 GLenum filter) {
+  const GLenum target_type = desc.samples > 0 ? GL_TEXTURE_2D_MULTISAMPLE
+                                              : GL_TEXTURE_2D;
+  auto found = std::find_if(
+      targets_.begin(), targets_.end(), [&](const Target& target) {
+        return !target.in_use && target.desc == desc;
+      });
+  if (found == targets_.end()) {
+    PixelFormat format = GetPixelFormat(desc.internal_format);
+    Target target{0, desc, false, frame_};
+    glGenTextures(1, &target.texture);
+    glBindTexture(target_type, target.texture);
+    if (desc.samples > 0) {
+      glTexImage2DMultisample(target_type, desc.samples, desc.internal_format,
+                              desc.width, desc.height, GL_TRUE);
+    } else {
+      glTexImage2D(target_type, 0, desc.internal_format, desc.width,
+                   desc.height, 0, format.format, format.type, NULL);
+      glTexParameteri(target_type, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(target_type, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    targets_.emplace_back(target);
+    found = targets_.end() - 1;
+    ++num_allocations_;
+    memory_size_ += MemorySize(desc);
+    peak_memory_size_ = std::max(peak_memory_size_, memory_size_);
+  } else {
+    glBindTexture(target_type, found->texture);
+  }
+  // whoever used it last may have filtered differently. multisampled
+  // textures cannot be filtered
+  if (desc.samples == 0) {
+    glTexParameteri(target_type, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(target_type, GL_TEXTURE_MAG_FILTER, filter);
+  }
+  glBindTexture(target_type, 0);
+  found->in_use = true;
+  found->last_used = frame_;
+  return found->texture;
+}
+
+void RenderTargetPool::Release(GLuint texture) {
+  if (texture == 0) return;
+  auto found = std::find_if(
+      targets_.begin(), targets_.end(),
+      [=](const Target& target) { return target.texture == texture; });
+  if (found == targets_.end() || !found->in_use)
+    throw std::runtime_error{"Texture not acquired from pool"};
+  found->in_use = false;
+  found->last_used = frame_;
+}
+
+void RenderTargetPool::EndFrame() {
+  ++frame_;
+  auto idle = std::remove_if(
+      targets_.begin(), targets_.end(), [this](const Target& target) {
+        if (target.in_use || frame_ - target.last_used <= max_idle_frames_)
+          return false;
+        glDeleteTextures(1, &target.texture);
+        memory_size_ -= MemorySize(target.desc);
+        return true;
+      });
+  targets_.erase(idle, targets_.end());
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
@@ -0,0 +1,77 @@
+#ifndef WRAPPER_OPENGL_RENDER_TARGET_POOL_H
+#define WRAPPER_OPENGL_RENDER_TARGET_POOL_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+
+namespace wrapper {
+namespace opengl {
+
+struct RenderTargetDesc {
+  int width, height;
+  GLenum internal_format;
+  int samples;  // 0 if not multisampled
+
+  bool operator==(const RenderTargetDesc& other) const {
+    return width == other.width && height == other.height &&
+        internal_format == other.internal_format && samples == other.samples;
+  }
+};
+
+// hands out textures to render to, keyed by size, format and samples.
+// released textures are kept and handed out again for the same key. targets
+// that only live through a few passes of a frame should be released right
+// after their last reader is issued, so that passes later in the frame (or
+// in the next frame) asking for the same key reuse the same memory, which
+// is safe since commands of a context execute in order. when render
+// resolution goes back and forth between a few sizes, targets of each size
+// are allocated only once. textures that stay released for max_idle_frames
+// are deleted. multisampled targets are GL_TEXTURE_2D_MULTISAMPLE, others
+// are GL_TEXTURE_2D
+class RenderTargetPool {
+ public:
+  explicit RenderTargetPool(int max_idle_frames = 300);
+  RenderTargetPool(const RenderTargetPool&) = delete;
+  RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+  ~RenderTargetPool();
+
+  // filter is used for both minifying and magnifying, and texture coordinates
+  // are clamped to edge. filter is ignored if multisampled. content is
+  // undefined
+  GLuint Acquire(const RenderTargetDesc& desc, GLenum filter = GL_LINEAR);
+  // texture must have been acquired from this pool. 0 is ignored
+  void Release(GLuint texture);
+  // deletes textures that have been idle for too long
+  void EndFrame();
+
+  int num_textures() const { return static_cast<int>(targets_.size()); }
+  // times a texture had to be allocated
+  int num_allocations() const { return num_allocations_; }
+  // bytes of all textures held by pool, including idle ones, and the most
+  // ever held. sizes are estimated from formats, since drivers may pad them
+  size_t memory_size() const { return memory_size_; }
+  size_t peak_memory_size() const { return peak_memory_size_; }
+  static size_t MemorySize(const RenderTargetDesc& desc);
+
+ private:
+  struct Target {
+    GLuint texture;
+    RenderTargetDesc desc;
+    bool in_use;
+    long last_used;  // frame
+  };
+
+  int max_idle_frames_;
+  long frame_;
+  int num_allocations_;
+  size_t memory_size_;
+  size_t peak_memory_size_;
+  std::vector<Target> targets_;
+};
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_RENDER_TARGET_POOL_H */
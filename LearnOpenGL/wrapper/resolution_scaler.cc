@@ -0,0 +1,84 @@
+#include "resolution_scaler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+namespace wrapper {
+namespace opengl {
+namespace {
+
+// frames averaged before deciding
+const size_t kWindowSize{8};
+// frames ignored after a change. GPU time is read back a few frames late
+// (see GpuProfiler), so these were still rendered at the previous scale
+const int kSettleFrames{6};
+// fraction of budget aimed at when dropping, and that must not be exceeded
+// after rising. the gap between exceeding the budget and this is hysteresis
+const double kDropTarget{0.9};
+const double kRiseLimit{0.8};
+
+} /* namespace */
+
+ResolutionScaler::ResolutionScaler(double target_ms,
+                                   float min_scale,
+                                   float max_scale,
+                                   int num_steps)
+    : target_ms_{target_ms}, min_scale_{min_scale}, max_scale_{max_scale},
+      num_steps_{num_steps}, step_{num_steps}, num_ignored_{0},
+      num_changes_{0} {
+  if (target_ms <= 0.0 || num_steps <= 0 || min_scale <= 0.0f ||
+      min_scale >= max_scale)
+    throw std::runtime_error{"Invalid resolution scaler parameters"};
+  window_.reserve(kWindowSize);
+}
+
+float ResolutionScaler::StepScale(int step) const {
+  return min_scale_ + (max_scale_ - min_scale_) * step / num_steps_;
+}
+
+float ResolutionScaler::scale() const {
+  return StepScale(step_);
+}
+
+void ResolutionScaler::SetStep(int step) {
+  step_ = step;
+  window_.clear();
+  num_ignored_ = 0;
+  ++num_changes_;
+}
+
+bool ResolutionScaler::AddFrame(double gpu_ms) {
+  if (num_changes_ > 0 && num_ignored_ < kSettleFrames) {
+    ++num_ignored_;
+    return false;
+  }
+  window_.emplace_back(gpu_ms);
+  if (window_.size() < kWindowSize) return false;
+
+  double mean_ms = std::accumulate(window_.begin(), window_.end(), 0.0) /
+      window_.size();
+  window_.clear();
+
+  // GPU time is assumed to be proportional to scale squared
+  const float scale = StepScale(step_);
+  if (mean_ms > target_ms_ && step_ > 0) {
+    float wanted = scale * std::sqrt(target_ms_ * kDropTarget / mean_ms);
+    int step = static_cast<int>(std::floor(
+        (wanted - min_scale_) / (max_scale_ - min_scale_) * num_steps_));
+    SetStep(std::max(0, std::min(step, step_ - 1)));
+    return true;
+  }
+  if (step_ < num_steps_) {
+    float ratio = StepScale(step_ + 1) / scale;
+    if (mean_ms * ratio * ratio < target_ms_ * kRiseLimit) {
+      SetStep(step_ + 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
@@ -0,0 +1,47 @@
+#ifndef WRAPPER_OPENGL_RESOLUTION_SCALER_H
+#define WRAPPER_OPENGL_RESOLUTION_SCALER_H
+
+#include <vector>
+
+namespace wrapper {
+namespace opengl {
+
+// picks the scale of render resolution (of each axis) from GPU time of
+// recent frames, so that frames fit in a budget. scale moves in num_steps
+// even steps between min_scale and max_scale, so that only a few sizes of
+// render targets are ever needed. it drops as soon as the average of a
+// window of frames exceeds the budget, by as many steps as GPU time is
+// expected to need, assuming it is proportional to the number of pixels. it
+// rises one step at a time, only if that is still expected to leave some
+// headroom. after each change, frames are ignored until timings of the new
+// scale arrive, so that it does not oscillate
+class ResolutionScaler {
+ public:
+  // target_ms is the budget of GPU time per frame
+  explicit ResolutionScaler(double target_ms,
+                            float min_scale = 0.5f,
+                            float max_scale = 1.0f,
+                            int num_steps = 8);
+
+  // gpu_ms is of a frame recently rendered. returns whether scale changed
+  bool AddFrame(double gpu_ms);
+  float scale() const;
+  int num_changes() const { return num_changes_; }
+
+ private:
+  double target_ms_;
+  float min_scale_, max_scale_;
+  int num_steps_;
+  int step_;  // from 0 (min_scale) to num_steps_ (max_scale)
+  int num_ignored_;
+  int num_changes_;
+  std::vector<double> window_;
+
+  float StepScale(int step) const;
+  void SetStep(int step);
+};
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_RESOLUTION_SCALER_H */
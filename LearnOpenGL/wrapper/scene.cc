@@ -0,0 +1,209 @@
+#include "scene.h"
+
+#include <stdexcept>
+#include <string>
+
+using glm::mat4;
+using std::vector;
+
+namespace wrapper {
+namespace opengl {
+namespace {
+
+AABB Union(const AABB& a, const AABB& b) {
+  AABB box = a;
+  box.Extend(b);
+  return box;
+}
+
+} /* namespace */
+
+int Scene::Add(const Model& model, const mat4& transform, bool casts_shadow) {
+  int id;
+  if (free_objects_.empty()) {
+    id = static_cast<int>(objects_.size());
+    objects_.emplace_back();
+  } else {
+    id = free_objects_.back();
+    free_objects_.pop_back();
+  }
+  int leaf = AllocateNode();
+  objects_[id] = Object{&model, transform, model.bounds().Transform(transform),
+                        casts_shadow, next_version_++, leaf};
+  nodes_[leaf].bounds = objects_[id].bounds;
+  nodes_[leaf].object = id;
+  InsertLeaf(leaf);
+  return id;
+}
+
+void Scene::CheckId(int id) const {
+  if (id < 0 || static_cast<size_t>(id) >= objects_.size() ||
+      !objects_[id].model)
+    throw std::runtime_error{"Invalid object id " + std::to_string(id)};
+}
+
+void Scene::Remove(int id) {
+  CheckId(id);
+  RemoveLeaf(objects_[id].leaf);
+  free_nodes_.emplace_back(objects_[id].leaf);
+  objects_[id].model = nullptr;
+  free_objects_.emplace_back(id);
+}
+
+void Scene::SetTransform(int id, const mat4& transform) {
+  CheckId(id);
+  Object& object = objects_[id];
+  if (transform == object.transform) return;
+  object.transform = transform;
+  object.bounds = object.model->bounds().Transform(transform);
+  object.version = next_version_++;
+  nodes_[object.leaf].bounds = object.bounds;
+  // moving in place keeps the tree shape. this degrades if objects travel far,
+  // but objects of this scene only spin or move a little
+  Refit(nodes_[object.leaf].parent);
+}
+
+int Scene::AllocateNode() {
+  int node;
+  if (free_nodes_.empty()) {
+    node = static_cast<int>(nodes_.size());
+    nodes_.emplace_back();
+  } else {
+    node = free_nodes_.back();
+    free_nodes_.pop_back();
+  }
+  nodes_[node] = Node{AABB{}, -1, {-1, -1}, -1};
+  return node;
+}
+
+void Scene::InsertLeaf(int leaf) {
+  if (root_ < 0) {
+    root_ = leaf;
+    nodes_[leaf].parent = -1;
+    return;
+  }
+
+  // walk down towards the sibling whose box grows the least. cost of a
+  // choice is surface area of new parent plus growth of all ancestors
+  const AABB& box = nodes_[leaf].bounds;
+  int sibling = root_;
+  while (nodes_[sibling].object < 0) {
+    const Node& node = nodes_[sibling];
+    float combined_area = Union(node.bounds, box).area();
+    float cost = 2.0f * combined_area;
+    float inherited_cost = 2.0f * (combined_area - node.bounds.area());
+
+    float child_costs[2];
+    for (int i = 0; i < 2; ++i) {
+      const Node& child = nodes_[node.children[i]];
+      float area = Union(child.bounds, box).area();
+      // descending into an internal node only pays for its growth
+      if (child.object < 0) area -= child.bounds.area();
+      child_costs[i] = area + inherited_cost;
+    }
+    if (cost < child_costs[0] && cost < child_costs[1]) break;
+    sibling = node.children[child_costs[0] < child_costs[1] ? 0 : 1];
+  }
+
+  int old_parent = nodes_[sibling].parent;
+  int new_parent = AllocateNode();
+  nodes_[new_parent].parent = old_parent;
+  nodes_[new_parent].children[0] = sibling;
+  nodes_[new_parent].children[1] = leaf;
+  nodes_[sibling].parent = new_parent;
+  nodes_[leaf].parent = new_parent;
+  if (old_parent < 0) {
+    root_ = new_parent;
+  } else {
+    Node& parent = nodes_[old_parent];
+    parent.children[parent.children[0] == sibling ? 0 : 1] = new_parent;
+  }
+  Refit(new_parent);
+}
+
+void Scene::RemoveLeaf(int leaf) {
+  if (leaf == root_) {
+    root_ = -1;
+    return;
+  }
+  // parent is replaced by sibling
+  int parent = nodes_[leaf].parent;
+  int grandparent = nodes_[parent].parent;
+  const int* children = nodes_[parent].children;
+  int sibling = children[0] == leaf ? children[1] : children[0];
+  nodes_[sibling].parent = grandparent;
+  if (grandparent < 0) {
+    root_ = sibling;
+  } else {
+    Node& node = nodes_[grandparent];
+    node.children[node.children[0] == parent ? 0 : 1] = sibling;
+    Refit(grandparent);
+  }
+  free_nodes_.emplace_back(parent);
+}
+
+void Scene::Refit(int node) {
+  for (; node >= 0; node = nodes_[node].parent) {
+    Node& current = nodes_[node];
+    current.bounds = Union(nodes_[current.children[0]].bounds,
+                           nodes_[current.children[1]].bounds);
+  }
+}
+
+template<typename Volume>
+void Scene::QueryVolume(const Volume& volume,
+                        vector<int>* ids,
+                        bool casters_only) const {
+  if (root_ < 0) return;
+  vector<int> stack{root_};
+  while (!stack.empty()) {
+    const Node& node = nodes_[stack.back()];
+    stack.pop_back();
+    if (!volume.Intersects(node.bounds)) continue;
+    if (node.object >= 0) {
+      if (!casters_only || objects_[node.object].casts_shadow)
+        ids->emplace_back(node.object);
+    } else {
+      stack.emplace_back(node.children[0]);
+      stack.emplace_back(node.children[1]);
+    }
+  }
+}
+
+void Scene::Query(const Frustum& frustum,
+                  vector<int>* ids,
+                  bool casters_only) const {
+  QueryVolume(frustum, ids, casters_only);
+}
+
+void Scene::Query(const AABB& box,
+                  vector<int>* ids,
+                  bool casters_only) const {
+  QueryVolume(box, ids, casters_only);
+}
+
+bool Scene::Raycast(const Ray& ray, float max_t, int* id, float* t) const {
+  if (root_ < 0) return false;
+  bool hit = false;
+  vector<int> stack{root_};
+  while (!stack.empty()) {
+    const Node& node = nodes_[stack.back()];
+    stack.pop_back();
+    // nodes further than the closest hit so far cannot contain a closer one
+    float node_t;
+    if (!ray.Intersects(node.bounds, max_t, &node_t)) continue;
+    if (node.object >= 0) {
+      hit = true;
+      max_t = node_t;
+      *id = node.object;
+      *t = node_t;
+    } else {
+      stack.emplace_back(node.children[0]);
+      stack.emplace_back(node.children[1]);
+    }
+  }
+  return hit;
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
@@ -0,0 +1,90 @@
+#ifndef WRAPPER_OPENGL_SCENE_H
+#define WRAPPER_OPENGL_SCENE_H
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "model.h"
+
+namespace wrapper {
+namespace opengl {
+
+// models placed in the world, organized in a bounding volume hierarchy so
+// that visibility queries only visit objects near the query volume. objects
+// are inserted one at a time next to the node whose box grows the least, and
+// boxes of ancestors are refitted when an object moves. models are not owned
+// and must outlive the scene
+class Scene {
+ public:
+  Scene() : root_{-1}, next_version_{0} {}
+
+  // returns id of object, which stays valid until it is removed
+  int Add(const Model& model,
+          const glm::mat4& transform,
+          bool casts_shadow = true);
+  void Remove(int id);
+  void SetTransform(int id, const glm::mat4& transform);
+
+  // ids of objects whose world bounds intersect the volume are appended to
+  // ids, in no particular order
+  void Query(const Frustum& frustum,
+             std::vector<int>* ids,
+             bool casters_only = false) const;
+  void Query(const AABB& box,
+             std::vector<int>* ids,
+             bool casters_only = false) const;
+  // finds the closest object whose world bounds are hit within [0, max_t].
+  // returns false if there is none
+  bool Raycast(const Ray& ray, float max_t, int* id, float* t) const;
+
+  const Model& model(int id) const { return *objects_[id].model; }
+  const glm::mat4& transform(int id) const { return objects_[id].transform; }
+  const AABB& world_bounds(int id) const { return objects_[id].bounds; }
+  bool casts_shadow(int id) const { return objects_[id].casts_shadow; }
+  // changes whenever the object is added or moved, and is never reused, so
+  // that (id, version) identifies a placement
+  unsigned version(int id) const { return objects_[id].version; }
+
+ private:
+  struct Object {
+    const Model* model;  // nullptr if removed
+    glm::mat4 transform;
+    AABB bounds;
+    bool casts_shadow;
+    unsigned version;
+    int leaf;
+  };
+
+  // leaves have object >= 0, internal nodes always have two children
+  struct Node {
+    AABB bounds;
+    int parent;
+    int children[2];
+    int object;
+  };
+
+  std::vector<Object> objects_;
+  std::vector<int> free_objects_;
+  std::vector<Node> nodes_;
+  std::vector<int> free_nodes_;
+  int root_;
+  unsigned next_version_;
+
+  // throws if id does not refer to an object in scene
+  void CheckId(int id) const;
+  int AllocateNode();
+  void InsertLeaf(int leaf);
+  void RemoveLeaf(int leaf);
+  void Refit(int node);
+  template<typename Volume>
+  void QueryVolume(const Volume& volume,
+                   std::vector<int>* ids,
+                   bool casters_only) const;
+};
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_SCENE_H */
@@ -7,21 +7,52 @@
 
 #include "shader.h"
 
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <unordered_map>
 
+#include "program_cache.h"
+
 #include <glm/gtc/type_ptr.hpp>
 
 #define GL_NO_SHADER 0
 using std::ifstream;
 using std::runtime_error;
 using std::string;
+using std::vector;
 
 namespace wrapper {
 namespace opengl {
 namespace {
 
+const string& ReadCode(const string& path);
+
+// GLSL has no include directive, so lines of '#include "file"' are replaced
+// with code of file, which is relative to the including one
+string ExpandIncludes(const string& path, const string& code) {
+  const string directive{"#include \""};
+  const string dir = path.substr(0, path.find_last_of('/') + 1);
+  std::istringstream lines{code};
+  std::ostringstream expanded;
+  string line;
+  while (std::getline(lines, line)) {
+    if (line.compare(0, directive.size(), directive) != 0) {
+      expanded << line << '\n';
+      continue;
+    }
+    size_t end = line.find('"', directive.size());
+    if (end == string::npos)
+      throw runtime_error{"Malformed include in " + path + ": " + line};
+    expanded << ReadCode(
+        dir + line.substr(directive.size(), end - directive.size()));
+  }
+  return expanded.str();
+}
+
+// returns code with includes expanded, so that program keys change along
+// with included files
 const string& ReadCode(const string& path) {
   static std::unordered_map<string, string> kLoadedCode{};
   auto loaded = kLoadedCode.find(path);
@@ -31,14 +62,15 @@ const string& ReadCode(const string& path) {
     if (!file.is_open())
       throw runtime_error{"Failed to open file: " + path};
 
+    string code;
     try {
       std::ostringstream stream;
       stream << file.rdbuf();
-      string code = stream.str();
-      loaded = kLoadedCode.insert({path, code}).first;
+      code = stream.str();
     } catch (const ifstream::failure& e) {
       throw runtime_error{"Failed to read file: " + e.code().message()};
     }
+    loaded = kLoadedCode.insert({path, ExpandIncludes(path, code)}).first;
   }
   return loaded->second;
 }
@@ -67,6 +99,7 @@ GLuint CreateProgram(GLuint vert_shader,
   glAttachShader(program, frag_shader);
   if (geom_shader != GL_NO_SHADER)
     glAttachShader(program, geom_shader);
+  program_cache::MarkRetrievable(program);
   glLinkProgram(program);
 
   int success;
@@ -80,63 +113,297 @@ GLuint CreateProgram(GLuint vert_shader,
   return program;
 }
 
-} /* namespace */
+// FNV-1a, stable across runs unlike std::hash
+uint64_t Hash(const string& data, uint64_t hash = 14695981039346656037ull) {
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
 
-Shader::Shader(const string& vert_path,
-               const string& frag_path,
-               const string& geom_path) {
+string ToHex(uint64_t value) {
+  char buffer[17];
+  std::snprintf(buffer, sizeof(buffer), "%016llx",
+                static_cast<unsigned long long>(value));
+  return buffer;
+}
+
+// binary depends on sources and on the driver that compiled them
+uint64_t ProgramKey(const string& vert_path,
+                    const string& frag_path,
+                    const string& geom_path) {
+  uint64_t key = Hash(ReadCode(vert_path));
+  key = Hash(ReadCode(frag_path), key);
+  if (!geom_path.empty()) key = Hash(ReadCode(geom_path), key);
+  for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    const char* value = reinterpret_cast<const char*>(glGetString(name));
+    key = Hash(value ? value : "", key);
+  }
+  return key;
+}
+
+// each vertex shader may be paired with several fragment shaders, so cache
+// files are named after the whole combination
+string ProgramCachePath(const string& vert_path,
+                        const string& frag_path,
+                        const string& geom_path) {
+  return vert_path + "." + ToHex(Hash(frag_path + '\0' + geom_path)) +
+         ".progbin";
+}
+
+GLuint CompileProgram(const string& vert_path,
+                      const string& frag_path,
+                      const string& geom_path) {
   GLuint vert_shader = CreateShader(
       GL_VERTEX_SHADER, ReadCode(vert_path).c_str());
   GLuint frag_shader = CreateShader(
       GL_FRAGMENT_SHADER, ReadCode(frag_path).c_str());
   GLuint geom_shader = geom_path.empty() ? GL_NO_SHADER : CreateShader(
       GL_GEOMETRY_SHADER, ReadCode(geom_path).c_str());
-  program_id_ = CreateProgram(vert_shader, frag_shader, geom_shader);
+  GLuint program = CreateProgram(vert_shader, frag_shader, geom_shader);
 
   glDeleteShader(vert_shader);
   glDeleteShader(frag_shader);
   if (geom_shader != GL_NO_SHADER)
     glDeleteShader(geom_shader);
+  return program;
+}
+
+} /* namespace */
+
+Shader::Shader(const string& vert_path,
+               const string& frag_path,
+               const string& geom_path) {
+  // programs are never deleted, so shaders built from the same files can
+  // share one program (and its uniform table) for the lifetime of process
+  static std::unordered_map<string, std::shared_ptr<Program>> kLoadedProgram{};
+  string name = vert_path + '\0' + frag_path + '\0' + geom_path;
+  auto loaded = kLoadedProgram.find(name);
+  if (loaded != kLoadedProgram.end()) {
+    program_ = loaded->second;
+    program_id_ = program_->id;
+    return;
+  }
+
+  string cache_path = ProgramCachePath(vert_path, frag_path, geom_path);
+  uint64_t key = ProgramKey(vert_path, frag_path, geom_path);
+  program_id_ = program_cache::Load(cache_path, key);
+  if (program_id_ == 0) {
+    program_id_ = CompileProgram(vert_path, frag_path, geom_path);
+    program_cache::Write(cache_path, key, program_id_);
+  }
+
+  Reflect();
+  kLoadedProgram.insert({name, program_});
+}
+
+void Shader::Reflect() {
+  program_ = std::make_shared<Program>();
+  program_->id = program_id_;
+
+  GLint num_uniforms, max_name_length;
+  glGetProgramiv(program_id_, GL_ACTIVE_UNIFORMS, &num_uniforms);
+  glGetProgramiv(program_id_, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+  vector<char> buffer(max_name_length + 1);
+  for (GLint i = 0; i < num_uniforms; ++i) {
+    GLint size;
+    GLenum type;
+    glGetActiveUniform(program_id_, i, (GLsizei)buffer.size(), nullptr,
+                       &size, &type, buffer.data());
+    string name{buffer.data()};
+    // uniforms in blocks have no location
+    if (glGetUniformLocation(program_id_, name.c_str()) == -1) continue;
+
+    // arrays are reported as "name[0]" with size of array. flatten them, so
+    // that each element has its own entry. "name" also refers to "name[0]"
+    string base = name;
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+      base = name.substr(0, name.size() - 3);
+    for (GLint j = 0; j < size; ++j) {
+      string element = size > 1 || base != name ?
+          base + "[" + std::to_string(j) + "]" : name;
+      GLint location = glGetUniformLocation(program_id_, element.c_str());
+      if (location == -1) continue;
+      program_->uniform_indices.insert(
+          {element, (int)program_->uniforms.size()});
+      program_->uniforms.emplace_back(
+          Uniform{element, location, type, false, {}});
+    }
+    if (base != name)
+      program_->uniform_indices.insert({base, program_->uniform_indices[name]});
+  }
+
+  GLint num_blocks;
+  glGetProgramiv(program_id_, GL_ACTIVE_UNIFORM_BLOCKS, &num_blocks);
+  glGetProgramiv(program_id_, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+                 &max_name_length);
+  buffer.resize(max_name_length + 1);
+  for (GLint i = 0; i < num_blocks; ++i) {
+    glGetActiveUniformBlockName(program_id_, i, (GLsizei)buffer.size(),
+                                nullptr, buffer.data());
+    program_->block_indices.insert({buffer.data(), (GLuint)i});
+  }
 }
 
 void Shader::Use() const {
     glUseProgram(program_id_);
 }
 
-GLuint Shader::get_uniform(const string& name) const {
-  GLint location = glGetUniformLocation(program_id_, name.c_str());
-  if (location == GL_INVALID_INDEX)
+int Shader::FindUniform(const string& name) const {
+  auto found = program_->uniform_indices.find(name);
+  if (found == program_->uniform_indices.end())
     throw runtime_error{"Cannot find uniform: " + name};
-  return location;
+  return found->second;
+}
+
+GLuint Shader::get_uniform(const string& name) const {
+  return program_->uniforms[FindUniform(name)].location;
+}
+
+bool Shader::has_uniform(const string& name) const {
+  return program_->uniform_indices.count(name) != 0;
+}
+
+namespace {
+
+bool IsSampler(GLenum type) {
+  switch (type) {
+    case GL_SAMPLER_1D:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_3D:
+    case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_CUBE_SHADOW:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_2D_ARRAY_SHADOW:
+    case GL_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_BUFFER:
+    case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_2D:
+    case GL_UNSIGNED_INT_SAMPLER_2D:
+      return true;
+    default:
+      return false;
+  }
+}
+
+} /* namespace */
+
+void Shader::CheckType(int index, const int*) const {
+  GLenum type = program_->uniforms[index].type;
+  if (type != GL_INT && type != GL_BOOL && !IsSampler(type))
+    throw runtime_error{"Uniform is not int: " + program_->uniforms[index].name};
+}
+
+void Shader::CheckType(int index, const float*) const {
+  if (program_->uniforms[index].type != GL_FLOAT)
+    throw runtime_error{"Uniform is not float: " +
+        program_->uniforms[index].name};
+}
+
+void Shader::CheckType(int index, const glm::vec2*) const {
+  if (program_->uniforms[index].type != GL_FLOAT_VEC2)
+    throw runtime_error{"Uniform is not vec2: " +
+        program_->uniforms[index].name};
+}
+
+void Shader::CheckType(int index, const glm::vec3*) const {
+  if (program_->uniforms[index].type != GL_FLOAT_VEC3)
+    throw runtime_error{"Uniform is not vec3: " +
+        program_->uniforms[index].name};
+}
+
+void Shader::CheckType(int index, const glm::mat3*) const {
+  if (program_->uniforms[index].type != GL_FLOAT_MAT3)
+    throw runtime_error{"Uniform is not mat3: " +
+        program_->uniforms[index].name};
+}
+
+void Shader::CheckType(int index, const glm::mat4*) const {
+  if (program_->uniforms[index].type != GL_FLOAT_MAT4)
+    throw runtime_error{"Uniform is not mat4: " +
+        program_->uniforms[index].name};
+}
+
+bool Shader::UpdateCache(int index, const void* value, size_t size) const {
+  Uniform& uniform = program_->uniforms[index];
+  if (uniform.has_value && std::memcmp(uniform.value, value, size) == 0)
+    return false;
+  std::memcpy(uniform.value, value, size);
+  uniform.has_value = true;
+  return true;
+}
+
+void Shader::set(UniformHandle<int> handle, int value) const {
+  if (UpdateCache(handle.index_, &value, sizeof(value)))
+    glUniform1i(program_->uniforms[handle.index_].location, value);
+}
+
+void Shader::set(UniformHandle<float> handle, float value) const {
+  if (UpdateCache(handle.index_, &value, sizeof(value)))
+    glUniform1f(program_->uniforms[handle.index_].location, value);
+}
+
+void Shader::set(UniformHandle<glm::vec2> handle,
+                 const glm::vec2& value) const {
+  if (UpdateCache(handle.index_, value_ptr(value), sizeof(value)))
+    glUniform2fv(program_->uniforms[handle.index_].location, 1,
+                 value_ptr(value));
+}
+
+void Shader::set(UniformHandle<glm::vec3> handle,
+                 const glm::vec3& value) const {
+  if (UpdateCache(handle.index_, value_ptr(value), sizeof(value)))
+    glUniform3fv(program_->uniforms[handle.index_].location, 1,
+                 value_ptr(value));
+}
+
+void Shader::set(UniformHandle<glm::mat3> handle,
+                 const glm::mat3& value) const {
+  // how many matrices to send, transpose or not
+  // (GLM is already in coloumn order, so no)
+  if (UpdateCache(handle.index_, value_ptr(value), sizeof(value)))
+    glUniformMatrix3fv(program_->uniforms[handle.index_].location, 1,
+                       GL_FALSE, value_ptr(value));
+}
+
+void Shader::set(UniformHandle<glm::mat4> handle,
+                 const glm::mat4& value) const {
+  if (UpdateCache(handle.index_, value_ptr(value), sizeof(value)))
+    glUniformMatrix4fv(program_->uniforms[handle.index_].location, 1,
+                       GL_FALSE, value_ptr(value));
 }
 
 void Shader::set_int(const string& name, int value) const {
-  glUniform1i(get_uniform(name), value);
+  set(get_handle<int>(name), value);
 }
 
 void Shader::set_float(const string& name, float value) const {
-  glUniform1f(get_uniform(name), value);
+  set(get_handle<float>(name), value);
+}
+
+void Shader::set_vec2(const string& name, const glm::vec2& value) const {
+  set(get_handle<glm::vec2>(name), value);
 }
 
 void Shader::set_vec3(const string& name, const glm::vec3& value) const {
-  glUniform3fv(get_uniform(name), 1, value_ptr(value));
+  set(get_handle<glm::vec3>(name), value);
 }
 
 void Shader::set_mat3(const string& name, const glm::mat3& value) const {
-  // how many matrices to send, transpose or not
-  // (GLM is already in coloumn order, so no)
-  glUniformMatrix3fv(get_uniform(name), 1, GL_FALSE, value_ptr(value));
+  set(get_handle<glm::mat3>(name), value);
 }
 
 void Shader::set_mat4(const string& name, const glm::mat4& value) const {
-  glUniformMatrix4fv(get_uniform(name), 1, GL_FALSE, value_ptr(value));
+  set(get_handle<glm::mat4>(name), value);
 }
 
 void Shader::set_block(const string& name, GLuint binding_point) const {
-  GLint block_index = glGetUniformBlockIndex(program_id_, name.c_str());
-  if (block_index == GL_INVALID_INDEX)
+  auto found = program_->block_indices.find(name);
+  if (found == program_->block_indices.end())
     throw runtime_error{"Cannot find block: " + name};
-  glUniformBlockBinding(program_id_, block_index, binding_point);
+  glUniformBlockBinding(program_id_, found->second, binding_point);
 }
 
 } /* namespace opengl */
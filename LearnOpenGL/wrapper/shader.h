@@ -8,7 +8,10 @@
 #ifndef WRAPPER_OPENGL_SHADER_H
 #define WRAPPER_OPENGL_SHADER_H
 
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
@@ -16,22 +19,88 @@
 namespace wrapper {
 namespace opengl {
 
+// refers to an entry in the uniform table of the shader it is obtained from
+// (or any copy of that shader). setting through a handle involves neither
+// string operations nor driver queries
+template <typename T>
+class UniformHandle {
+ public:
+  UniformHandle() : index_{-1} {}
+  bool valid() const { return index_ >= 0; }
+
+ private:
+  friend class Shader;
+  explicit UniformHandle(int index) : index_{index} {}
+  int index_;
+};
+
 class Shader {
  public:
   Shader(const std::string& vert_path,
          const std::string& frag_path,
          const std::string& geom_path = "");
   void Use() const;
+  // shaders built from the same sources share one program
+  GLuint program_id() const { return program_id_; }
   GLuint get_uniform(const std::string& name) const;
+  // whether uniform is active, i.e. not optimized out of the program
+  bool has_uniform(const std::string& name) const;
   void set_int(const std::string& name, int value) const;
   void set_float(const std::string& name, float value) const;
+  void set_vec2(const std::string& name, const glm::vec2& value) const;
   void set_vec3(const std::string& name, const glm::vec3& value) const;
   void set_mat3(const std::string& name, const glm::mat3& value) const;
   void set_mat4(const std::string& name, const glm::mat4& value) const;
   void set_block(const std::string& name, GLuint binding_point) const;
 
+  // resolve once, then use on the hot path. throws if uniform is not active
+  // or its type does not match T
+  template <typename T>
+  UniformHandle<T> get_handle(const std::string& name) const {
+    int index = FindUniform(name);
+    CheckType(index, static_cast<const T*>(nullptr));
+    return UniformHandle<T>{index};
+  }
+  // like other setters, shader must be in use. uploading is skipped if the
+  // value is the same as the last one set
+  void set(UniformHandle<int> handle, int value) const;
+  void set(UniformHandle<float> handle, float value) const;
+  void set(UniformHandle<glm::vec2> handle, const glm::vec2& value) const;
+  void set(UniformHandle<glm::vec3> handle, const glm::vec3& value) const;
+  void set(UniformHandle<glm::mat3> handle, const glm::mat3& value) const;
+  void set(UniformHandle<glm::mat4> handle, const glm::mat4& value) const;
+
  private:
+  struct Uniform {
+    std::string name;
+    GLint location;
+    GLenum type;
+    bool has_value;
+    // last value set, used to filter redundant uploads
+    alignas(glm::mat4) unsigned char value[sizeof(glm::mat4)];
+  };
+  // shared by all shaders using the same program, so that cached values
+  // always reflect the state of the program
+  struct Program {
+    GLuint id;
+    std::vector<Uniform> uniforms;
+    std::unordered_map<std::string, int> uniform_indices;
+    std::unordered_map<std::string, GLuint> block_indices;
+  };
+
   GLuint program_id_;
+  std::shared_ptr<Program> program_;
+
+  void Reflect();
+  int FindUniform(const std::string& name) const;
+  void CheckType(int index, const int*) const;
+  void CheckType(int index, const float*) const;
+  void CheckType(int index, const glm::vec2*) const;
+  void CheckType(int index, const glm::vec3*) const;
+  void CheckType(int index, const glm::mat3*) const;
+  void CheckType(int index, const glm::mat4*) const;
+  // returns false if value is same as cached one, otherwise updates cache
+  bool UpdateCache(int index, const void* value, size_t size) const;
 };
 
 } /* namespace opengl */
@@ -7,6 +7,8 @@
 
 #include "shadow.h"
 
+#include <algorithm>
+
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "loader.h"
@@ -14,6 +16,7 @@
 using glm::lookAt;
 using glm::mat4;
 using glm::vec3;
+using std::pair;
 using std::string;
 using std::vector;
 
@@ -22,66 +25,151 @@ namespace opengl {
 namespace {
 
 const int kCubeMapSideLength{1024};
+// GL_DEPTH_COMPONENT is usually stored in 24 bits, padded to 32
+const size_t kDepthBytes{4};
 const string kOmniShadowVertShader{"shader_omnishadow.vs"};
-const string kOmniShadowGeomShader{"shader_omnishadow.gs"};
 const string kOmniShadowFragShader{"shader_omnishadow.fs"};
 const string kUniShadowVertShader{"shader_unishadow.vs"};
 const string kUniShadowFragShader{"shader_unishadow.fs"};
 
 } /* namespace */
 
-Shadow::Shadow(int width,
+Shadow::Shadow(int num_faces,
+               int width,
                int height,
                const mat4& projection,
                const Shader& shader)
-    : width_{width}, height_{height}, proj_{projection}, shader_{shader} {}
+    : num_faces_{num_faces}, dirty_faces_{(1u << num_faces) - 1},
+      next_face_{0}, has_calculated_{false}, light_moved_{true},
+      width_{width}, height_{height}, shader_{shader},
+      model_uniform_{shader_.get_handle<mat4>("model")}, proj_{projection} {}
 
 void Shadow::CalculateShadow(int prev_width,
                              int prev_height,
                              GLuint prev_frameBuffer,
-                             const vector<Model>& models,
-                             const vector<mat4>& model_matrices) const {
-  if (models.size() != model_matrices.size())
-    throw std::runtime_error{"Vector size incompatible"};
+                             const Scene& scene,
+                             int max_faces) {
+  // faces rendered before this change are no longer valid
+  auto casters = FindCasters(scene);
+  if (light_moved_ || casters != casters_) {
+    dirty_faces_ = (1u << num_faces_) - 1;
+    light_moved_ = false;
+    casters_ = std::move(casters);
+  }
+  if (dirty_faces_ == 0 || max_faces <= 0) return;
 
   // to avoid peter panning (side effect of setting bias in fragment shader)
   // (sometimes culling front face instead of back face also works)
   glEnable(GL_CULL_FACE);
   glViewport(0, 0, width_, height_);
   glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
-  glClear(GL_DEPTH_BUFFER_BIT);
 
   shader_.Use();
-  for (int i = 0; i < models.size(); ++i) {
-    shader_.set_mat4("model", model_matrices[i]);
-    models[i].Draw(shader_, 0, false); // no need to load texture!
+  SetUniforms();
+  const int first_face = next_face_;
+  for (int i = 0; i < num_faces_ && max_faces > 0; ++i) {
+    const int face = (first_face + i) % num_faces_;
+    if (!(dirty_faces_ & (1u << face))) continue;
+    RenderFace(face, scene);
+    dirty_faces_ &= ~(1u << face);
+    --max_faces;
+    next_face_ = (face + 1) % num_faces_;
   }
 
   glBindFramebuffer(GL_FRAMEBUFFER, prev_frameBuffer);
   glViewport(0, 0, prev_width, prev_height);
   glDisable(GL_CULL_FACE);
+
+  if (dirty_faces_ == 0) has_calculated_ = true;
+}
+
+size_t Shadow::memory_size() const {
+  return static_cast<size_t>(width_) * height_ * num_faces_ * kDepthBytes;
+}
+
+vector<pair<int, unsigned>> Shadow::FindCasters(const Scene& scene) const {
+  vector<int> ids;
+  QueryCasters(scene, &ids);
+  std::sort(ids.begin(), ids.end());
+  vector<pair<int, unsigned>> casters;
+  casters.reserve(ids.size());
+  for (int id : ids)
+    casters.emplace_back(id, scene.version(id));
+  return casters;
 }
 
-OmniShadow::OmniShadow(float frustum_height, const mat4& projection)
-    : Shadow{kCubeMapSideLength, kCubeMapSideLength, projection,
-             Shader{kOmniShadowVertShader, kOmniShadowFragShader,
-                    kOmniShadowGeomShader}}, frustum_height_{frustum_height} {
+int Shadow::NumDirtyFaces(const Scene& scene) const {
+  if (light_moved_ || FindCasters(scene) != casters_) return num_faces_;
+  int num_dirty = 0;
+  for (int face = 0; face < num_faces_; ++face) {
+    if (dirty_faces_ & (1u << face)) ++num_dirty;
+  }
+  return num_dirty;
+}
+
+void Shadow::DrawCasters(const mat4& light_space, const Scene& scene) const {
+  vector<int> ids;
+  scene.Query(Frustum{light_space}, &ids, true);
+  for (int id : ids) {
+    shader_.set(model_uniform_, scene.transform(id));
+    scene.model(id).Draw(shader_, 0, false); // no need to load texture!
+  }
+}
+
+void ShadowScheduler::Request(const Shadow* shadow,
+                              float priority,
+                              int num_faces) {
+  requests_.emplace_back(PendingShadow{shadow, priority, num_faces});
+}
+
+vector<ShadowScheduler::Grant> ShadowScheduler::Schedule() {
+  // priority grows linearly with number of frames waited
+  for (auto& request : requests_)
+    request.priority *= 1 + waiting_frames_[request.shadow];
+  std::stable_sort(requests_.begin(), requests_.end(),
+                   [](const PendingShadow& a, const PendingShadow& b) {
+                     return a.priority > b.priority;
+                   });
+
+  vector<Grant> grants;
+  int budget = face_budget_;
+  for (const auto& request : requests_) {
+    const Shadow* shadow = request.shadow;
+    int num_faces = shadow->has_calculated() ?
+        std::min(request.num_faces, budget) : request.num_faces;
+    budget -= std::min(budget, num_faces);
+    if (num_faces > 0) grants.emplace_back(Grant{shadow, num_faces});
+    if (num_faces == request.num_faces) waiting_frames_.erase(shadow);
+    else ++waiting_frames_[shadow];
+  }
+  requests_.clear();
+  return grants;
+}
+
+OmniShadow::OmniShadow(float frustum_height,
+                       float far,
+                       const mat4& projection)
+    : Shadow{6, kCubeMapSideLength, kCubeMapSideLength, projection,
+             Shader{kOmniShadowVertShader, kOmniShadowFragShader}},
+      frustum_height_{frustum_height}, far_{far},
+      light_pos_{0.0f}, light_spaces_(6, mat4(1.0f)) {
   CreateDepthMap();
-  for (int i = 0; i < 6; ++i)
-    uniform_names_.emplace_back("lightSpace[" + std::to_string(i) + "]");
-  shader_.Use();
-  shader_.set_float("frustumHeight", frustum_height_);
+  frustum_height_uniform_ = shader_.get_handle<float>("frustumHeight");
+  light_pos_uniform_ = shader_.get_handle<vec3>("lightPos");
+  light_space_uniform_ = shader_.get_handle<mat4>("lightSpace");
 }
 
 OmniShadow OmniShadow::PointLightShadow(float near, float far) {
   mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, near, far);
-  return OmniShadow{far - near, projection};
+  return OmniShadow{far - near, far, projection};
 }
 
 UniShadow::UniShadow(int width, int height, const mat4& projection)
-    : Shadow{width, height, projection,
-             Shader{kUniShadowVertShader, kUniShadowFragShader}} {
+    : Shadow{1, width, height, projection,
+             Shader{kUniShadowVertShader, kUniShadowFragShader}},
+      light_space_{1.0f} {
   CreateDepthMap();
+  light_space_uniform_ = shader_.get_handle<mat4>("lightSpace");
 }
 
 UniShadow UniShadow::DirLightShadow(int width, int height,
@@ -117,7 +205,9 @@ void OmniShadow::CreateDepthMap() {
 
   glGenFramebuffers(1, &fbo_);
   glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
-  glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_map_, 0);
+  // faces are attached one at a time when rendering
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                         GL_TEXTURE_CUBE_MAP_POSITIVE_X, depth_map_, 0);
   // by following two lines, we tell OpenGL there will be no color component
   glDrawBuffer(GL_NONE);
   glReadBuffer(GL_NONE);
@@ -149,9 +239,10 @@ void UniShadow::CreateDepthMap() {
 }
 
 void OmniShadow::MoveLight(const vec3& position) {
-  shader_.Use();
-  shader_.set_vec3("lightPos", position);
-  vector<mat4> light_spaces{
+  if (has_calculated_ && position == light_pos_) return;
+  light_moved_ = true;
+  light_pos_ = position;
+  light_spaces_ = {
       proj_ * lookAt(position, position + vec3{ 1.0,  0.0,  0.0},
                      vec3{ 0.0, -1.0,  0.0}),
       proj_ * lookAt(position, position + vec3{-1.0,  0.0,  0.0},
@@ -165,16 +256,49 @@ void OmniShadow::MoveLight(const vec3& position) {
       proj_ * lookAt(position, position + vec3{ 0.0,  0.0, -1.0},
                      vec3{ 0.0, -1.0,  0.0}),
   };
-  for (int i = 0; i < 6; ++i)
-    shader_.set_mat4(uniform_names_[i], light_spaces[i]);
+}
+
+void OmniShadow::SetUniforms() const {
+  shader_.set(frustum_height_uniform_, frustum_height_);
+  shader_.set(light_pos_uniform_, light_pos_);
+}
+
+void OmniShadow::QueryCasters(const Scene& scene, vector<int>* ids) const {
+  // six faces together cover a cube around the light
+  scene.Query(AABB{light_pos_ - vec3(far_), light_pos_ + vec3(far_)}, ids,
+              true);
+}
+
+void OmniShadow::RenderFace(int face, const Scene& scene) {
+  // one pass per face instead of amplifying every triangle to all six faces
+  // in geometry shader, so that casters can be culled per face
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                         GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, depth_map_, 0);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  shader_.set(light_space_uniform_, light_spaces_[face]);
+  DrawCasters(light_spaces_[face], scene);
 }
 
 void UniShadow::MoveLight(const vec3& position,
                           const vec3& front,
                           const vec3& up) {
-  light_space_ = proj_ * lookAt(position, position + front, up);
-  shader_.Use();
-  shader_.set_mat4("lightSpace", light_space_);
+  mat4 light_space = proj_ * lookAt(position, position + front, up);
+  if (has_calculated_ && light_space == light_space_) return;
+  light_moved_ = true;
+  light_space_ = light_space;
+}
+
+void UniShadow::SetUniforms() const {
+  shader_.set(light_space_uniform_, light_space_);
+}
+
+void UniShadow::QueryCasters(const Scene& scene, vector<int>* ids) const {
+  scene.Query(Frustum{light_space_}, ids, true);
+}
+
+void UniShadow::RenderFace(int /*face*/, const Scene& scene) {
+  glClear(GL_DEPTH_BUFFER_BIT);
+  DrawCasters(light_space_, scene);
 }
 
 void OmniShadow::BindShadowMap(GLuint index) const {
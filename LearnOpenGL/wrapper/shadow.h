@@ -9,37 +9,73 @@
 #define WRAPPER_OPENGL_SHADOW_H
 
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "bounds.h"
+#include "scene.h"
 #include "shader.h"
-#include "model.h"
 
 namespace wrapper {
 namespace opengl {
 
 class Shadow {
  public:
+  // renders at most max_faces of faces that are out of date. each face is
+  // rendered only with casters of scene that intersect its frustum
   void CalculateShadow(int prev_width,
                        int prev_height,
                        GLuint prev_frameBuffer,
-                       const std::vector<Model>& models,
-                       const std::vector<glm::mat4>& model_matrices) const;
+                       const Scene& scene,
+                       int max_faces);
+  // number of faces that are out of date. all faces are if the light has
+  // moved, or casters within reach of the light have been added, removed or
+  // moved since they were last rendered. returns 0 if shadow map is up to date
+  int NumDirtyFaces(const Scene& scene) const;
+  // whether all faces have been rendered at least once
+  bool has_calculated() const { return has_calculated_; }
+  // bytes of depth map, estimated, since its precision is left to the driver
+  size_t memory_size() const;
 
  protected:
+  int num_faces_;
+  unsigned dirty_faces_;  // bit mask
+  // face to render first next time. faces are rendered round-robin, so that
+  // if they are invalidated before all are rendered, later ones still catch up
+  int next_face_;
+  bool has_calculated_;
+  bool light_moved_;
+  // (id, version) of casters within reach when faces were last invalidated
+  std::vector<std::pair<int, unsigned>> casters_;
   GLuint fbo_;
   GLuint depth_map_;
   int width_, height_;
   Shader shader_;
+  UniformHandle<glm::mat4> model_uniform_;
   glm::mat4 proj_;
 
-  Shadow(int width,
+  Shadow(int num_faces,
+         int width,
          int height,
          const glm::mat4& projection,
          const Shader& shader);
+  // sorted by id
+  std::vector<std::pair<int, unsigned>> FindCasters(const Scene& scene) const;
+  // casters are looked up within this volume
+  virtual void QueryCasters(const Scene& scene,
+                            std::vector<int>* ids) const = 0;
+  // should be called with framebuffer bound and shader in use
+  virtual void RenderFace(int face, const Scene& scene) = 0;
+  // only draws casters inside of light_space frustum
+  void DrawCasters(const glm::mat4& light_space, const Scene& scene) const;
   virtual void CreateDepthMap() = 0;
+  // shadows of the same kind share one program, so uniforms specific to a
+  // light are set right before rendering
+  virtual void SetUniforms() const = 0;
   virtual void BindShadowMap(GLuint index) const = 0;
   virtual ~Shadow() {}
 };
@@ -54,10 +90,19 @@ class OmniShadow : public Shadow {
 
  private:
   float frustum_height_;
-  std::vector<std::string> uniform_names_;
+  float far_;
+  glm::vec3 light_pos_;
+  std::vector<glm::mat4> light_spaces_;
+  UniformHandle<float> frustum_height_uniform_;
+  UniformHandle<glm::vec3> light_pos_uniform_;
+  UniformHandle<glm::mat4> light_space_uniform_;
   OmniShadow(float frustum_height,
+             float far,
              const glm::mat4& projection);
+  void QueryCasters(const Scene& scene, std::vector<int>* ids) const;
+  void RenderFace(int face, const Scene& scene);
   void CreateDepthMap();
+  void SetUniforms() const;
 };
 
 class UniShadow : public Shadow {
@@ -83,10 +128,44 @@ class UniShadow : public Shadow {
 
  private:
   glm::mat4 light_space_;
+  UniformHandle<glm::mat4> light_space_uniform_;
   UniShadow(int width,
             int height,
             const glm::mat4& projection);
+  void QueryCasters(const Scene& scene, std::vector<int>* ids) const;
+  void RenderFace(int face, const Scene& scene);
   void CreateDepthMap();
+  void SetUniforms() const;
+};
+
+// decides how many faces of each dirty shadow to render in a frame. shadows
+// that have never been calculated get all their faces, since they have no
+// valid map at all. others are served in order of priority until the budget
+// (in number of faces) is used up, so a cube map may be updated over several
+// frames. a shadow that keeps being deferred gains priority every frame it
+// waits, so that it does not starve
+class ShadowScheduler {
+ public:
+  struct Grant {
+    const Shadow* shadow;
+    int num_faces;
+  };
+
+  explicit ShadowScheduler(int face_budget) : face_budget_{face_budget} {}
+  // num_faces should be the number of dirty faces. higher priority goes first
+  void Request(const Shadow* shadow, float priority, int num_faces);
+  // returns faces to render in this frame, and clears requests
+  std::vector<Grant> Schedule();
+
+ private:
+  struct PendingShadow {
+    const Shadow* shadow;
+    float priority;
+    int num_faces;
+  };
+  int face_budget_;
+  std::vector<PendingShadow> requests_;
+  std::unordered_map<const Shadow*, int> waiting_frames_;
 };
 
 } /* namespace opengl */
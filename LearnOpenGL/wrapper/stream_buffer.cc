@@ -0,0 +1,137 @@
+#include "stream_buffer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using std::runtime_error;
+
+namespace wrapper {
+namespace opengl {
+namespace {
+
+// regions start at multiples of this, so that any alignment a caller may ask
+// for (uniform buffers need at most 256 bytes) holds for absolute offsets
+const GLsizeiptr kRegionAlignment{256};
+const GLuint64 kWaitTimeout{1000000000};  // 1 second
+
+GLsizeiptr AlignUp(GLsizeiptr value, GLsizeiptr alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// GLAD leaves the entry point null if it was generated without the extension
+// or for an older version, even where the driver supports it (macOS stops at
+// 4.1), in which case buffers are orphaned instead
+bool HasBufferStorage() {
+  if (glBufferStorage == nullptr) return false;
+  GLint major = 0, minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  if (major > 4 || (major == 4 && minor >= 4)) return true;
+  GLint num_extensions;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+  for (GLint i = 0; i < num_extensions; ++i) {
+    const char* extension = reinterpret_cast<const char*>(
+        glGetStringi(GL_EXTENSIONS, i));
+    if (std::strcmp(extension, "GL_ARB_buffer_storage") == 0) return true;
+  }
+  return false;
+}
+
+} /* namespace */
+
+StreamBuffer::StreamBuffer(GLsizeiptr frame_size, int num_frames)
+    : frame_size_{AlignUp(frame_size, kRegionAlignment)},
+      num_frames_{num_frames}, frame_{num_frames - 1}, cursor_{0},
+      mapped_{nullptr}, fences_(num_frames, nullptr), num_waits_{0} {
+  const GLsizeiptr total_size = frame_size_ * num_frames_;
+  glGenBuffers(1, &buffer_);
+  // bound to a target that draws never use, so that other bindings are kept
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+  if (HasBufferStorage()) {
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_COPY_WRITE_BUFFER, total_size, NULL, flags);
+    mapped_ = static_cast<char*>(
+        glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total_size, flags));
+    if (!mapped_) throw runtime_error{"Failed to map stream buffer"};
+  } else {
+    glBufferData(GL_COPY_WRITE_BUFFER, total_size, NULL, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+StreamBuffer::~StreamBuffer() {
+  for (GLsync fence : fences_) {
+    if (fence) glDeleteSync(fence);
+  }
+  if (mapped_) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+  glDeleteBuffers(1, &buffer_);
+}
+
+void StreamBuffer::BeginFrame() {
+  frame_ = (frame_ + 1) % num_frames_;
+  cursor_ = 0;
+  GLsync& fence = fences_[frame_];
+  if (!fence) return;
+  // only flush commands if the fence is not signaled yet, otherwise it may
+  // never be
+  GLenum result = glClientWaitSync(fence, 0, 0);
+  if (result == GL_TIMEOUT_EXPIRED) {
+    ++num_waits_;
+    do {
+      result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                kWaitTimeout);
+    } while (result == GL_TIMEOUT_EXPIRED);
+  }
+  if (result == GL_WAIT_FAILED)
+    throw runtime_error{"Failed to wait for stream buffer"};
+  glDeleteSync(fence);
+  fence = nullptr;
+}
+
+GLintptr StreamBuffer::Upload(const void* data,
+                              GLsizeiptr size,
+                              GLsizeiptr alignment) {
+  const GLsizeiptr region = frame_size_ * frame_;
+  const GLsizeiptr offset = AlignUp(region + cursor_, alignment);
+  if (offset + size > region + frame_size_)
+    throw runtime_error{"Stream buffer frame is full"};
+  cursor_ = offset + size - region;
+
+  if (mapped_) {
+    std::memcpy(mapped_ + offset, data, size);
+  } else {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer_);
+    void* range = glMapBufferRange(
+        GL_COPY_WRITE_BUFFER, offset, size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+        GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!range) throw runtime_error{"Failed to map stream buffer"};
+    std::memcpy(range, data, size);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+  return offset;
+}
+
+void StreamBuffer::EndFrame() {
+  GLsync& fence = fences_[frame_];
+  if (fence) glDeleteSync(fence);
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLsizeiptr StreamBuffer::UniformAlignment() {
+  static const GLsizeiptr kAlignment = []() {
+    GLint alignment = 1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    return static_cast<GLsizeiptr>(alignment);
+  }();
+  return kAlignment;
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
@@ -0,0 +1,57 @@
+#ifndef WRAPPER_OPENGL_STREAM_BUFFER_H
+#define WRAPPER_OPENGL_STREAM_BUFFER_H
+
+#include <vector>
+
+#include <glad/glad.h>
+
+namespace wrapper {
+namespace opengl {
+
+// one buffer split into a ring of regions, one per frame, for data that is
+// written by the CPU every frame (uniforms, instances, text vertices). a
+// region is reused only after the fence placed at the end of the frame that
+// last used it is signaled, so the CPU can run num_frames - 1 frames ahead of
+// the GPU, and writing never waits for draws that read older data. with
+// ARB_buffer_storage (core since 4.4) the buffer is mapped once, persistently
+// and coherently. otherwise each upload maps its own range unsynchronized,
+// which is safe since fences already guarantee that the GPU is done with it
+class StreamBuffer {
+ public:
+  // frame_size is how many bytes can be uploaded in one frame
+  explicit StreamBuffer(GLsizeiptr frame_size, int num_frames = 3);
+  StreamBuffer(const StreamBuffer&) = delete;
+  StreamBuffer& operator=(const StreamBuffer&) = delete;
+  ~StreamBuffer();
+
+  // moves to the next region, waiting for the GPU if it still reads from it.
+  // must be called before the first upload of a frame
+  void BeginFrame();
+  // copies data into the current region and returns its offset in buffer(),
+  // which is a multiple of alignment. throws if the region is full
+  GLintptr Upload(const void* data, GLsizeiptr size, GLsizeiptr alignment = 1);
+  // must be called after the last command that reads data of this frame
+  void EndFrame();
+
+  GLuint buffer() const { return buffer_; }
+  bool persistent() const { return mapped_ != nullptr; }
+  // times BeginFrame had to wait for the GPU
+  int num_waits() const { return num_waits_; }
+  // offset alignment required by glBindBufferRange with GL_UNIFORM_BUFFER
+  static GLsizeiptr UniformAlignment();
+
+ private:
+  GLuint buffer_;
+  GLsizeiptr frame_size_;
+  int num_frames_;
+  int frame_;
+  GLsizeiptr cursor_;  // relative to start of current region
+  char* mapped_;
+  std::vector<GLsync> fences_;
+  int num_waits_;
+};
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_STREAM_BUFFER_H */
@@ -7,61 +7,141 @@
 
 #include "text.h"
 
-#include "loader.h"
+#include <cstdint>
 
 using glm::vec2;
+using std::string;
+using std::vector;
 
 namespace wrapper {
 namespace opengl {
+namespace {
 
-Text::Text() {
+const int kFloatsPerVertex{2 + 2};
+const int kVerticesPerGlyph{6};
+// stat text changes every frame, so layouts of old strings are dropped once
+// there are too many of them
+const size_t kMaxCachedLayouts{256};
+
+// malformed sequences are decoded as U+FFFD
+vector<uint32_t> DecodeUtf8(const string& text) {
+  const uint32_t kReplacement = 0xFFFD;
+  vector<uint32_t> code_points;
+  code_points.reserve(text.size());
+  for (size_t i = 0; i < text.size();) {
+    unsigned char lead = text[i];
+    int length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 :
+                 (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+    if (length == 0 || i + length > text.size()) {
+      code_points.push_back(kReplacement);
+      ++i;
+      continue;
+    }
+    uint32_t code_point = length == 1 ? lead : lead & (0x7F >> length);
+    bool valid = true;
+    for (int j = 1; j < length; ++j) {
+      unsigned char next = text[i + j];
+      if ((next >> 6) != 0x2) valid = false;
+      code_point = (code_point << 6) | (next & 0x3F);
+    }
+    code_points.push_back(valid ? code_point : kReplacement);
+    i += valid ? length : 1;
+  }
+  return code_points;
+}
+
+} /* namespace */
+
+Text::Text(const string& font_path, StreamBuffer* stream)
+    : stream_{stream}, atlas_{new GlyphAtlas{font_path}} {
   glGenVertexArrays(1, &vao_);
   glBindVertexArray(vao_);
-  glGenBuffers(1, &vbo_);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-  glBufferData(GL_ARRAY_BUFFER, 6 * (2 + 2) * sizeof(float), NULL,
-               GL_DYNAMIC_DRAW);
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float),
+  // draws select their vertices with the first vertex, since uploads are
+  // aligned to vertex size
+  glBindBuffer(GL_ARRAY_BUFFER, stream_->buffer());
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE,
+                        kFloatsPerVertex * sizeof(float), (void *)0);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE,
+                        kFloatsPerVertex * sizeof(float),
                         (void *)(2 * sizeof(float)));
   glEnableVertexAttribArray(0);
   glEnableVertexAttribArray(1);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindVertexArray(0);
+
+  // rasterize printable ASCII up front, so that common text does not grow
+  // the atlas while rendering
+  for (uint32_t c = 0x20; c < 0x7F; ++c)
+    atlas_->GetGlyph(c);
 }
 
-void Text::renderText(const Shader& shader, const std::string& text,
+const Text::Layout& Text::GetLayout(const string& text, float scale) {
+  LayoutKey key{text, scale};
+  auto found = layouts_.find(key);
+  if (found != layouts_.end() &&
+      found->second.atlas_generation == atlas_->generation())
+    return found->second;
+
+  // rasterize all glyphs first, since that may grow the atlas and change
+  // texture coordinates of glyphs that are already in it
+  vector<uint32_t> code_points = DecodeUtf8(text);
+  vector<const Glyph*> glyphs;
+  glyphs.reserve(code_points.size());
+  for (uint32_t code_point : code_points)
+    glyphs.push_back(&atlas_->GetGlyph(code_point));
+
+  Layout layout{atlas_->generation(), {}};
+  layout.vertices.reserve(glyphs.size() * kVerticesPerGlyph * kFloatsPerVertex);
+  vec2 atlas_size = atlas_->size();
+  float x = 0.0f;
+  for (const Glyph* glyph : glyphs) {
+    float x_pos = x + glyph->bearing.x * scale;
+    float y_pos = -(glyph->size.y - glyph->bearing.y) * scale;
+    vec2 size = vec2(glyph->size) * scale;
+    x += glyph->advance * scale;
+    if (glyph->size.x == 0 || glyph->size.y == 0) continue;  // e.g. space
+
+    vec2 uv_min = vec2(glyph->offset) / atlas_size;
+    vec2 uv_max = vec2(glyph->offset + glyph->size) / atlas_size;
+    float vertex_attrib[kVerticesPerGlyph][kFloatsPerVertex]{
+        {x_pos,          y_pos + size.y, uv_min.x, uv_min.y},
+        {x_pos,          y_pos,          uv_min.x, uv_max.y},
+        {x_pos + size.x, y_pos,          uv_max.x, uv_max.y},
+        {x_pos,          y_pos + size.y, uv_min.x, uv_min.y},
+        {x_pos + size.x, y_pos,          uv_max.x, uv_max.y},
+        {x_pos + size.x, y_pos + size.y, uv_max.x, uv_min.y},
+    };
+    layout.vertices.insert(layout.vertices.end(), &vertex_attrib[0][0],
+                           &vertex_attrib[0][0] + sizeof(vertex_attrib) /
+                                                  sizeof(float));
+  }
+
+  if (found != layouts_.end()) {
+    found->second = std::move(layout);
+    return found->second;
+  }
+  if (layouts_.size() >= kMaxCachedLayouts) layouts_.clear();
+  return layouts_.insert({std::move(key), std::move(layout)}).first->second;
+}
+
+void Text::renderText(const Shader& shader, const string& text,
                       float x, float y, float scale, const glm::vec3& color) {
+  const Layout& layout = GetLayout(text, scale);
+  if (layout.vertices.empty()) return;
+
   shader.Use();
   glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, atlas_->texture());
   shader.set_int("text", 0);
   shader.set_vec3("color", color);
-  glBindVertexArray(vao_);
+  shader.set_vec2("offset", {x, y});
 
-  for (auto c : text) {
-    loader::Character ch = loader::LoadCharacter(c);
-
-    float x_pos = x + ch.bearing.x * scale;
-    float y_pos = y - (ch.size.y - ch.bearing.y) * scale;
-    vec2 size = vec2(ch.size) * scale;
-    x += ch.advance * scale;
-
-    float vertex_attrib[6][4]{
-        {x_pos,          y_pos + size.y, 0.0, 0.0},
-        {x_pos,          y_pos,          0.0, 1.0},
-        {x_pos + size.x, y_pos,          1.0, 1.0},
-        {x_pos,          y_pos + size.y, 0.0, 0.0},
-        {x_pos + size.x, y_pos,          1.0, 1.0},
-        {x_pos + size.x, y_pos + size.y, 1.0, 0.0},
-    };
-
-    glBindTexture(GL_TEXTURE_2D, ch.texture);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertex_attrib), vertex_attrib);
-    glDrawArrays(GL_TRIANGLES, 0, 6);
-  }
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  const GLsizeiptr stride = kFloatsPerVertex * sizeof(float);
+  GLintptr offset = stream_->Upload(
+      layout.vertices.data(), layout.vertices.size() * sizeof(float), stride);
+  glBindVertexArray(vao_);
+  glDrawArrays(GL_TRIANGLES, (GLint)(offset / stride),
+               (GLsizei)(layout.vertices.size() / kFloatsPerVertex));
   glBindVertexArray(0);
 }
 
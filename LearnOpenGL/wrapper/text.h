@@ -8,24 +8,56 @@
 #ifndef WRAPPER_OPENGL_TEXT_H
 #define WRAPPER_OPENGL_TEXT_H
 
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include "glyph_atlas.h"
 #include "shader.h"
+#include "stream_buffer.h"
 
 namespace wrapper {
 namespace opengl {
 
+// text is UTF-8 encoded. each call lays out text (or reuses the layout of
+// the same text and scale) and draws all glyphs with one draw call. vertices
+// are uploaded to stream, which must outlive this object
 class Text {
  public:
-  Text();
+  Text(const std::string& font_path, StreamBuffer* stream);
   void renderText(const Shader& shader, const std::string& text,
                   float x, float y, float scale, const glm::vec3& color);
 
  private:
-  GLuint vao_, vbo_;
+  struct LayoutKey {
+    std::string text;
+    float scale;
+    bool operator==(const LayoutKey& other) const {
+      return scale == other.scale && text == other.text;
+    }
+  };
+  struct LayoutKeyHash {
+    size_t operator()(const LayoutKey& key) const {
+      return std::hash<std::string>{}(key.text) ^
+             (std::hash<float>{}(key.scale) << 1);
+    }
+  };
+  // vertices of glyph quads relative to starting point of text
+  struct Layout {
+    int atlas_generation;
+    std::vector<float> vertices;
+  };
+
+  GLuint vao_;
+  StreamBuffer* stream_;
+  std::unique_ptr<GlyphAtlas> atlas_;
+  std::unordered_map<LayoutKey, Layout, LayoutKeyHash> layouts_;
+
+  const Layout& GetLayout(const std::string& text, float scale);
 };
 
 } /* namespace opengl */
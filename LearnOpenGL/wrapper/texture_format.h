@@ -0,0 +1,59 @@
+#ifndef WRAPPER_OPENGL_TEXTURE_FORMAT_H
+#define WRAPPER_OPENGL_TEXTURE_FORMAT_H
+
+#include <cstdint>
+
+#include <glad/glad.h>
+
+// from EXT_texture_compression_s3tc and EXT_texture_sRGB
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+namespace wrapper {
+namespace opengl {
+namespace texture_format {
+
+// cooked textures are produced offline by the CookTexture tool and hold all
+// mip levels of all faces in their final internal format, so that loading is
+// only mapping the file and uploading each level. layout:
+//   Header
+//   Level[num_faces * num_levels] (face major)
+//   data of each level, aligned to kAlignment
+
+const char kMagic[8]{'L', 'O', 'G', 'L', 'T', 'E', 'X', '\0'};
+const uint32_t kVersion{1};
+const uint32_t kAlignment{16};
+// cooked file of "image.png" is "image.png.ktex", and cooked cubemap of
+// directory "skybox" is "skybox.ktex"
+const char kExtension[]{".ktex"};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_faces;        // 1 for 2D texture, 6 for cubemap
+  uint32_t num_levels;
+  uint32_t internal_format;
+  uint32_t format;           // only meaningful if not compressed
+  uint32_t compressed;
+  uint32_t srgb;
+  uint32_t reserved;
+};
+
+struct Level {
+  uint64_t offset;
+  uint64_t size;
+  uint32_t width;
+  uint32_t height;
+};
+
+} /* namespace texture_format */
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_TEXTURE_FORMAT_H */
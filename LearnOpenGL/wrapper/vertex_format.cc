@@ -0,0 +1,147 @@
+#include "vertex_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <glm/gtc/packing.hpp>
+
+using glm::vec2;
+using glm::vec3;
+using glm::vec4;
+using std::vector;
+
+namespace wrapper {
+namespace opengl {
+namespace {
+
+static_assert(sizeof(Vertex) == 32, "Vertex must be tightly packed");
+static_assert(sizeof(PackedVertex) == 16,
+              "PackedVertex must be tightly packed");
+
+const float kMaxUnorm16 = std::numeric_limits<uint16_t>::max();
+
+uint16_t QuantizeUnorm16(float value) {
+  return static_cast<uint16_t>(
+      std::round(std::min(std::max(value, 0.0f), 1.0f) * kMaxUnorm16));
+}
+
+template<typename T>
+void CopyIndices(const vector<GLuint>& indices,
+                 vector<unsigned char>* bytes) {
+  bytes->resize(indices.size() * sizeof(T));
+  for (size_t i = 0; i < indices.size(); ++i) {
+    T index = static_cast<T>(indices[i]);
+    std::memcpy(bytes->data() + i * sizeof(T), &index, sizeof(T));
+  }
+}
+
+} /* namespace */
+
+const VertexLayout& VertexLayout::Float() {
+  static const VertexLayout layout{
+      sizeof(Vertex), false, {
+          {0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position)},
+          {1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, normal)},
+          {2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, tex_coord)},
+      }};
+  return layout;
+}
+
+const VertexLayout& VertexLayout::Packed() {
+  // normal has 4 components in this format, and shaders only read xyz
+  static const VertexLayout layout{
+      sizeof(PackedVertex), true, {
+          {0, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+           offsetof(PackedVertex, position)},
+          {1, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+           offsetof(PackedVertex, normal)},
+          {2, 2, GL_HALF_FLOAT, GL_FALSE,
+           offsetof(PackedVertex, tex_coord)},
+      }};
+  return layout;
+}
+
+void VertexLayout::Apply() const {
+  for (const auto& attribute : attributes) {
+    glVertexAttribPointer(attribute.location, attribute.size, attribute.type,
+                          attribute.normalized, stride,
+                          (void *)attribute.offset);
+    glEnableVertexAttribArray(attribute.location);
+  }
+}
+
+void SetPositionRange(const vec3& offset, const vec3& scale) {
+  glVertexAttrib3fv(kPositionOffsetLocation, &offset[0]);
+  glVertexAttrib3fv(kPositionScaleLocation, &scale[0]);
+}
+
+void QuantizationError::Extend(const QuantizationError& other) {
+  position = std::max(position, other.position);
+  normal = std::max(normal, other.normal);
+  tex_coord = std::max(tex_coord, other.tex_coord);
+}
+
+size_t IndexSize(GLenum index_type) {
+  return index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(GLuint);
+}
+
+PackedMesh Pack(const vector<Vertex>& vertices,
+                const vector<GLuint>& indices,
+                const AABB& bounds) {
+  PackedMesh packed;
+  packed.vertices.resize(vertices.size());
+  packed.error = QuantizationError{0.0f, 0.0f, 0.0f};
+  // flat meshes have zero size along some axis, where all positions are min
+  vec3 size = bounds.empty() ? vec3(0.0f) : bounds.max - bounds.min;
+
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    const Vertex& vertex = vertices[i];
+    PackedVertex& packed_vertex = packed.vertices[i];
+    for (int j = 0; j < 3; ++j) {
+      float t = size[j] > 0.0f ?
+          (vertex.position[j] - bounds.min[j]) / size[j] : 0.0f;
+      packed_vertex.position[j] = QuantizeUnorm16(t);
+    }
+    packed_vertex.position[3] = 0;
+    vec3 normal = glm::length(vertex.normal) > 0.0f ?
+        glm::normalize(vertex.normal) : vertex.normal;
+    packed_vertex.normal = glm::packSnorm3x10_1x2(vec4(normal, 0.0f));
+    for (int j = 0; j < 2; ++j)
+      packed_vertex.tex_coord[j] = glm::packHalf1x16(vertex.tex_coord[j]);
+
+    // measure what shaders will actually see
+    vec3 position;
+    for (int j = 0; j < 3; ++j) {
+      position[j] = bounds.min[j] +
+          packed_vertex.position[j] / kMaxUnorm16 * size[j];
+    }
+    vec3 unpacked_normal{glm::unpackSnorm3x10_1x2(packed_vertex.normal)};
+    vec2 tex_coord{glm::unpackHalf1x16(packed_vertex.tex_coord[0]),
+                   glm::unpackHalf1x16(packed_vertex.tex_coord[1])};
+    float normal_error = 0.0f;
+    if (glm::length(normal) > 0.0f && glm::length(unpacked_normal) > 0.0f) {
+      float cos_angle = glm::dot(normal, glm::normalize(unpacked_normal));
+      normal_error = glm::degrees(
+          std::acos(std::min(std::max(cos_angle, -1.0f), 1.0f)));
+    }
+    packed.error.Extend(QuantizationError{
+        glm::length(position - vertex.position), normal_error,
+        std::max(std::abs(tex_coord.x - vertex.tex_coord.x),
+                 std::abs(tex_coord.y - vertex.tex_coord.y))});
+  }
+
+  packed.num_indices = indices.size();
+  if (vertices.size() <= std::numeric_limits<uint16_t>::max()) {
+    packed.index_type = GL_UNSIGNED_SHORT;
+    CopyIndices<uint16_t>(indices, &packed.indices);
+  } else {
+    packed.index_type = GL_UNSIGNED_INT;
+    CopyIndices<GLuint>(indices, &packed.indices);
+  }
+  return packed;
+}
+
+} /* namespace opengl */
+} /* namespace wrapper */
@@ -0,0 +1,93 @@
+#ifndef WRAPPER_OPENGL_VERTEX_FORMAT_H
+#define WRAPPER_OPENGL_VERTEX_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+namespace wrapper {
+namespace opengl {
+
+// vertex as imported, 32 bytes
+struct Vertex {
+  glm::vec3 position;
+  glm::vec3 normal;
+  glm::vec2 tex_coord;
+};
+
+// vertex as uploaded, 16 bytes. position is 16-bit normalized within bounds
+// of its mesh, normal is GL_INT_2_10_10_10_REV and texture coordinates are
+// half floats
+struct PackedVertex {
+  uint16_t position[4];  // last one is padding
+  uint32_t normal;
+  uint16_t tex_coord[2];
+};
+
+// vertex shaders read positions as
+//     positionOffset + aPos * positionScale
+// where both are generic attributes at these locations, set per model. they
+// are (0, 0, 0) and (1, 1, 1) for unquantized positions
+const GLuint kPositionOffsetLocation{7};
+const GLuint kPositionScaleLocation{8};
+
+// values of generic attributes are context state, not part of VAO, so they
+// must be set before every draw
+void SetPositionRange(const glm::vec3& offset, const glm::vec3& scale);
+
+struct VertexAttribute {
+  GLuint location;
+  GLint size;
+  GLenum type;
+  GLboolean normalized;
+  size_t offset;
+};
+
+struct VertexLayout {
+  GLsizei stride;
+  bool quantized_position;
+  std::vector<VertexAttribute> attributes;
+
+  // layout of Vertex
+  static const VertexLayout& Float();
+  // layout of PackedVertex
+  static const VertexLayout& Packed();
+  // calls glVertexAttribPointer for all attributes. vertex buffer must be
+  // bound to GL_ARRAY_BUFFER
+  void Apply() const;
+};
+
+// largest difference between original and packed attributes
+struct QuantizationError {
+  float position;  // in model space
+  float normal;    // in degrees
+  float tex_coord;
+
+  void Extend(const QuantizationError& other);
+};
+
+struct PackedMesh {
+  std::vector<PackedVertex> vertices;
+  // GL_UNSIGNED_SHORT if there are less than 65536 vertices, otherwise
+  // GL_UNSIGNED_INT
+  GLenum index_type;
+  size_t num_indices;
+  std::vector<unsigned char> indices;
+  QuantizationError error;
+};
+
+size_t IndexSize(GLenum index_type);
+// positions are quantized within bounds, which should enclose all of them
+PackedMesh Pack(const std::vector<Vertex>& vertices,
+                const std::vector<GLuint>& indices,
+                const AABB& bounds);
+
+} /* namespace opengl */
+} /* namespace wrapper */
+
+#endif /* WRAPPER_OPENGL_VERTEX_FORMAT_H */